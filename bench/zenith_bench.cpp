@@ -0,0 +1,267 @@
+// Microbenchmarks for the CPU paths behind ingest and picking: VpTree build
+// and query, the GLModel ingest copy, animated layer time indexing, and
+// Controls::selectAt (picking without the depth readback). No GL context is
+// needed. Every case runs at each size and thread count and the results are
+// written as JSON, one record per case, size and thread count:
+//
+//   zenith_bench [--sizes 10000,100000,1000000] [--threads 1,2,4]
+//                [--repeats 5] [--filter vptree] [--out results.json]
+//
+// Times are wall-clock seconds per repeat after one untimed warm-up run;
+// items_per_second is based on the median.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Controls.hpp"
+#include "GLModel.hpp"
+#include "Parallel.hpp"
+#include "TimeIndex.hpp"
+#include "vptree.hpp"
+
+typedef VpTree<DataPoint, euclidean_distance> PointTree;
+
+// Keeps results alive so the optimizer can't drop the timed work.
+static volatile size_t sink = 0;
+
+static const float benchColor[4] = {1.0f, 0.0f, 0.0f, 1.0f};
+
+// Points in [-1, 1]^2 at z = 1, as the Python 2D layers store them.
+static std::vector<float> randomPoints(size_t n, unsigned seed) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+    std::vector<float> points(3 * n);
+    for (size_t i = 0; i < n; i++) {
+        points[3 * i] = coordinate(random);
+        points[3 * i + 1] = coordinate(random);
+        points[3 * i + 2] = 1.0f;
+    }
+    return points;
+}
+
+static std::vector<DataPoint> dataPoints(std::vector<float>& points) {
+    std::vector<DataPoint> items;
+    items.reserve(points.size() / 3);
+    for (size_t i = 0; i < points.size() / 3; i++) {
+        items.emplace_back(3, (int) i, &points[3 * i]);
+    }
+    return items;
+}
+
+// Epoch-nanosecond times one millisecond apart, optionally shuffled.
+static std::vector<long> times(size_t n, bool shuffled) {
+    std::vector<long> result(n);
+    for (size_t i = 0; i < n; i++) {
+        result[i] = 1700000000000000000L + (long) i * 1000000L;
+    }
+    if (shuffled)
+        std::shuffle(result.begin(), result.end(), std::mt19937(7));
+    return result;
+}
+
+struct BenchCase {
+    const char* name;
+    // Builds the inputs for n points outside the timed region and returns
+    // the timed body, which reports how many items it processed.
+    std::function<std::function<size_t()>(size_t n)> prepare;
+};
+
+static std::vector<BenchCase> benchCases() {
+    std::vector<BenchCase> cases;
+    cases.push_back({"vptree_build", [](size_t n) {
+        auto points = std::make_shared<std::vector<float>>(randomPoints(n, 1));
+        auto items = std::make_shared<std::vector<DataPoint>>(dataPoints(*points));
+        return std::function<size_t()>([points, items, n]() {
+            PointTree tree;
+            tree.create(*items);
+            sink += tree._items.size();
+            return n;
+        });
+    }});
+    cases.push_back({"vptree_query", [](size_t n) {
+        auto points = std::make_shared<std::vector<float>>(randomPoints(n, 1));
+        auto tree = std::make_shared<PointTree>();
+        tree->create(dataPoints(*points));
+        auto queries = std::make_shared<std::vector<float>>(randomPoints(10000, 2));
+        return std::function<size_t()>([points, tree, queries]() {
+            std::vector<DataPoint> results;
+            std::vector<float> distances;
+            size_t count = queries->size() / 3;
+            for (size_t i = 0; i < count; i++) {
+                DataPoint query(3, 0, &(*queries)[3 * i]);
+                results.clear();
+                distances.clear();
+                tree->search(query, 1, &results, &distances);
+                sink += results.size();
+            }
+            return count;
+        });
+    }});
+    struct Ingest {
+        const char* name;
+        bool picking;
+        int spatialOrder;
+    };
+    const Ingest ingests[] = {
+        {"glmodel_ingest", false, SPATIAL_ORDER_NONE},
+        {"glmodel_ingest_hilbert", false, SPATIAL_ORDER_HILBERT},
+        {"glmodel_ingest_picking", true, SPATIAL_ORDER_NONE},
+    };
+    for (const Ingest& ingest : ingests) {
+        cases.push_back({ingest.name, [ingest](size_t n) {
+            auto points = std::make_shared<std::vector<float>>(randomPoints(n, 1));
+            return std::function<size_t()>([points, ingest, n]() {
+                GLModel model(points->data(), (int) n, 3, 0, GL_POINTS, "bench", benchColor, nullptr, 0, 1,
+                              std::vector<std::string>(), ingest.picking, ingest.spatialOrder);
+                sink += model.permutation.size();
+                return n;
+            });
+        }});
+    }
+    for (bool shuffled : {false, true}) {
+        cases.push_back({shuffled ? "animated_ingest_shuffled" : "animated_ingest_sorted", [shuffled](size_t n) {
+            auto points = std::make_shared<std::vector<float>>(randomPoints(n, 1));
+            auto stamps = std::make_shared<std::vector<long>>(times(n, shuffled));
+            return std::function<size_t()>([points, stamps, n]() {
+                GLModelAnimated model(points->data(), (int) n, 3, 0, GL_POINTS, 1000000, 1000000, stamps->data(),
+                                      "bench", benchColor, nullptr, 0, 1, std::vector<std::string>(), false);
+                sink += (size_t) model.numSteps;
+                return n;
+            });
+        }});
+    }
+    cases.push_back({"time_search", [](size_t n) {
+        auto stamps = std::make_shared<std::vector<long>>(times(n, false));
+        auto targets = std::make_shared<std::vector<long>>(times(100000, true));
+        long span = (*stamps)[n - 1] - (*stamps)[0] + 1;
+        for (auto && target : *targets) {
+            target = (*stamps)[0] + (target % span + span) % span;
+        }
+        return std::function<size_t()>([stamps, targets, n]() {
+            for (long target : *targets) {
+                sink += firstTimeAfter(stamps->data(), n, target);
+            }
+            return targets->size();
+        });
+    }});
+    cases.push_back({"select", [](size_t n) {
+        // The 2D engine's camera over the unit square, 1000 pixels wide;
+        // clicks land near random points.
+        auto points = std::make_shared<std::vector<float>>(randomPoints(n, 1));
+        auto tree = std::make_shared<PointTree>();
+        tree->create(dataPoints(*points));
+        glm::mat4 identity(1.0f);
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 projection = glm::ortho(-1.05f, 1.05f, -1.05f, 1.05f, 0.9f, 100.0f);
+        glm::vec4 viewport(0.0f, 0.0f, 1000.0f, 1000.0f);
+        auto clicks = std::make_shared<std::vector<glm::vec3>>();
+        std::vector<float> targets = randomPoints(10000, 3);
+        for (size_t i = 0; i < targets.size() / 3; i++) {
+            glm::vec3 target = glm::vec3(targets[3 * i], targets[3 * i + 1], targets[3 * i + 2]);
+            clicks->push_back(glm::project(target, view, projection, viewport));
+        }
+        return std::function<size_t()>([points, tree, clicks, identity, view, projection]() {
+            for (auto && click : *clicks) {
+                auto selection = Controls::selectAt(click, 1000, 1000, identity, view, projection, identity, tree.get());
+                sink += (size_t) std::get<0>(selection);
+            }
+            return clicks->size();
+        });
+    }});
+    return cases;
+}
+
+static std::vector<long> parseList(const char* text) {
+    std::vector<long> values;
+    for (const char* at = text; *at != '\0';) {
+        char* end;
+        long value = strtol(at, &end, 10);
+        if (end == at)
+            break;
+        values.push_back(value);
+        at = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+int main(int argc, char** argv) {
+    std::vector<long> sizes = {10000, 100000, 1000000};
+    std::vector<long> threadCounts = {1, (long) std::max(1u, std::thread::hardware_concurrency())};
+    int repeats = 5;
+    std::string filter;
+    std::string outPath;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--sizes") && hasValue) {
+            sizes = parseList(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && hasValue) {
+            threadCounts = parseList(argv[++i]);
+        } else if (!strcmp(argv[i], "--repeats") && hasValue) {
+            repeats = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--filter") && hasValue) {
+            filter = argv[++i];
+        } else if (!strcmp(argv[i], "--out") && hasValue) {
+            outPath = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--sizes N,...] [--threads T,...] [--repeats R] [--filter NAME] [--out FILE]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+
+    FILE* out = outPath.empty() ? stdout : fopen(outPath.c_str(), "w");
+    if (out == nullptr) {
+        fprintf(stderr, "zenith: could not open %s\n", outPath.c_str());
+        return 1;
+    }
+    fprintf(out, "{\n  \"context\": {\"hardware_concurrency\": %u, \"repeats\": %d},\n  \"benchmarks\": [",
+            std::thread::hardware_concurrency(), repeats);
+    bool first = true;
+    for (auto && bench : benchCases()) {
+        if (!filter.empty() && strstr(bench.name, filter.c_str()) == nullptr)
+            continue;
+        for (long size : sizes) {
+            if (size < 2)
+                continue;
+            for (long threads : threadCounts) {
+                setParallelThreadCount((int) threads);
+                std::function<size_t()> body = bench.prepare((size_t) size);
+                size_t items = body();
+                std::vector<double> seconds;
+                for (int r = 0; r < repeats; r++) {
+                    auto start = std::chrono::steady_clock::now();
+                    items = body();
+                    seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+                }
+                std::sort(seconds.begin(), seconds.end());
+                double mean = 0.0;
+                for (double s : seconds) {
+                    mean += s / seconds.size();
+                }
+                double median = seconds[seconds.size() / 2];
+                fprintf(out,
+                        "%s\n    {\"name\": \"%s\", \"size\": %ld, \"threads\": %ld, \"items\": %zu, "
+                        "\"min_seconds\": %.9f, \"median_seconds\": %.9f, \"mean_seconds\": %.9f, "
+                        "\"max_seconds\": %.9f, \"items_per_second\": %.1f}",
+                        first ? "" : ",", bench.name, size, threads, items,
+                        seconds.front(), median, mean, seconds.back(), median > 0.0 ? items / median : 0.0);
+                first = false;
+                fflush(out);
+            }
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout)
+        fclose(out);
+    setParallelThreadCount(0);
+    return 0;
+}
@@ -0,0 +1,190 @@
+// Frame-time benchmark: replays a camera path with the offscreen context
+// (EGL, including Mesa's llvmpipe, or a hidden GLFW window) and reports
+// frame-time percentiles, CPU time per phase and draw calls as JSON.
+//
+//   zenith_frames [--3d] [--points 1000000] [--layers 4] [--style points|lines]
+//                 [--data vertices.f32] [--no-picking]
+//                 [--path recorded.path | --frames 300 --width 1280 --height 720]
+//                 [--save-path synthetic.path] [--out results.json]
+//                 [--trace trace.json]
+//
+// Without --data the layers are random points (or random walks for lines)
+// split evenly over --layers; --data loads raw float32 x, y, z triples as
+// one layer. Without --path a synthetic path is generated that pans, zooms,
+// turns and sweeps the hover cursor over the data. Paths are recorded from
+// the window with Engine::recording (record_camera_path in Python).
+// --trace writes the profiling zones as Chrome trace-event JSON; it needs
+// a build with ZENITH_ENABLE_TRACING.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "CameraPath.hpp"
+#include "Engine.hpp"
+#include "GLModel.hpp"
+#include "MappedFile.hpp"
+#include "Tracing.hpp"
+
+static const float layerColor[4] = {0.2f, 0.6f, 1.0f, 0.6f};
+
+// Points in [-1, 1]^3 (z = 1 in 2D, as the Python 2D layers store them);
+// for line strips, a random walk through the same box.
+static std::vector<float> randomVertices(size_t n, bool lines, bool flat, unsigned seed) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+    std::normal_distribution<float> step(0.0f, 0.01f);
+    std::vector<float> vertices(3 * n);
+    float at[3] = {0.0f, 0.0f, 0.0f};
+    for (size_t i = 0; i < n; i++) {
+        for (int c = 0; c < 3; c++) {
+            at[c] = lines ? std::min(1.0f, std::max(-1.0f, at[c] + step(random))) : coordinate(random);
+            vertices[3 * i + c] = at[c];
+        }
+        if (flat)
+            vertices[3 * i + 2] = 1.0f;
+    }
+    return vertices;
+}
+
+static bool loadVertices(const std::string& path, std::vector<float>* vertices) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    size_t count = file.size / (3 * sizeof(float));
+    vertices->resize(3 * count);
+    if (count > 0)
+        memcpy(vertices->data(), file.data, 3 * count * sizeof(float));
+    return count > 0;
+}
+
+int main(int argc, char** argv) {
+    bool threeD = false;
+    long points = 1000000;
+    long layers = 4;
+    bool lines = false;
+    bool picking = true;
+    long frames = 300;
+    int width = 1280;
+    int height = 720;
+    std::string dataPath;
+    std::string pathFile;
+    std::string savePath;
+    std::string outPath;
+    std::string tracePath;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--3d")) {
+            threeD = true;
+        } else if (!strcmp(argv[i], "--no-picking")) {
+            picking = false;
+        } else if (!strcmp(argv[i], "--points") && hasValue) {
+            points = std::max(1L, atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--layers") && hasValue) {
+            layers = std::max(1L, atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--style") && hasValue) {
+            lines = !strcmp(argv[++i], "lines");
+        } else if (!strcmp(argv[i], "--data") && hasValue) {
+            dataPath = argv[++i];
+        } else if (!strcmp(argv[i], "--path") && hasValue) {
+            pathFile = argv[++i];
+        } else if (!strcmp(argv[i], "--frames") && hasValue) {
+            frames = std::max(1L, atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--width") && hasValue) {
+            width = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--height") && hasValue) {
+            height = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--save-path") && hasValue) {
+            savePath = argv[++i];
+        } else if (!strcmp(argv[i], "--out") && hasValue) {
+            outPath = argv[++i];
+        } else if (!strcmp(argv[i], "--trace") && hasValue) {
+            tracePath = argv[++i];
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--3d] [--points N] [--layers L] [--style points|lines] [--data FILE] [--no-picking]\n"
+                    "       [--path FILE | --frames N --width W --height H] [--save-path FILE] [--out FILE]\n"
+                    "       [--trace FILE]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    std::unique_ptr<Engine> engine(threeD ? new Engine3d() : new Engine());
+    GLuint drawType = lines ? GL_LINE_STRIP : GL_POINTS;
+    std::vector<std::vector<float>> data;
+    if (!dataPath.empty()) {
+        data.emplace_back();
+        if (!loadVertices(dataPath, &data.back())) {
+            fprintf(stderr, "zenith: no vertices in %s\n", dataPath.c_str());
+            return 1;
+        }
+        points = (long) data.back().size() / 3;
+        layers = 1;
+    } else {
+        for (long layer = 0; layer < layers; layer++) {
+            long share = points / layers + (layer < points % layers ? 1 : 0);
+            data.push_back(randomVertices((size_t) std::max(share, 1L), lines, !threeD, (unsigned) layer + 1));
+        }
+    }
+    for (size_t layer = 0; layer < data.size(); layer++) {
+        std::string name = "layer " + std::to_string(layer);
+        engine->addModel((int) layer, std::shared_ptr<GLModel>(new GLModel(
+            data[layer].data(), (int) (data[layer].size() / 3), 3, 0, drawType, name,
+            layerColor, nullptr, 0, (int) layer, {}, picking)));
+    }
+    // Layers keep their own copies.
+    data.clear();
+
+    CameraPath path;
+    if (!pathFile.empty()) {
+        if (!path.load(pathFile))
+            return 1;
+    } else {
+        path = engine->syntheticCameraPath(width, height, frames, 60.0);
+    }
+    if (!savePath.empty() && !path.save(savePath))
+        return 1;
+
+    ReplayReport report;
+    if (!engine->replayCameraPath(path, &report)) {
+        fprintf(stderr, "zenith: could not replay the camera path offscreen\n");
+        return 1;
+    }
+    if (!tracePath.empty() && !traceExport(tracePath)) {
+        fprintf(stderr, "zenith: could not write a trace to %s (built without ZENITH_ENABLE_TRACING?)\n",
+                tracePath.c_str());
+        return 1;
+    }
+
+    FILE* out = outPath.empty() ? stdout : fopen(outPath.c_str(), "w");
+    if (out == nullptr) {
+        fprintf(stderr, "zenith: could not open %s\n", outPath.c_str());
+        return 1;
+    }
+    unsigned long maxDrawCalls = 0;
+    for (auto && frame : report.frames) {
+        maxDrawCalls = std::max(maxDrawCalls, frame.drawCalls);
+    }
+    const double ms = 1000.0;
+    fprintf(out,
+            "{\n  \"context\": {\"backend\": \"%s\", \"engine\": \"%s\", \"width\": %d, \"height\": %d, "
+            "\"frames\": %zu, \"points\": %ld, \"layers\": %ld, \"style\": \"%s\", \"picking\": %s, \"path\": \"%s\"},\n",
+            report.backend.c_str(), threeD ? "3d" : "2d", report.width, report.height,
+            report.frames.size(), points, layers, lines ? "lines" : "points", picking ? "true" : "false",
+            pathFile.empty() ? "synthetic" : pathFile.c_str());
+    fprintf(out,
+            "  \"frame_ms\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f},\n",
+            report.p50 * ms, report.p95 * ms, report.p99 * ms, report.max * ms, report.mean.total * ms);
+    fprintf(out,
+            "  \"phase_ms\": {\"update\": %.4f, \"pick\": %.4f, \"draw\": %.4f, \"finish\": %.4f},\n",
+            report.mean.update * ms, report.mean.pick * ms, report.mean.draw * ms, report.mean.finish * ms);
+    fprintf(out, "  \"draw_calls\": {\"mean\": %lu, \"max\": %lu}\n}\n", report.mean.drawCalls, maxDrawCalls);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -76,11 +76,19 @@ zenith_viz_include_dirs = [
     fq_path("zenith_viz/cpp/imgui"),
     str(get_pybind_include()),
 ]
+
+# ZENITH_ENABLE_TRACING=1 pip install . builds in the profiling zones (see
+# zenith_viz/cpp/Tracing.hpp); without it they compile to nothing.
+zenith_viz_define_macros = []
+if os.environ.get("ZENITH_ENABLE_TRACING", "0") not in ("", "0"):
+    zenith_viz_define_macros.append(("ZENITH_ENABLE_TRACING", "1"))
+
 ext_modules = [
     Extension(
         "_zenith",
         zenith_viz_srcs_with_deps,
         include_dirs=zenith_viz_include_dirs,
+        define_macros=zenith_viz_define_macros,
         language="c++",
         extra_compile_args=["-g"],
     ),
@@ -134,6 +142,8 @@ class BuildExt(build_ext):
         link_opts = self.l_opts.get(ct, [])
         if sys.platform == "linux" or sys.platform == "linux2":
             opts.append("-D_GLFW_X11")
+            # The offscreen context loads libEGL at runtime.
+            link_opts.append("-ldl")
         elif sys.platform == "darwin":
             original_compile_func = self.compiler._compile
 
@@ -179,8 +189,6 @@ setup(
     package_data={
         "zenith_viz": [
             "zenith_viz/resources/colors.yml",
-            "zenith_viz/shaders/fragmentShader.shader",
-            "zenith_viz/shaders/vertexShader.shader",
         ],
     },
     include_package_data=True,
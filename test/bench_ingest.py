@@ -0,0 +1,178 @@
+"""Ingest latency and peak memory of the Python layer API.
+
+Times Zenith2D/Zenith3D.add_layer and add_animated_layer from numpy input to
+a registered layer (validation, vstack/ravel, the create_gl_model copy and
+the picking index) for float32 and float64 input, with and without picking
+and string data, and reports the peak resident set size of each run. No
+window is opened, so it runs without a display:
+
+    python test/bench_ingest.py [--sizes 1000,100000,10000000]
+                                [--cases 2d_float64,2d_picking]
+                                [--repeats 3] [--out results.json]
+
+Every case and size runs in a fresh interpreter, so peak RSS belongs to that
+run alone; ingest_peak_bytes is the growth of the peak over what the input
+arrays already took. Picking and string cases skip sizes over
+--max-indexed (10M by default), where the index or the Python strings alone
+need tens of gigabytes; pass --max-indexed 100000000 to run them anyway.
+"""
+import argparse
+import json
+import os
+import platform
+import resource
+import statistics
+import subprocess
+import sys
+import time
+
+DEFAULT_SIZES = [1000, 10000, 100000, 1000000, 10000000, 100000000]
+
+# name -> (plot class, input dtype, picking, string data, animated)
+CASES = {
+    "2d_float64": ("Zenith2D", "float64", False, False, False),
+    "2d_float32": ("Zenith2D", "float32", False, False, False),
+    "2d_picking": ("Zenith2D", "float64", True, False, False),
+    "2d_strings": ("Zenith2D", "float64", False, True, False),
+    "2d_animated": ("Zenith2D", "float64", False, False, True),
+    "3d_float64": ("Zenith3D", "float64", False, False, False),
+    "3d_float32": ("Zenith3D", "float32", False, False, False),
+    "3d_picking": ("Zenith3D", "float64", True, False, False),
+    "3d_animated": ("Zenith3D", "float64", False, False, True),
+}
+
+
+def peak_rss_bytes() -> int:
+    peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    # Kilobytes on Linux, bytes on macOS.
+    return peak if sys.platform == "darwin" else peak * 1024
+
+
+def run_case(name: str, size: int, repeats: int) -> dict:
+    """Runs one case in this process; called in the worker interpreter."""
+    import numpy as np
+    from zenith_viz.zenith_viz import Zenith2D, Zenith3D, DrawStyles
+
+    plot_class, dtype, picking, strings, animated = CASES[name]
+    rng = np.random.default_rng(1)
+    x = rng.uniform(-1.0, 1.0, size).astype(dtype)
+    y = rng.uniform(-1.0, 1.0, size).astype(dtype)
+    z = rng.uniform(-1.0, 1.0, size).astype(dtype)
+    times = np.arange(size, dtype=np.int64) * 1000
+    string_data = [str(i) for i in range(size)] if strings else None
+    baseline = peak_rss_bytes()
+
+    def ingest():
+        plot = Zenith2D() if plot_class == "Zenith2D" else Zenith3D()
+        coordinates = (x, y) if plot_class == "Zenith2D" else (x, y, z)
+        start = time.perf_counter()
+        if animated:
+            layer = plot.add_animated_layer(
+                *coordinates,
+                times,
+                color=(255, 0, 0),
+                draw_style=DrawStyles.GL_POINTS,
+                window_size=max(1, size // 100),
+                name="bench",
+                string_data=string_data,
+                picking_enabled=picking,
+            )
+        else:
+            layer = plot.add_layer(
+                *coordinates,
+                color=(255, 0, 0),
+                name="bench",
+                draw_style=DrawStyles.GL_POINTS,
+                string_data=string_data,
+                picking_enabled=picking,
+            )
+        seconds = time.perf_counter() - start
+        assert layer, "add_layer failed"
+        return seconds
+
+    seconds = [ingest() for _ in range(repeats)]
+    peak = peak_rss_bytes()
+    median = statistics.median(seconds)
+    return {
+        "name": name,
+        "size": size,
+        "dtype": dtype,
+        "picking": picking,
+        "strings": strings,
+        "animated": animated,
+        "min_seconds": min(seconds),
+        "median_seconds": median,
+        "max_seconds": max(seconds),
+        "points_per_second": size / median if median > 0 else 0.0,
+        "peak_rss_bytes": peak,
+        "ingest_peak_bytes": peak - baseline,
+        "ingest_bytes_per_point": (peak - baseline) / size,
+    }
+
+
+def run_worker(name: str, size: int, repeats: int) -> dict:
+    """Runs one case in a fresh interpreter and returns its record."""
+    command = [
+        sys.executable,
+        os.path.abspath(__file__),
+        "--worker",
+        name,
+        str(size),
+        str(repeats),
+    ]
+    completed = subprocess.run(command, stdout=subprocess.PIPE, universal_newlines=True)
+    if completed.returncode != 0:
+        return {"name": name, "size": size, "error": completed.returncode}
+    return json.loads(completed.stdout.strip().splitlines()[-1])
+
+
+def main(argv=None) -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--sizes", default=",".join(str(s) for s in DEFAULT_SIZES[:-1]))
+    parser.add_argument("--cases", default=",".join(CASES))
+    parser.add_argument("--repeats", type=int, default=3)
+    parser.add_argument("--max-indexed", type=int, default=10000000)
+    parser.add_argument("--out", default=None)
+    parser.add_argument("--worker", nargs=3, metavar=("CASE", "SIZE", "REPEATS"), help=argparse.SUPPRESS)
+    args = parser.parse_args(argv)
+
+    if args.worker:
+        name, size, repeats = args.worker
+        print(json.dumps(run_case(name, int(size), max(1, int(repeats)))))
+        return 0
+
+    sizes = [int(size) for size in args.sizes.split(",") if size]
+    names = [name for name in args.cases.split(",") if name]
+    unknown = [name for name in names if name not in CASES]
+    if unknown:
+        parser.error("unknown cases: {} (known: {})".format(", ".join(unknown), ", ".join(CASES)))
+
+    records = []
+    for name in names:
+        _, _, picking, strings, _ = CASES[name]
+        for size in sizes:
+            if (picking or strings) and size > args.max_indexed:
+                continue
+            record = run_worker(name, size, max(1, args.repeats))
+            records.append(record)
+            print(json.dumps(record), file=sys.stderr)
+
+    report = {
+        "context": {
+            "python": platform.python_version(),
+            "machine": platform.machine(),
+            "cpus": os.cpu_count(),
+            "repeats": args.repeats,
+        },
+        "benchmarks": records,
+    }
+    if args.out:
+        with open(args.out, "w") as out:
+            json.dump(report, out, indent=2)
+    else:
+        print(json.dumps(report, indent=2))
+    return 1 if any("error" in record for record in records) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
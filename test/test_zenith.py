@@ -1,7 +1,24 @@
+import gc
+import json
+import os
+import subprocess
+import sys
+import time
+import weakref
 from functools import reduce
 
 import numpy as np
-from zenith_viz.zenith_viz import Zenith2D, DrawStyles, InvalidColorRepresentationError
+import pytest
+from zenith_viz.zenith_viz import (
+    Zenith2D,
+    Zenith3D,
+    DrawStyles,
+    SpatialOrder,
+    InvalidColorRepresentationError,
+    export_trace,
+    clear_trace,
+    tracing_enabled,
+)
 
 plot = Zenith2D()
 
@@ -66,6 +83,42 @@ def test_draw_style_input_can_handle_enum():
         assert plot._check_draw_style(enum_member) == value
 
 
+def test_spatial_order_input_can_handle_enum():
+    for _, enum_member in SpatialOrder._value2member_map_.items():
+        value = enum_member.value
+        assert plot._check_spatial_order(value) == enum_member.value
+        assert plot._check_spatial_order(enum_member) == value
+    assert plot._check_spatial_order(7) == 0
+
+
+def test_spatially_ordered_layer_with_picking_and_strings():
+    x_data = np.random.randn(1000)
+    y_data = np.random.randn(1000)
+    string_data = [str(i) for i in range(1000)]
+    for order in (SpatialOrder.MORTON, SpatialOrder.HILBERT):
+        layer = plot.add_layer(
+            x_data,
+            y_data,
+            name="ordered",
+            color="firebrick",
+            draw_style=DrawStyles.GL_POINTS,
+            string_data=string_data,
+            picking_enabled=True,
+            spatial_order=order,
+        )
+        assert layer
+        model = plot.__layers__[layer]
+        stored = [model.original_index(i) for i in range(1000)]
+        assert sorted(stored) == list(range(1000))
+        assert stored != list(range(1000))
+        # Picking answers with the caller's index, and its string with it.
+        for index in (0, 123, 999):
+            picked = model.nearest_index(x_data[index], y_data[index], 1.0)
+            assert picked == index
+            assert model.string_data(picked) == string_data[index]
+        assert plot.remove_layer(layer)
+
+
 def test_layer_creating_with_different_x_y_len_fails():
     x_data = np.random.randn(100)
     y_data = np.random.randn(101)
@@ -103,6 +156,772 @@ def test_adding_several_layers_then_removing_two():
     assert plot.__engine__.num_models() == 2
 
 
+def test_batching_can_be_toggled_with_many_small_layers():
+    batch_plot = Zenith2D()
+    batch_plot.set_batching(True, 1000)
+    rng = np.random.default_rng(7)
+    for i in range(50):
+        layer = batch_plot.add_layer(
+            rng.standard_normal(10),
+            rng.standard_normal(10),
+            name="small" + str(i),
+            color=(5 * i, 64, 255 - 5 * i),
+            draw_style=DrawStyles.GL_POINTS,
+        )
+        assert layer
+    assert batch_plot.__engine__.num_models() == 50
+
+    def draw():
+        image = batch_plot.render_to_array(64, 48)
+        if image is None or batch_plot.benchmark_camera_path(width=64, height=48, frames=1) is None:
+            pytest.skip("no offscreen GL context available")
+        return image, batch_plot.frame_stats()["draw_calls"]
+
+    batched, batched_calls = draw()
+    batch_plot.set_batching(False)
+    unbatched, unbatched_calls = draw()
+    batch_plot.close_headless()
+    assert batched_calls < unbatched_calls
+    assert np.array_equal(batched, unbatched)
+
+
+def test_buffer_stats_are_empty_before_show():
+    stats = Zenith2D().buffer_stats()
+    assert stats["blocks"] == 0
+    assert stats["used_bytes"] == 0
+    assert stats["driver_allocations"] == 0
+
+
+def _current_rss_bytes():
+    try:
+        with open("/proc/self/statm") as statm:
+            return int(statm.read().split()[1]) * os.sysconf("SC_PAGE_SIZE")
+    except (OSError, ValueError):
+        return None
+
+
+def test_rotating_layers_keeps_memory_steady():
+    soak_plot = Zenith2D()
+    x_data = np.random.randn(20000)
+    y_data = np.random.randn(20000)
+    string_data = [str(i) for i in range(20000)]
+
+    def rotate(rounds):
+        for _ in range(rounds):
+            layer = soak_plot.add_layer(
+                x_data,
+                y_data,
+                name="rotating",
+                color="firebrick",
+                draw_style=DrawStyles.GL_POINTS,
+                string_data=string_data,
+                picking_enabled=True,
+            )
+            # Drawing uploads the layer into the arena, so removing it has
+            # GPU memory to give back.
+            if soak_plot.render_to_array(32, 32) is None:
+                return False
+            assert soak_plot.remove_layer(layer)
+        return True
+
+    if not rotate(10):
+        pytest.skip("no offscreen GL context available")
+    baseline = _current_rss_bytes()
+    baseline_stats = soak_plot.buffer_stats()
+    rotate(100)
+    # One more frame hands the last removed layer to the release queue.
+    soak_plot.render_to_array(32, 32)
+    stats = soak_plot.buffer_stats()
+    soak_plot.close_headless()
+    assert soak_plot.__engine__.num_models() == 0
+    # Only the last few layers may still wait on their fences; a leak would
+    # hold on to one per round.
+    layer_bytes = 3 * 4 * len(x_data)
+    assert stats["pending_releases"] <= 2
+    assert stats["used_bytes"] <= 2 * layer_bytes
+    assert stats["reserved_bytes"] <= baseline_stats["reserved_bytes"]
+    if baseline is not None:
+        # Each leaked layer would hold a few MB of vertices, strings and
+        # picking index.
+        assert _current_rss_bytes() - baseline < 64 * 1024 * 1024
+
+
+def test_memory_budget_callback_can_query_the_plot():
+    budget_plot = Zenith2D()
+    budget_plot.add_layer(
+        np.random.randn(1000),
+        np.random.randn(1000),
+        name="over budget",
+        color="firebrick",
+        draw_style=DrawStyles.GL_POINTS,
+    )
+    seen = []
+
+    def callback(cpu: int, gpu: int) -> None:
+        # Runs once the command that crossed the budget has finished, so
+        # the engine can be queried from here.
+        seen.append(len(budget_plot.memory_stats()))
+
+    budget_plot.set_memory_budget(cpu_bytes=1, callback=callback)
+    assert len(seen) == 1
+    assert seen[0] > 0
+
+
+def test_default_memory_budget_callback_does_not_keep_the_plot_alive():
+    budget_plot = Zenith2D()
+    budget_plot.set_memory_budget(cpu_bytes=1)
+    plot_ref = weakref.ref(budget_plot)
+    del budget_plot
+    gc.collect()
+    assert plot_ref() is None
+
+
+def test_memory_stats_break_down_layer_bytes():
+    stats_plot = Zenith2D()
+    layer = stats_plot.add_layer(
+        np.random.randn(1000),
+        np.random.randn(1000),
+        name="accounted",
+        color="firebrick",
+        draw_style=DrawStyles.GL_POINTS,
+        string_data=[str(i) for i in range(1000)],
+        picking_enabled=True,
+    )
+    stats = stats_plot.memory_stats()
+    layer_stats = stats["layers"][layer]
+    assert layer_stats["name"] == "accounted"
+    assert layer_stats["cpu"]["vertices"] == 1000 * 3 * 4
+    assert layer_stats["cpu"]["colors"] == 0
+    assert layer_stats["cpu"]["strings"] > 0
+    assert layer_stats["cpu"]["picking"] > 0
+    assert layer_stats["gpu_bytes"] == 0
+    assert stats["cpu_bytes"] == layer_stats["cpu_bytes"]
+
+
+def test_animated_layer_time_index_scales_with_points():
+    index_plot = Zenith2D()
+    # Nanosecond epochs with a step of one used to size the index by the
+    # time span; shuffled times are sorted along with their vertices.
+    times = 1_700_000_000_000_000_000 + np.arange(500, dtype=np.int64) * 1_000_000_000
+    np.random.shuffle(times)
+    layer = index_plot.add_animated_layer(
+        np.random.randn(500),
+        np.random.randn(500),
+        times,
+        color="firebrick",
+        draw_style=DrawStyles.GL_POINTS,
+        window_size=1,
+        name="epochs",
+    )
+    layer_stats = index_plot.memory_stats()["layers"][layer]
+    assert layer_stats["cpu"]["time"] == 500 * 8
+    assert layer_stats["cpu"]["permutation"] == 500 * 4
+
+
+def test_memory_budget_hook_fires_when_exceeded():
+    budget_plot = Zenith2D()
+    exceeded = []
+    budget_plot.set_memory_budget(
+        cpu_bytes=10000, callback=lambda cpu, gpu: exceeded.append(cpu)
+    )
+    budget_plot.add_layer(
+        np.random.randn(100),
+        np.random.randn(100),
+        name="small",
+        color="firebrick",
+        draw_style=DrawStyles.GL_POINTS,
+    )
+    assert not exceeded
+    budget_plot.add_layer(
+        np.random.randn(10000),
+        np.random.randn(10000),
+        name="large",
+        color="firebrick",
+        draw_style=DrawStyles.GL_POINTS,
+    )
+    assert len(exceeded) == 1
+    assert exceeded[0] > 10000
+
+
+def test_continuous_rendering_can_be_toggled():
+    render_plot = Zenith2D()
+    render_plot.set_continuous_rendering(True)
+    render_plot.set_continuous_rendering(False)
+    assert render_plot.__engine__.num_models() == 0
+
+
+def test_layer_commands_return_futures():
+    future_plot = Zenith2D()
+    layer = future_plot.add_layer(
+        np.random.randn(100),
+        np.random.randn(100),
+        name="queued",
+        color="firebrick",
+        draw_style=DrawStyles.GL_POINTS,
+    )
+    future = future_plot.remove_layer(layer, block=False)
+    assert future.wait(1.0)
+    assert future.done()
+    assert future.result()
+    assert not future_plot.remove_layer(layer, block=False).result()
+
+
+def test_layer_changes_are_visible_immediately():
+    scene_plot = Zenith2D()
+    layer = scene_plot.add_layer(
+        np.random.randn(100),
+        np.random.randn(100),
+        name="published",
+        color="firebrick",
+        draw_style=DrawStyles.GL_POINTS,
+    )
+    assert scene_plot.__engine__.model_exists(layer)
+    future = scene_plot.remove_layer(layer, block=False)
+    assert not scene_plot.__engine__.model_exists(layer)
+    assert future.result()
+
+
+def test_render_to_array_draws_layers_offscreen():
+    offscreen_plot = Zenith3D()
+    red = offscreen_plot.add_layer(
+        np.linspace(-1.0, 1.0, 200),
+        np.zeros(200),
+        np.zeros(200),
+        color=(1.0, 0.0, 0.0),
+        name="red",
+        draw_style=DrawStyles.GL_POINTS,
+    )
+    green = offscreen_plot.add_layer(
+        np.zeros(200),
+        np.linspace(-1.0, 1.0, 200),
+        np.zeros(200),
+        color=(0.0, 1.0, 0.0),
+        name="green",
+        draw_style=DrawStyles.GL_POINTS,
+    )
+    image = offscreen_plot.render_to_array(160, 120)
+    if image is None:
+        pytest.skip("no offscreen GL context available")
+    assert image.shape == (120, 160, 4)
+    assert image.dtype == np.uint8
+    assert (image[:, :, 3] == 255).all()
+    assert (image[:, :, 0] > 100).any() and (image[:, :, 1] > 100).any()
+
+    only_red, only_green = offscreen_plot.render_batch(
+        160, 120, [None], layer_sets=[[red], [green]]
+    )
+    assert (only_red[:, :, 0] > 100).any() and not (only_red[:, :, 1] > 100).any()
+    assert (only_green[:, :, 1] > 100).any() and not (only_green[:, :, 0] > 100).any()
+    offscreen_plot.close_headless()
+
+
+def test_export_frames_writes_one_frame_per_animation_step(tmp_path):
+    export_plot = Zenith2D()
+    export_plot.add_animated_layer(
+        np.linspace(-1.0, 1.0, 60),
+        np.zeros(60),
+        np.arange(60),
+        color="firebrick",
+        draw_style=DrawStyles.GL_POINTS,
+        window_size=5,
+        name="animated",
+    )
+    path = str(tmp_path / "out.y4m")
+    stats = export_plot.export_frames(path, 64, 48)
+    if stats is None:
+        pytest.skip("no offscreen GL context available")
+    # The window size doubles as the step size: 60 time units in steps of 5.
+    header = b"YUV4MPEG2 W64 H48 F30:1 Ip A1:1 C420jpeg\n"
+    assert stats["frames"] == 11
+    assert os.path.getsize(path) == len(header) + 11 * (6 + 64 * 48 * 3 // 2)
+    with open(path, "rb") as video:
+        assert video.read(len(header)) == header
+
+    pattern = str(tmp_path / "frame_%03d.png")
+    assert export_plot.export_frames(pattern, 32, 32, frames=3) is not None
+    for index in range(3):
+        with open(pattern % index, "rb") as image:
+            assert image.read(8) == b"\x89PNG\r\n\x1a\n"
+    export_plot.close_headless()
+
+
+def test_time_windows_hide_points_outside_them():
+    window_plot = Zenith2D()
+    static = window_plot.add_layer(
+        np.zeros(10),
+        np.zeros(10),
+        name="static",
+        color="firebrick",
+        draw_style=DrawStyles.GL_POINTS,
+    )
+    assert not window_plot.set_time_windows(static, [(0, 10)])
+    animated = window_plot.add_animated_layer(
+        np.linspace(-1.0, 1.0, 100),
+        np.zeros(100),
+        np.arange(100),
+        color=(1.0, 0.0, 0.0),
+        draw_style=DrawStyles.GL_POINTS,
+        window_size=1,
+        name="animated",
+    )
+    window_plot.remove_layer(static)
+    assert window_plot.set_time_windows(animated, [(0, 20), (80, 100)])
+    image = window_plot.render_to_array(200, 50)
+    if image is None:
+        pytest.skip("no offscreen GL context available")
+    red_columns = np.nonzero((image[:, :, 0] > 100).any(axis=0))[0]
+    assert red_columns.size > 0
+    assert not ((red_columns > 70) & (red_columns < 130)).any()
+    window_plot.close_headless()
+
+
+def _show_until_drawn(window_plot, timeout=10.0):
+    # Opens the window on its own render thread and waits for a frame past
+    # those already drawn; False when no window can be opened here.
+    if sys.platform.startswith("linux") and not (
+        os.environ.get("DISPLAY") or os.environ.get("WAYLAND_DISPLAY")
+    ):
+        return False
+    drawn = window_plot.frame_stats()["frames"]
+    if not window_plot.show(block=False):
+        return False
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        if window_plot.frame_stats()["frames"] > drawn:
+            return True
+        time.sleep(0.01)
+    window_plot.close()
+    window_plot.wait()
+    return False
+
+
+def test_keep_resident_leaves_offscreen_rendering_working():
+    resident_plot = Zenith2D()
+    resident_plot.add_layer(
+        np.linspace(-1.0, 1.0, 100),
+        np.zeros(100),
+        color=(1.0, 0.0, 0.0),
+        name="resident",
+        draw_style=DrawStyles.GL_POINTS,
+    )
+    # No window has been shown, so there is nothing to hide or free.
+    resident_plot.set_keep_resident(True)
+    image = resident_plot.render_to_array(64, 48)
+    resident_plot.set_keep_resident(False)
+    if image is None:
+        pytest.skip("no offscreen GL context available")
+    assert (image[:, :, 0] > 100).any()
+    resident_plot.close_headless()
+
+def test_keep_resident_reopens_without_rebuilding_the_scene():
+    resident_plot = Zenith2D()
+    resident_plot.add_layer(
+        np.linspace(-1.0, 1.0, 100),
+        np.zeros(100),
+        color=(1.0, 0.0, 0.0),
+        name="resident",
+        draw_style=DrawStyles.GL_POINTS,
+    )
+    resident_plot.set_keep_resident(True)
+    if not _show_until_drawn(resident_plot):
+        pytest.skip("no window available")
+    resident_plot.close()
+    resident_plot.wait()
+    shaders = resident_plot.shader_stats()
+    buffers = resident_plot.buffer_stats()
+    # The hidden window comes back with its programs and layer buffers.
+    assert _show_until_drawn(resident_plot)
+    resident_plot.close()
+    resident_plot.wait()
+    reopened = resident_plot.shader_stats()
+    assert reopened["compiled"] + reopened["loaded"] == (
+        shaders["compiled"] + shaders["loaded"]
+    )
+    assert resident_plot.buffer_stats()["reserved_bytes"] == buffers["reserved_bytes"]
+    resident_plot.set_keep_resident(False)
+
+def test_background_uploads_leave_offscreen_rendering_synchronous():
+    loader_plot = Zenith2D()
+    loader_plot.add_layer(
+        np.linspace(-1.0, 1.0, 100),
+        np.zeros(100),
+        color=(1.0, 0.0, 0.0),
+        name="loaded",
+        draw_style=DrawStyles.GL_POINTS,
+    )
+    # Every layer qualifies, but offscreen frames never wait for the loader.
+    loader_plot.set_background_uploads(1)
+    image = loader_plot.render_to_array(64, 48)
+    if image is None:
+        pytest.skip("no offscreen GL context available")
+    assert (image[:, :, 0] > 100).any()
+    loader_plot.close_headless()
+
+def test_background_uploads_skip_a_layer_until_it_is_adopted():
+    loader_plot = Zenith2D()
+    count = 1 << 22
+    loader_plot.add_layer(
+        np.random.randn(count),
+        np.random.randn(count),
+        color=(1.0, 0.0, 0.0),
+        name="large",
+        draw_style=DrawStyles.GL_POINTS,
+    )
+    loader_plot.set_background_uploads(1 << 20)
+    if not _show_until_drawn(loader_plot):
+        pytest.skip("no window available")
+    skipped = []
+    deadline = time.monotonic() + 30.0
+    while time.monotonic() < deadline:
+        # Read before the upload count, so a frame counted here was drawn
+        # while the layer was still uploading.
+        drawn = loader_plot.frame_stats()
+        if loader_plot.buffer_stats()["pending_uploads"] == 0:
+            break
+        skipped.append(drawn["vertices"])
+        time.sleep(0.005)
+    # The frame that adopts the layer draws it.
+    drawn = loader_plot.frame_stats()
+    pending = loader_plot.buffer_stats()["pending_uploads"]
+    loader_plot.close()
+    loader_plot.wait()
+    assert pending == 0
+    assert not any(skipped)
+    assert drawn["vertices"] == count
+
+def test_timeline_drives_animated_layers():
+    timeline_plot = Zenith2D()
+    timeline_plot.add_animated_layer(
+        np.linspace(-1.0, 1.0, 100),
+        np.zeros(100),
+        np.arange(100) * 10,
+        color=(1.0, 0.0, 0.0),
+        draw_style=DrawStyles.GL_POINTS,
+        window_size=1,
+        name="animated",
+    )
+    timeline_plot.set_timeline(position=10**6)
+    state = timeline_plot.timeline()
+    assert state["first"] == 0
+    assert state["last"] == 990
+    assert state["position"] == 990
+    assert not state["playing"]
+    timeline_plot.set_timeline(position=500, playing=True, rate=100.0, loop=False)
+    state = timeline_plot.timeline()
+    assert state["playing"] and not state["loop"]
+    assert state["rate"] == 100.0
+    timeline_plot.set_timeline(position=500, playing=False)
+    assert timeline_plot.timeline()["position"] == 500
+    image = timeline_plot.render_to_array(200, 50)
+    if image is None:
+        pytest.skip("no offscreen GL context available")
+    red_columns = np.nonzero((image[:, :, 0] > 100).any(axis=0))[0]
+    assert red_columns.size > 0
+    assert ((red_columns > 70) & (red_columns < 130)).all()
+    timeline_plot.close_headless()
+
+
+def test_track_layer_interpolates_between_samples():
+    track_plot = Zenith2D()
+    assert not track_plot.add_track_layer(
+        np.zeros(3), np.zeros(3), [0, 0], np.arange(3), "red", 1, "bad ids"
+    )
+    tracks = track_plot.add_track_layer(
+        np.array([-1.0, 0.0, 1.0, 1.0, 1.0]),
+        np.array([0.0, 0.0, 0.0, -1.0, 1.0]),
+        np.array([4, 4, 4, 9, 9]),
+        np.array([0, 500, 1000, 0, 1000]),
+        color=(1.0, 0.0, 0.0),
+        step=500,
+        name="tracks",
+    )
+    assert tracks
+    assert track_plot.timeline()["last"] == 1000
+
+    def red_columns(position):
+        track_plot.set_timeline(position=position)
+        image = track_plot.render_to_array(200, 50)
+        if image is None:
+            pytest.skip("no offscreen GL context available")
+        # The moving entity is the leftmost red point.
+        return np.nonzero((image[:, :, 0] > 100).any(axis=0))[0]
+
+    start = red_columns(0).min()
+    between = red_columns(250).min()
+    middle = red_columns(500).min()
+    assert start < between < middle
+    track_plot.close_headless()
+
+
+def test_streamed_layer_rejects_styles_that_cannot_be_chunked():
+    streamed_plot = Zenith2D()
+    for style in (DrawStyles.GL_LINE_LOOP, DrawStyles.GL_TRIANGLE_FAN, DrawStyles.GL_TRIANGLE_STRIP):
+        assert not streamed_plot.add_streamed_layer(
+            np.linspace(-1.0, 1.0, 100),
+            np.zeros(100),
+            np.arange(100),
+            "red",
+            style,
+            10,
+            "chunked " + style.name,
+        )
+
+
+def test_streamed_layer_matches_animated_layer(tmp_path):
+    count = 100000
+    x = np.linspace(-1.0, 1.0, count)
+    y = np.sin(np.arange(count) * 0.01)
+    times = np.arange(count, dtype=np.int64) * 10
+    vertex_path = str(tmp_path / "vertices.f32")
+    time_path = str(tmp_path / "times.i64")
+    np.column_stack((x, y, np.ones(count))).astype(np.float32).tofile(vertex_path)
+    times.tofile(time_path)
+
+    def render(add):
+        stream_plot = Zenith2D()
+        layer = add(stream_plot)
+        assert layer
+        stream_plot.set_timeline(position=500000)
+        image = stream_plot.render_to_array(200, 100)
+        stats = stream_plot.memory_stats()
+        stream_plot.close_headless()
+        if image is None:
+            pytest.skip("no offscreen GL context available")
+        return image, stats["layers"][layer]
+
+    streamed, stats = render(
+        lambda p: p.add_streamed_layer_from_files(
+            vertex_path, time_path, "red", DrawStyles.GL_POINTS, 500, "streamed",
+            chunk_points=1000,
+        )
+    )
+    animated, _ = render(
+        lambda p: p.add_animated_layer(
+            x, y, times, "red", DrawStyles.GL_POINTS, 500, "animated"
+        )
+    )
+    assert (streamed == animated).all()
+    # Only the chunks around the window are resident, not the series.
+    assert 0 < stats["gpu"]["vertices"] < count * 12 // 10
+
+
+def test_ingest_benchmark_reports_latency_and_peak_rss(tmp_path):
+    out = str(tmp_path / "ingest.json")
+    script = os.path.join(os.path.dirname(__file__), "bench_ingest.py")
+    completed = subprocess.run(
+        [sys.executable, script, "--sizes", "1000", "--repeats", "1",
+         "--cases", "2d_float32,3d_picking,2d_animated", "--out", out],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+    assert completed.returncode == 0
+    with open(out) as report:
+        records = json.load(report)["benchmarks"]
+    assert [record["name"] for record in records] == ["2d_float32", "3d_picking", "2d_animated"]
+    for record in records:
+        assert record["size"] == 1000
+        assert record["median_seconds"] > 0.0
+        assert record["peak_rss_bytes"] >= record["ingest_peak_bytes"] >= 0
+
+
+def test_camera_path_replays_offscreen(tmp_path):
+    path_plot = Zenith2D()
+    path_plot.add_layer(
+        np.linspace(-1.0, 1.0, 500),
+        np.zeros(500),
+        color="red",
+        name="line",
+        draw_style=DrawStyles.GL_POINTS,
+    )
+    report = path_plot.benchmark_camera_path(width=64, height=48, frames=5)
+    if report is None:
+        pytest.skip("no offscreen GL context available")
+    assert report["frames"] == 5
+    assert report["draw_calls"] == [1] * 5
+    assert 0.0 < report["p50_ms"] <= report["p95_ms"] <= report["p99_ms"] <= report["max_ms"]
+    assert set(report["phase_ms"]) == {"update", "draw", "pick", "finish"}
+
+    # Nothing is recorded without a window: only the header is written.
+    recorded = str(tmp_path / "recorded.path")
+    assert path_plot.save_camera_path(recorded)
+    with open(recorded) as saved:
+        assert saved.readline() == "zenith-camera-path 1\n"
+    assert path_plot.benchmark_camera_path(recorded) is None
+
+    # time width height pan_x pan_y pan_z zoom angle_x angle_y cursor_x cursor_y
+    with open(recorded, "a") as saved:
+        saved.write("0 64 48 0 0 0 3 0 0 32 24\n")
+        saved.write("0.5 64 48 0.25 0 0 2.5 0.1 0 10 24\n")
+    report = path_plot.benchmark_camera_path(recorded)
+    assert report["frames"] == 2
+    path_plot.close_headless()
+
+
+def test_frame_stats_count_replayed_frames():
+    stats_plot = Zenith2D()
+    assert stats_plot.frame_stats()["frames"] == 0
+    stats_plot.add_layer(
+        np.linspace(-1.0, 1.0, 500),
+        np.zeros(500),
+        color=(255, 0, 0),
+        name="counted",
+        draw_style=DrawStyles.GL_POINTS,
+        picking_enabled=True,
+    )
+    if stats_plot.benchmark_camera_path(width=64, height=48, frames=5) is None:
+        pytest.skip("no offscreen GL context available")
+    stats = stats_plot.frame_stats()
+    stats_plot.close_headless()
+    assert stats["frames"] == 5
+    assert len(stats["frame_ms"]) == 5
+    assert stats["draw_calls"] == 1
+    assert stats["vertices"] == 500
+    assert stats["culled_vertices"] == 0
+    assert stats["pick_ms"] >= 0.0
+    phases = stats["phase_ms"]
+    assert sorted(phases) == ["draw", "pick", "present", "ui", "update"]
+    assert sum(phases.values()) <= stats["last_frame_ms"] + 1e-6
+    # Replayed frames have no input to wait on.
+    assert stats["input_latency_ms"] == []
+    # GPU times can lag the frames by one or two.
+    assert list(stats["gpu_ms"]) in ([], ["counted"], ["batch: counted"])
+
+
+
+def test_shader_programs_are_cached_between_plots(tmp_path, monkeypatch):
+    # Read when the plot is created.
+    monkeypatch.setenv("ZENITH_SHADER_CACHE", str(tmp_path / "shaders"))
+    stats = []
+    for _ in range(2):
+        cached_plot = Zenith2D()
+        cached_plot.add_layer(
+            np.linspace(-1.0, 1.0, 100),
+            np.zeros(100),
+            color=(0, 0, 255),
+            name="cached",
+            draw_style=DrawStyles.GL_POINTS,
+        )
+        if cached_plot.benchmark_camera_path(width=32, height=32, frames=1) is None:
+            pytest.skip("no offscreen GL context available")
+        cached_plot.close_headless()
+        stats.append(cached_plot.shader_stats())
+    first, second = stats
+    assert first["programs"] == 0 and first["compiled"] >= 1
+    if not first["binaries"]:
+        assert second["compiled"] >= 1
+        return
+    assert first["loaded"] == 0
+    assert os.listdir(str(tmp_path / "shaders"))
+    # The second plot builds the same variants from the cache.
+    assert second["loaded"] >= 1
+    assert second["compiled"] == 0
+
+def test_consecutive_layers_of_one_kind_share_a_program_bind():
+    grouped_plot = Zenith3D()
+    for layer in range(6):
+        grouped_plot.add_layer(
+            np.linspace(-1.0, 1.0, 100),
+            np.full(100, layer / 6.0),
+            np.zeros(100),
+            color=(0, 255, 0),
+            name="grouped {}".format(layer),
+            draw_style=DrawStyles.GL_POINTS if layer >= 3 else DrawStyles.GL_LINE_STRIP,
+        )
+    frames = 4
+    if grouped_plot.benchmark_camera_path(width=32, height=32, frames=frames) is None:
+        pytest.skip("no offscreen GL context available")
+    stats = grouped_plot.shader_stats()
+    grouped_plot.close_headless()
+    assert stats["programs"] == 2
+    # One bind per run of lines or points, not one per layer.
+    assert stats["binds"] <= (frames + 1) * stats["programs"]
+
+
+def test_later_layers_are_drawn_on_top():
+    stacked_plot = Zenith2D()
+    x_data = np.linspace(-1.0, 1.0, 1000)
+    stacked_plot.add_layer(
+        x_data,
+        np.zeros(1000),
+        name="points below",
+        draw_style=DrawStyles.GL_POINTS,
+        color=(255, 0, 0),
+    )
+    stacked_plot.add_layer(
+        x_data,
+        np.zeros(1000),
+        name="line above",
+        draw_style=DrawStyles.GL_LINE_STRIP,
+        color=(0, 255, 0),
+    )
+    image = stacked_plot.render_to_array(64, 48)
+    stacked_plot.close_headless()
+    if image is None:
+        pytest.skip("no offscreen GL context available")
+    # The points are wider than the line; it shows only if drawn after them.
+    line = (image[:, :, 1] > 200) & (image[:, :, 0] < 50)
+    assert line.any()
+
+
+def test_later_batches_are_drawn_on_top():
+    stacked_plot = Zenith2D()
+    x_data = np.linspace(-1.0, 1.0, 1000)
+    # Two layers of each style in a row, so each pair forms a batch.
+    for name, style, color in [
+        ("points below", DrawStyles.GL_POINTS, (255, 0, 0)),
+        ("more points below", DrawStyles.GL_POINTS, (255, 0, 0)),
+        ("line", DrawStyles.GL_LINE_STRIP, (0, 255, 0)),
+        ("another line", DrawStyles.GL_LINE_STRIP, (0, 255, 0)),
+        ("points on top", DrawStyles.GL_POINTS, (0, 0, 255)),
+        ("more points on top", DrawStyles.GL_POINTS, (0, 0, 255)),
+    ]:
+        stacked_plot.add_layer(
+            x_data, np.zeros(1000), name=name, draw_style=style, color=color
+        )
+    image = stacked_plot.render_to_array(64, 48)
+    if image is None or stacked_plot.benchmark_camera_path(width=64, height=48, frames=1) is None:
+        pytest.skip("no offscreen GL context available")
+    draw_calls = stacked_plot.frame_stats()["draw_calls"]
+    stacked_plot.close_headless()
+    assert draw_calls == 3
+    # The last points cover the lines drawn before them.
+    line = (image[:, :, 1] > 200) & (image[:, :, 2] < 50)
+    top = (image[:, :, 2] > 200) & (image[:, :, 1] < 50)
+    assert top.any()
+    assert not line.any()
+
+
+def test_trace_export_writes_chrome_trace_events(tmp_path):
+    trace = str(tmp_path / "trace.json")
+    if not tracing_enabled():
+        assert not export_trace(trace)
+        pytest.skip("built without ZENITH_ENABLE_TRACING")
+    clear_trace()
+    trace_plot = Zenith3D()
+    trace_plot.add_layer(
+        np.linspace(-1.0, 1.0, 500),
+        np.zeros(500),
+        np.zeros(500),
+        color="red",
+        name="traced",
+        draw_style=DrawStyles.GL_POINTS,
+        picking_enabled=True,
+    )
+    replayed = trace_plot.benchmark_camera_path(width=64, height=48, frames=3) is not None
+    trace_plot.close_headless()
+    assert export_trace(trace)
+    with open(trace) as exported:
+        events = json.load(exported)["traceEvents"]
+    zones = {event["name"] for event in events if event["ph"] == "X"}
+    assert {"create_gl_model", "GLModel::GLModel", "picking index"} <= zones
+    assert all(event["dur"] >= 0 for event in events if event["ph"] == "X")
+    if replayed:
+        assert {"replay frame", "GLBoilerPlate::draw"} <= zones
+        # The layer's draws (or its batch's) were timed on the GPU track.
+        gpu = [e["tid"] for e in events if e["ph"] == "M" and e["args"]["name"] == "GPU"]
+        assert any(e["tid"] in gpu for e in events if e["ph"] == "X")
+
+
 def test_removing_non_existant_layer_fails():
     result = plot.remove_layer(12341)
     assert not result
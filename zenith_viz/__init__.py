@@ -1,2 +1,3 @@
 __version__ = "0.0.8"
-from .zenith_viz import Zenith2D, Zenith3D, DrawStyles, color_lookup
+from .zenith_viz import Zenith2D, Zenith3D, DrawStyles, SpatialOrder, color_lookup
+from .zenith_viz import export_trace, clear_trace, tracing_enabled
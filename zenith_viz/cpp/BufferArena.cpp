@@ -0,0 +1,252 @@
+#ifndef ZENITH_CPP_BUFFERARENA_CPP_
+#define ZENITH_CPP_BUFFERARENA_CPP_
+
+#include "BufferArena.hpp"
+#include <algorithm>
+#include <iterator>
+#include "glad/gl.h"
+
+BufferArena::BufferArena(GLsizeiptr blockSize) {
+    this->blockSize = blockSize;
+    this->alignment = 256;
+    this->scratchBuffer = 0;
+    this->scratchSize = 0;
+    this->compactedBytes = 0;
+    this->driverAllocations = 0;
+}
+
+BufferArena::~BufferArena() {
+    // GL objects die with their context; Engine calls releaseAll() while
+    // the context is still current.
+}
+
+int BufferArena::newBlock(GLsizeiptr size) {
+    Block block;
+    glGenBuffers(1, &block.buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, block.buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW);
+    block.size = size;
+    block.used = 0;
+    block.freeRanges[0] = size;
+    driverAllocations++;
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (blocks[i].buffer == 0) {
+            blocks[i] = block;
+            return static_cast<int>(i);
+        }
+    }
+    blocks.push_back(block);
+    return static_cast<int>(blocks.size() - 1);
+}
+
+bool BufferArena::carve(int blockIdx, GLsizeiptr bytes, GLintptr* offset) {
+    Block& block = blocks[blockIdx];
+    for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+        if (it->second < bytes)
+            continue;
+        *offset = it->first;
+        GLsizeiptr remaining = it->second - bytes;
+        block.freeRanges.erase(it);
+        if (remaining > 0)
+            block.freeRanges[*offset + bytes] = remaining;
+        return true;
+    }
+    return false;
+}
+
+void BufferArena::freeRange(Block* block, GLintptr offset, GLsizeiptr size) {
+    auto next = block->freeRanges.lower_bound(offset);
+    if (next != block->freeRanges.end() && offset + size == next->first) {
+        size += next->second;
+        next = block->freeRanges.erase(next);
+    }
+    if (next != block->freeRanges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += size;
+            return;
+        }
+    }
+    block->freeRanges[offset] = size;
+}
+
+int BufferArena::allocate(GLsizeiptr bytes, const void* data) {
+    GLsizeiptr aligned = ((std::max<GLsizeiptr>(bytes, 1) + alignment - 1) / alignment) * alignment;
+    int blockIdx = -1;
+    GLintptr offset = 0;
+    for (size_t i = 0; i < blocks.size() && blockIdx < 0; i++) {
+        if (blocks[i].buffer != 0 && carve(static_cast<int>(i), aligned, &offset))
+            blockIdx = static_cast<int>(i);
+    }
+    if (blockIdx < 0) {
+        blockIdx = newBlock(std::max(blockSize, aligned));
+        carve(blockIdx, aligned, &offset);
+    }
+
+    int handle;
+    if (!freeHandles.empty()) {
+        handle = freeHandles.back();
+        freeHandles.pop_back();
+    } else {
+        allocations.push_back(Allocation());
+        handle = static_cast<int>(allocations.size() - 1);
+    }
+    Allocation& allocation = allocations[handle];
+    allocation.block = blockIdx;
+    allocation.offset = offset;
+    allocation.size = aligned;
+    allocation.inUse = true;
+
+    Block& block = blocks[blockIdx];
+    block.live[offset] = handle;
+    block.used += aligned;
+
+    if (data != nullptr) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, block.buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+        RenderCounters::uploadBytes += bytes;
+    }
+    return handle;
+}
+
+void BufferArena::update(int handle, GLintptr offset, GLsizeiptr bytes, const void* data) {
+    BufferSlice target = slice(handle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, target.buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, target.offset + offset, bytes, data);
+    RenderCounters::uploadBytes += bytes;
+}
+
+void BufferArena::release(int handle) {
+    if (handle < 0 || handle >= static_cast<int>(allocations.size()))
+        return;
+    Allocation& allocation = allocations[handle];
+    if (!allocation.inUse)
+        return;
+    Block& block = blocks[allocation.block];
+    block.live.erase(allocation.offset);
+    block.used -= allocation.size;
+    freeRange(&block, allocation.offset, allocation.size);
+    allocation.inUse = false;
+    freeHandles.push_back(handle);
+}
+
+BufferSlice BufferArena::slice(int handle) {
+    Allocation& allocation = allocations[handle];
+    BufferSlice result;
+    result.buffer = blocks[allocation.block].buffer;
+    result.offset = allocation.offset;
+    result.size = allocation.size;
+    return result;
+}
+
+void BufferArena::moveAllocation(int handle, GLintptr dstOffset) {
+    Allocation& allocation = allocations[handle];
+    Block& block = blocks[allocation.block];
+    GLintptr srcOffset = allocation.offset;
+    GLsizeiptr size = allocation.size;
+    GLsizeiptr gap = srcOffset - dstOffset;
+
+    // glCopyBufferSubData rejects overlapping ranges within one buffer, so
+    // short slides bounce through a scratch buffer.
+    if (gap >= size) {
+        glBindBuffer(GL_COPY_READ_BUFFER, block.buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, block.buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, srcOffset, dstOffset, size);
+    } else {
+        if (scratchSize < size) {
+            if (scratchBuffer == 0)
+                glGenBuffers(1, &scratchBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, scratchBuffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_COPY);
+            scratchSize = size;
+            driverAllocations++;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, block.buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, scratchBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, srcOffset, 0, size);
+        glBindBuffer(GL_COPY_READ_BUFFER, scratchBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, block.buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, dstOffset, size);
+    }
+
+    block.live.erase(srcOffset);
+    block.live[dstOffset] = handle;
+    block.freeRanges.erase(dstOffset);
+    freeRange(&block, dstOffset + size, gap);
+    allocation.offset = dstOffset;
+}
+
+size_t BufferArena::compact(GLsizeiptr byteBudget) {
+    GLsizeiptr moved = 0;
+    for (auto && block : blocks) {
+        if (block.buffer == 0)
+            continue;
+        while (!block.freeRanges.empty() && moved < byteBudget) {
+            auto hole = block.freeRanges.begin();
+            auto next = block.live.lower_bound(hole->first);
+            if (next == block.live.end())
+                break;
+            GLsizeiptr size = allocations[next->second].size;
+            if (moved > 0 && moved + size > byteBudget)
+                break;
+            moveAllocation(next->second, hole->first);
+            moved += size;
+        }
+    }
+
+    int liveBlocks = 0;
+    for (auto && block : blocks) {
+        if (block.buffer != 0)
+            liveBlocks++;
+    }
+    for (auto && block : blocks) {
+        if (block.buffer != 0 && block.used == 0 && liveBlocks > 1) {
+            glDeleteBuffers(1, &block.buffer);
+            block = Block();
+            block.buffer = 0;
+            block.size = 0;
+            block.used = 0;
+            liveBlocks--;
+        }
+    }
+
+    compactedBytes += moved;
+    return moved;
+}
+
+void BufferArena::releaseAll() {
+    for (auto && block : blocks) {
+        if (block.buffer != 0)
+            glDeleteBuffers(1, &block.buffer);
+    }
+    if (scratchBuffer != 0)
+        glDeleteBuffers(1, &scratchBuffer);
+    scratchBuffer = 0;
+    scratchSize = 0;
+    blocks.clear();
+    allocations.clear();
+    freeHandles.clear();
+}
+
+BufferArenaStats BufferArena::stats() {
+    BufferArenaStats result = BufferArenaStats();
+    for (auto && block : blocks) {
+        if (block.buffer == 0)
+            continue;
+        result.blocks++;
+        result.reservedBytes += block.size;
+        result.usedBytes += block.used;
+        for (auto && range : block.freeRanges) {
+            result.freeBytes += range.second;
+            result.largestFreeBytes = std::max(result.largestFreeBytes, (size_t) range.second);
+        }
+    }
+    result.allocations = allocations.size() - freeHandles.size();
+    result.reservedBytes += scratchSize;
+    result.compactedBytes = compactedBytes;
+    result.driverAllocations = driverAllocations;
+    return result;
+}
+
+#endif
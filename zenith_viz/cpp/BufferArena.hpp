@@ -0,0 +1,82 @@
+#ifndef ZENITH_CPP_BUFFERARENA_HPP_
+#define ZENITH_CPP_BUFFERARENA_HPP_
+
+#include <cstddef>
+#include <map>
+#include <vector>
+#include "glad/gl.h"
+#include "FrameStats.hpp"
+
+struct BufferSlice {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+};
+
+struct BufferArenaStats {
+    size_t blocks;
+    size_t allocations;
+    size_t reservedBytes;
+    size_t usedBytes;
+    size_t freeBytes;
+    size_t largestFreeBytes;
+    size_t compactedBytes;
+    size_t driverAllocations;
+};
+
+// Engine-owned pool of large GL array buffers. Layers get byte ranges out of
+// a per-block first-fit free list, so adding or removing a layer is offset
+// bookkeeping rather than a glGenBuffers/glBufferData round trip.
+//
+// Allocations are addressed by handle because compact() may move them;
+// owners resolve the current buffer and offset with slice() when drawing.
+// allocate() and compact() issue GL calls and must run with the context
+// current; release() is bookkeeping only and is safe from any state.
+class BufferArena {
+ public:
+    struct Block {
+        GLuint buffer;
+        GLsizeiptr size;
+        GLsizeiptr used;
+        std::map<GLintptr, GLsizeiptr> freeRanges;
+        std::map<GLintptr, int> live;
+    };
+
+    struct Allocation {
+        int block;
+        GLintptr offset;
+        GLsizeiptr size;
+        bool inUse;
+    };
+
+    GLsizeiptr blockSize;
+    GLsizeiptr alignment;
+    std::vector<Block> blocks;
+    std::vector<Allocation> allocations;
+    std::vector<int> freeHandles;
+    GLuint scratchBuffer;
+    GLsizeiptr scratchSize;
+    size_t compactedBytes;
+    size_t driverAllocations;
+
+    explicit BufferArena(GLsizeiptr blockSize = 64 << 20);
+    ~BufferArena();
+    int allocate(GLsizeiptr bytes, const void* data);
+    void update(int handle, GLintptr offset, GLsizeiptr bytes, const void* data);
+    void release(int handle);
+    BufferSlice slice(int handle);
+    // Slides live ranges down over holes, moving at most byteBudget bytes,
+    // and returns blocks that became empty to the driver.
+    size_t compact(GLsizeiptr byteBudget);
+    // Deletes every GL buffer; used when the context is being destroyed.
+    void releaseAll();
+    BufferArenaStats stats();
+
+ private:
+    int newBlock(GLsizeiptr size);
+    bool carve(int blockIdx, GLsizeiptr bytes, GLintptr* offset);
+    void freeRange(Block* block, GLintptr offset, GLsizeiptr size);
+    void moveAllocation(int handle, GLintptr dstOffset);
+};
+
+#endif  // ZENITH_CPP_BUFFERARENA_HPP_
@@ -0,0 +1,146 @@
+#ifndef ZENITH_CPP_BUFFERLOADER_CPP_
+#define ZENITH_CPP_BUFFERLOADER_CPP_
+
+#include "BufferLoader.hpp"
+#include <algorithm>
+#include <utility>
+#include "Tracing.hpp"
+
+BufferLoader::BufferLoader() {
+    this->context = nullptr;
+    this->stopping = false;
+    this->inFlight = 0;
+}
+
+BufferLoader::~BufferLoader() {
+    // Engine stops the loader while its context is still current.
+}
+
+bool BufferLoader::start(GLFWwindow* context, std::function<void()> ready) {
+    if (context == nullptr)
+        return false;
+    this->context = context;
+    this->ready = ready;
+    stopping = false;
+    thread = std::thread([this]() { run(); });
+    return true;
+}
+
+void BufferLoader::submit(int id, std::shared_ptr<GLModel> model) {
+    Upload upload;
+    upload.id = id;
+    upload.model = model;
+    upload.sources.push_back(model->vertexData);
+    if (model->useColorData)
+        upload.sources.push_back(model->colorData);
+    upload.bytes = sizeof(float) * (GLsizeiptr) model->numVertices * model->numComponents;
+    upload.fence = nullptr;
+    model->uploadPending = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.push_back(std::move(upload));
+    }
+    wake.notify_one();
+}
+
+std::vector<BufferLoader::Upload> BufferLoader::collect() {
+    std::vector<Upload> done;
+    std::lock_guard<std::mutex> lock(mutex);
+    while (!finished.empty()) {
+        GLenum status = glClientWaitSync(finished.front().fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(finished.front().fence);
+        finished.front().fence = nullptr;
+        done.push_back(std::move(finished.front()));
+        finished.pop_front();
+    }
+    return done;
+}
+
+size_t BufferLoader::pending() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queued.size() + inFlight + finished.size();
+}
+
+void BufferLoader::stop() {
+    if (!thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+    for (auto && upload : queued) {
+        upload.model->uploadPending = false;
+    }
+    for (auto && upload : finished) {
+        if (upload.fence != nullptr)
+            glDeleteSync(upload.fence);
+        glDeleteBuffers((GLsizei) upload.buffers.size(), upload.buffers.data());
+        upload.model->uploadPending = false;
+    }
+    queued.clear();
+    finished.clear();
+    glfwDestroyWindow(context);
+    context = nullptr;
+}
+
+void BufferLoader::run() {
+    ZENITH_TRACE_THREAD("loader");
+    glfwMakeContextCurrent(context);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this]() { return stopping || !queued.empty(); });
+        if (stopping)
+            break;
+        Upload next = std::move(queued.front());
+        queued.pop_front();
+        inFlight++;
+        lock.unlock();
+        bool complete = this->upload(&next);
+        lock.lock();
+        inFlight--;
+        // An abandoned upload still goes to finished, without buffers or a
+        // fence, so stop() clears its layer like the others.
+        finished.push_back(std::move(next));
+        if (!complete)
+            break;
+        lock.unlock();
+        ready();
+        lock.lock();
+    }
+    lock.unlock();
+    glfwMakeContextCurrent(nullptr);
+}
+
+bool BufferLoader::upload(Upload* upload) {
+    ZENITH_TRACE_ZONE("BufferLoader::upload");
+    for (auto && source : upload->sources) {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        upload->buffers.push_back(buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, upload->bytes, nullptr, GL_STATIC_DRAW);
+        const char* data = reinterpret_cast<const char*>(source);
+        for (GLsizeiptr offset = 0; offset < upload->bytes; offset += chunkBytes) {
+            if (stopping) {
+                glDeleteBuffers((GLsizei) upload->buffers.size(), upload->buffers.data());
+                upload->buffers.clear();
+                return false;
+            }
+            GLsizeiptr bytes = std::min(chunkBytes, upload->bytes - offset);
+            glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data + offset);
+            // Hands the chunk to the driver now rather than at the end.
+            glFlush();
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    upload->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // Other contexts only see the fence once it has been flushed.
+    glFlush();
+    return true;
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef ZENITH_CPP_BUFFERLOADER_HPP_
+#define ZENITH_CPP_BUFFERLOADER_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "glad/gl.h"
+#include <GLFW/glfw3.h>
+#include "GLModel.hpp"
+
+// Uploads large layers off the render thread. The loader thread owns a
+// hidden window whose context shares objects with the main window's, and
+// fills each layer's buffers there in chunks, so the render loop keeps
+// drawing (and the UI keeps answering) while hundreds of megabytes go to
+// the GPU. A fence behind the last chunk tells the render thread when the
+// buffers are complete; collect() hands those layers back to be published.
+//
+// submit(), collect() and stop() belong on the render thread, which alone
+// touches the layers' flags.
+class BufferLoader {
+ public:
+    struct Upload {
+        int id;
+        std::shared_ptr<GLModel> model;
+        // Vertex and, with color data, color buffer, in that order.
+        std::vector<const void*> sources;
+        std::vector<GLuint> buffers;
+        GLsizeiptr bytes;
+        GLsync fence;
+    };
+
+    // Each glBufferSubData call copies at most this much.
+    GLsizeiptr chunkBytes = 4 << 20;
+
+    BufferLoader();
+    ~BufferLoader();
+    // Starts the thread on context, which the loader then owns; ready runs
+    // on the loader thread whenever an upload completes. False without a
+    // context.
+    bool start(GLFWwindow* context, std::function<void()> ready);
+    // Queues the layer's buffers and marks it uploadPending.
+    void submit(int id, std::shared_ptr<GLModel> model);
+    // Uploads whose fence has signaled, in submission order. The caller
+    // adopts or deletes their buffers.
+    std::vector<Upload> collect();
+    size_t pending();
+    // Abandons unfinished uploads, frees their buffers, joins the thread and
+    // destroys its context. The main context must be current.
+    void stop();
+
+ private:
+    GLFWwindow* context;
+    std::function<void()> ready;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<bool> stopping;
+    std::deque<Upload> queued;
+    std::deque<Upload> finished;
+    size_t inFlight;
+
+    void run();
+    bool upload(Upload* upload);
+};
+
+#endif  // ZENITH_CPP_BUFFERLOADER_HPP_
@@ -0,0 +1,107 @@
+#ifndef ZENITH_CPP_CAMERAPATH_CPP_
+#define ZENITH_CPP_CAMERAPATH_CPP_
+
+#include "CameraPath.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char* CAMERA_PATH_HEADER = "zenith-camera-path 1";
+
+bool CameraPath::save(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        fprintf(stderr, "zenith: could not write camera path %s\n", path.c_str());
+        return false;
+    }
+    fprintf(file, "%s\n", CAMERA_PATH_HEADER);
+    fprintf(file, "# time width height pan_x pan_y pan_z zoom angle_x angle_y cursor_x cursor_y\n");
+    for (auto && sample : samples) {
+        fprintf(file, "%.9g %d %d %.9g %.9g %.9g %.17g %.17g %.17g %.9g %.9g\n",
+                sample.time, sample.width, sample.height,
+                sample.pan.x, sample.pan.y, sample.pan.z,
+                sample.zoom, sample.angleX, sample.angleY,
+                sample.cursorX, sample.cursorY);
+    }
+    bool written = std::ferror(file) == 0;
+    written = std::fclose(file) == 0 && written;
+    if (!written)
+        fprintf(stderr, "zenith: could not write camera path %s\n", path.c_str());
+    return written;
+}
+
+bool CameraPath::load(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        fprintf(stderr, "zenith: could not open camera path %s\n", path.c_str());
+        return false;
+    }
+    std::vector<CameraPathSample> loaded;
+    char line[512];
+    bool headerSeen = false;
+    bool valid = true;
+    while (valid && std::fgets(line, sizeof(line), file) != nullptr) {
+        if (!headerSeen) {
+            headerSeen = std::strncmp(line, CAMERA_PATH_HEADER, std::strlen(CAMERA_PATH_HEADER)) == 0;
+            valid = headerSeen;
+            continue;
+        }
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        CameraPathSample sample;
+        valid = std::sscanf(line, "%lf %d %d %f %f %f %lf %lf %lf %lf %lf",
+                            &sample.time, &sample.width, &sample.height,
+                            &sample.pan.x, &sample.pan.y, &sample.pan.z,
+                            &sample.zoom, &sample.angleX, &sample.angleY,
+                            &sample.cursorX, &sample.cursorY) == 11
+            && sample.width > 0 && sample.height > 0;
+        if (valid)
+            loaded.push_back(sample);
+    }
+    std::fclose(file);
+    if (!valid || !headerSeen) {
+        fprintf(stderr, "zenith: %s is not a camera path\n", path.c_str());
+        return false;
+    }
+    samples = loaded;
+    return true;
+}
+
+static double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty())
+        return 0.0;
+    size_t rank = (size_t) std::ceil(fraction * sorted.size());
+    return sorted[std::min(std::max(rank, (size_t) 1), sorted.size()) - 1];
+}
+
+void summarizeReplay(ReplayReport* report) {
+    ReplayFrame mean = {};
+    std::vector<double> totals;
+    for (auto && frame : report->frames) {
+        mean.update += frame.update;
+        mean.draw += frame.draw;
+        mean.pick += frame.pick;
+        mean.finish += frame.finish;
+        mean.total += frame.total;
+        mean.drawCalls += frame.drawCalls;
+        totals.push_back(frame.total);
+    }
+    size_t count = report->frames.size();
+    if (count > 0) {
+        mean.update /= count;
+        mean.draw /= count;
+        mean.pick /= count;
+        mean.finish /= count;
+        mean.total /= count;
+        mean.drawCalls = (mean.drawCalls + count / 2) / count;
+    }
+    std::sort(totals.begin(), totals.end());
+    report->mean = mean;
+    report->p50 = percentile(totals, 0.50);
+    report->p95 = percentile(totals, 0.95);
+    report->p99 = percentile(totals, 0.99);
+    report->max = totals.empty() ? 0.0 : totals.back();
+}
+
+#endif
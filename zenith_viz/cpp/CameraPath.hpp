@@ -0,0 +1,65 @@
+#ifndef ZENITH_CPP_CAMERAPATH_HPP_
+#define ZENITH_CPP_CAMERAPATH_HPP_
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// What the interactive controls held for one frame, which is all the
+// render loop turns into matrices. pan is the translation dragged so far;
+// zoom is world units per pixel for Engine and the camera's distance for
+// Engine3d; angleX and angleY are Engine3d's drag rotation. The cursor is
+// in framebuffer pixels from the top left and drives hover picking.
+struct CameraPathSample {
+    double time;
+    int width;
+    int height;
+    glm::vec3 pan;
+    double zoom;
+    double angleX;
+    double angleY;
+    double cursorX;
+    double cursorY;
+};
+
+// Control states with the seconds since the first one, recorded from the
+// window or generated, for replaying the same interaction offscreen. Saved
+// as text: a "zenith-camera-path 1" line, then one sample per line.
+class CameraPath {
+ public:
+    std::vector<CameraPathSample> samples;
+
+    bool save(const std::string& path);
+    bool load(const std::string& path);
+};
+
+// Seconds one replayed frame spent in each phase: moving the timeline and
+// preparing batches, issuing draws, hover picking and waiting for the GPU
+// to finish. As in the window, picking reads back the depth under the
+// cursor, which waits for the frame's drawing; finish is what is left.
+struct ReplayFrame {
+    double update;
+    double draw;
+    double pick;
+    double finish;
+    double total;
+    unsigned long drawCalls;
+};
+
+struct ReplayReport {
+    std::string backend;
+    int width;
+    int height;
+    std::vector<ReplayFrame> frames;
+    // Filled in by summarizeReplay.
+    ReplayFrame mean;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+};
+
+// Per-phase means and nearest-rank percentiles of the frame times.
+void summarizeReplay(ReplayReport* report);
+
+#endif  // ZENITH_CPP_CAMERAPATH_HPP_
@@ -0,0 +1,92 @@
+#ifndef ZENITH_CPP_COMMANDQUEUE_CPP_
+#define ZENITH_CPP_COMMANDQUEUE_CPP_
+
+#include "CommandQueue.hpp"
+#include <thread>
+#include <utility>
+
+CommandFuture::CommandFuture(std::shared_future<bool> state) {
+    this->state = state;
+}
+
+bool CommandFuture::done() {
+    return state.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+bool CommandFuture::wait(double timeoutSeconds) {
+    if (timeoutSeconds < 0.0) {
+        state.wait();
+        return true;
+    }
+    auto timeout = std::chrono::duration<double>(timeoutSeconds);
+    return state.wait_for(timeout) == std::future_status::ready;
+}
+
+bool CommandFuture::result() {
+    return state.get();
+}
+
+CommandQueue::CommandQueue() {
+    Node* stub = new Node();
+    stub->next.store(nullptr);
+    head.store(stub);
+    tail = stub;
+}
+
+CommandQueue::~CommandQueue() {
+    // Commands nobody ran report failure rather than leaving waiters hung.
+    std::function<bool()> command;
+    std::promise<bool> promise;
+    while (pop(&command, &promise)) {
+        promise.set_value(false);
+    }
+    delete tail;
+}
+
+CommandFuture CommandQueue::push(std::function<bool()> command) {
+    Node* node = new Node();
+    node->next.store(nullptr, std::memory_order_relaxed);
+    node->command = std::move(command);
+    CommandFuture future(node->promise.get_future().share());
+    Node* prev = head.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+    return future;
+}
+
+bool CommandQueue::pop(std::function<bool()>* command, std::promise<bool>* promise) {
+    while (true) {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            // next becomes the new stub once its payload is taken.
+            *command = std::move(next->command);
+            *promise = std::move(next->promise);
+            delete tail;
+            tail = next;
+            return true;
+        }
+        if (head.load(std::memory_order_acquire) == tail)
+            return false;
+        // A producer has swapped head but not linked its node yet.
+        std::this_thread::yield();
+    }
+}
+
+size_t CommandQueue::drain() {
+    std::lock_guard<std::mutex> lock(drainMutex);
+    size_t count = 0;
+    std::function<bool()> command;
+    std::promise<bool> promise;
+    while (pop(&command, &promise)) {
+        // A throwing command must not take the render loop down; its
+        // caller gets the exception from the future instead.
+        try {
+            promise.set_value(command());
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+        count++;
+    }
+    return count;
+}
+
+#endif
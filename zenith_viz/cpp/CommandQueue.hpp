@@ -0,0 +1,52 @@
+#ifndef ZENITH_CPP_COMMANDQUEUE_HPP_
+#define ZENITH_CPP_COMMANDQUEUE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
+
+// Completion handle for a queued command. result() blocks until the render
+// loop has run the command and returns what it returned, or rethrows what
+// it threw.
+class CommandFuture {
+ public:
+    std::shared_future<bool> state;
+
+    explicit CommandFuture(std::shared_future<bool> state);
+    bool done();
+    // Returns false if the command has not run within timeoutSeconds; a
+    // negative timeout waits forever.
+    bool wait(double timeoutSeconds);
+    bool result();
+};
+
+// Multi-producer, single-consumer queue of engine commands (Vyukov's
+// intrusive linked-list queue). Pushing is one atomic exchange and never
+// blocks; the render loop drains at frame boundaries. drain() serializes
+// consumers with a mutex so a caller can run the queue itself when no
+// render loop is active.
+class CommandQueue {
+ public:
+    struct Node {
+        std::atomic<Node*> next;
+        std::function<bool()> command;
+        std::promise<bool> promise;
+    };
+
+    std::atomic<Node*> head;
+    Node* tail;
+    std::mutex drainMutex;
+
+    CommandQueue();
+    ~CommandQueue();
+    CommandFuture push(std::function<bool()> command);
+    // Runs commands until the queue is empty and returns how many ran.
+    size_t drain();
+
+ private:
+    bool pop(std::function<bool()>* command, std::promise<bool>* promise);
+};
+
+#endif  // ZENITH_CPP_COMMANDQUEUE_HPP_
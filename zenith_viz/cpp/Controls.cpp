@@ -5,9 +5,12 @@
 #include <tuple>
 #include <vector>
 #include "glad/gl.h"
+#include "Tracing.hpp"
 #include <glm/gtc/matrix_transform.hpp>
 
 double Controls::scrollOffset = 100.0;
+unsigned long Controls::inputEvents = 0;
+long long Controls::inputTime = 0;
 
 Controls::Controls(GLFWwindow* window, double mouseSpeed) {
     last_x = 0.0;
@@ -17,6 +20,49 @@ Controls::Controls(GLFWwindow* window, double mouseSpeed) {
     this->mouseSpeed = mouseSpeed;
     glfwSetWindowUserPointer(window, &Controls::scrollOffset);
     glfwSetScrollCallback(window, scrollCallback);
+    // Installed before ImGui, which chains to whatever callbacks it finds.
+    glfwSetCursorPosCallback(window, cursorPosCallback);
+    glfwSetMouseButtonCallback(window, mouseButtonCallback);
+    glfwSetKeyCallback(window, keyCallback);
+    glfwSetCharCallback(window, charCallback);
+    glfwSetWindowSizeCallback(window, windowSizeCallback);
+    glfwSetWindowRefreshCallback(window, windowRefreshCallback);
+}
+
+void Controls::noteInput() {
+    inputEvents++;
+    if (inputTime == 0)
+        inputTime = steadyNanoseconds();
+}
+
+long long Controls::takeInput() {
+    long long time = inputTime;
+    inputTime = 0;
+    return time;
+}
+
+void Controls::cursorPosCallback(GLFWwindow* window, double x, double y) {
+    noteInput();
+}
+
+void Controls::mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+    noteInput();
+}
+
+void Controls::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    noteInput();
+}
+
+void Controls::charCallback(GLFWwindow* window, unsigned int codepoint) {
+    noteInput();
+}
+
+void Controls::windowSizeCallback(GLFWwindow* window, int width, int height) {
+    inputEvents++;
+}
+
+void Controls::windowRefreshCallback(GLFWwindow* window) {
+    inputEvents++;
 }
 
 glm::mat4 Controls::getRotationMatrix(int width, int height) {
@@ -104,8 +150,20 @@ std::tuple<int, glm::vec3, float> Controls::select(
     glm::mat4 view,
     glm::mat4 projection,
     glm::mat4 rotation,
-    VpTree<DataPoint, euclidean_distance>* tree_index
+    VpTree<DataPoint, euclidean_distance>* tree_index,
+    const std::function<bool(int)>* pickable
 ) {
+    ZENITH_TRACE_ZONE("Controls::select");
+    float xpos, ypos;
+    int view_x, view_y;
+    cursorPixel(&xpos, &ypos, &view_x, &view_y);
+    float depth = 0.0f;
+    glReadPixels(xpos, ypos, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
+    auto win_v1 = glm::vec3(xpos, ypos, depth);
+    return selectAt(win_v1, view_x, view_y, model, view, projection, rotation, tree_index, pickable);
+}
+
+void Controls::cursorPixel(float* xpos, float* ypos, int* view_width, int* view_height) {
     double x;
     double y;
     int b_w;
@@ -119,23 +177,48 @@ std::tuple<int, glm::vec3, float> Controls::select(
     float y_ratio = static_cast<float>(height) / static_cast<float>(b_h);
     x = x / x_ratio;
     y = y / y_ratio;
-    float xpos = x;
-    float ypos = (height / y_ratio) - 1 - y;
-    float depth = 0.0f;
-    glReadPixels(xpos, ypos, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
-    auto win_v1 = glm::vec3(xpos, ypos, depth);
+    *xpos = x;
+    *ypos = (height / y_ratio) - 1 - y;
+    *view_width = static_cast<int>(static_cast<float>(width) / x_ratio);
+    *view_height = static_cast<int>(static_cast<float>(height) / y_ratio);
+}
 
-    int view_x = static_cast<int>(static_cast<float>(width) / x_ratio);
-    int view_y = static_cast<int>(static_cast<float>(height) / y_ratio);
+std::tuple<int, glm::vec3, float> Controls::selectWithDepth(
+    float depth,
+    glm::mat4 model,
+    glm::mat4 view,
+    glm::mat4 projection,
+    glm::mat4 rotation,
+    VpTree<DataPoint, euclidean_distance>* tree_index,
+    const std::function<bool(int)>* pickable
+) {
+    ZENITH_TRACE_ZONE("Controls::select");
+    float xpos, ypos;
+    int view_x, view_y;
+    cursorPixel(&xpos, &ypos, &view_x, &view_y);
+    auto win_v1 = glm::vec3(xpos, ypos, depth);
+    return selectAt(win_v1, view_x, view_y, model, view, projection, rotation, tree_index, pickable);
+}
 
+std::tuple<int, glm::vec3, float> Controls::selectAt(
+    glm::vec3 window_point,
+    int view_width,
+    int view_height,
+    glm::mat4 model,
+    glm::mat4 view,
+    glm::mat4 projection,
+    glm::mat4 rotation,
+    VpTree<DataPoint, euclidean_distance>* tree_index,
+    const std::function<bool(int)>* pickable
+) {
     auto unprj_v1 = glm::unProject(
-        win_v1,
+        window_point,
         view * model * rotation,
         projection,
-        glm::vec4(0, 0, view_x, view_y));
+        glm::vec4(0, 0, view_width, view_height));
 
-    auto results = new std::vector<DataPoint>();
-    auto distances = new std::vector<float>();
+    std::vector<DataPoint> results;
+    std::vector<float> distances;
 
     float query_point[3] = {
         unprj_v1.x,
@@ -143,12 +226,10 @@ std::tuple<int, glm::vec3, float> Controls::select(
         unprj_v1.z
     };
 
-    auto dp = new DataPoint(3, 0, query_point);
-
-    tree_index->search(*dp, 1, results, distances);
-    delete dp;
-    if (distances->at(0) < 0.5f) {
-        auto data_item = results->at(0);
+    DataPoint dp(3, 0, query_point);
+    tree_index->search(dp, 1, &results, &distances, pickable);
+    if (!distances.empty() && distances.at(0) < 0.5f) {
+        auto data_item = results.at(0);
         auto data_point = data_item._x;
         auto id = data_item.index();
         auto new_vec = glm::vec3(
@@ -156,20 +237,12 @@ std::tuple<int, glm::vec3, float> Controls::select(
             data_point[1],
             data_point[2]);
 
-        auto result = std::make_tuple(id, new_vec, distances->at(0));
-
-        results->clear();
-        distances->clear();
-        return result;
+        return std::make_tuple(id, new_vec, distances.at(0));
     } else {
-        auto result = std::make_tuple(
+        return std::make_tuple(
             -1000,
             glm::vec3(-1000.0f, -1000.0f, -1000.0f),
             1000.0f);
-
-        results->clear();
-        distances->clear();
-        return result;
     }
 }
 #endif
@@ -2,6 +2,7 @@
 #define ZENITH_CPP_CONTROLS_HPP_
 
 #include <cstdio>
+#include <functional>
 #include <tuple>
 #include <vector>
 #include "glad/gl.h"
@@ -19,6 +20,13 @@ class Controls {
     double mouseSpeed;
     GLFWwindow* window;
     static double scrollOffset;
+    // Bumped by every GLFW input callback; the render loop compares it
+    // against the last value it saw to decide whether a frame is needed.
+    static unsigned long inputEvents;
+    // steadyNanoseconds() when the oldest input event not yet on screen
+    // was handled, 0 if there is none. Events are only seen when the loop
+    // polls, so time queued before that is missed.
+    static long long inputTime;
     GLint vertexbuffer;
     Controls(GLFWwindow* window, double mouseSpeed);
     glm::vec3 getTranslationVector(float width, float height);
@@ -28,9 +36,47 @@ class Controls {
         glm::mat4 view,
         glm::mat4 projection,
         glm::mat4 rotation,
-        VpTree<DataPoint, euclidean_distance>* tree_index
+        VpTree<DataPoint, euclidean_distance>* tree_index,
+        const std::function<bool(int)>* pickable = nullptr
     );
+    // The cursor in framebuffer pixels, origin bottom left, and the size of
+    // the view in them.
+    void cursorPixel(float* xpos, float* ypos, int* view_width, int* view_height);
+    // select() with the depth under the cursor already read back.
+    std::tuple<int, glm::vec3, float> selectWithDepth(
+        float depth,
+        glm::mat4 model,
+        glm::mat4 view,
+        glm::mat4 projection,
+        glm::mat4 rotation,
+        VpTree<DataPoint, euclidean_distance>* tree_index,
+        const std::function<bool(int)>* pickable = nullptr
+    );
+    // The part of select() after reading the cursor and the depth under
+    // it: unprojects window_point (x, y, depth in window coordinates) and
+    // returns the nearest pickable point within 0.5 of it.
+    static std::tuple<int, glm::vec3, float> selectAt(
+        glm::vec3 window_point,
+        int view_width,
+        int view_height,
+        glm::mat4 model,
+        glm::mat4 view,
+        glm::mat4 projection,
+        glm::mat4 rotation,
+        VpTree<DataPoint, euclidean_distance>* tree_index,
+        const std::function<bool(int)>* pickable = nullptr
+    );
+    static void noteInput();
+    // Returns inputTime and starts waiting for the next event.
+    static long long takeInput();
+    static void cursorPosCallback(GLFWwindow* window, double x, double y);
+    static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+    static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+    static void charCallback(GLFWwindow* window, unsigned int codepoint);
+    static void windowSizeCallback(GLFWwindow* window, int width, int height);
+    static void windowRefreshCallback(GLFWwindow* window);
     static void scrollCallback(GLFWwindow* window, double x, double y) {
+        noteInput();
         auto scrollOffsetPointer =
             reinterpret_cast<double*>(glfwGetWindowUserPointer(window));
         if (*scrollOffsetPointer + y > 1.0) {
@@ -66,6 +112,7 @@ class Controls3d: public Controls {
     glm::mat4 getRotationMatrix(int width, int height);
 
     static void scrollCallback3d(GLFWwindow* window, double x, double y) {
+        noteInput();
         auto scrollOffsetPointer =
             reinterpret_cast<double*>(glfwGetWindowUserPointer(window));
         *scrollOffsetPointer -= (y / 2.0);
@@ -9,30 +9,47 @@ using namespace std;
 #include <vector>
 #include <string>
 #include <map>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "GLBoilerPlate.hpp"
 #include "Controls.hpp"
 #include "GLModel.hpp"
+#include "GlfwLibrary.hpp"
+#include "Tracing.hpp"
 #include "imgui/imgui.h"
 #include "imgui/backends/imgui_impl_glfw.h"
 #include "imgui/backends/imgui_impl_opengl3.h"
 
 
-Engine::Engine(std::string shaderPath) {
-    models = new std::map<int, GLModel*>();
+Engine::Engine() {
+    auto empty = std::make_shared<SceneSnapshot>();
+    empty->version = 0;
+    scene = empty;
+    arena = new BufferArena();
+    releaseQueue = new ReleaseQueue();
+    commands = new CommandQueue();
     mouseSpeed = 20.0f;
-    this->shaderPath = shaderPath;
     picking_point = glm::vec3(0.0f, 0.0f, 0.0f);
 }
 
 Engine::~Engine() {
-    if (vertexArrayInitialized) {
-        glDeleteVertexArrays(1, &vertexArrayId);
-        vertexArrayInitialized = false;
+    if (renderThread.joinable()) {
+        close();
+        renderThread.join();
     }
-    if (shaderInitialized)
-        glDeleteShader(shaderProgram);
+    releaseWindow();
+    closeHeadless();
+    // Without a context every queued release is bookkeeping only.
+    releaseQueue->flush();
+    delete releaseQueue;
+    delete commands;
+    delete arena;
 }
 
 void Engine::initControls() {
@@ -43,28 +60,41 @@ void Engine::initialize() {
     this->width = 1024;
     this->height = 768;
     this->bp = new GLBoilerPlate();
+    this->bp->stats = &frameStats;
     this->window = bp->initWindow();
     initControls();
-    if (!shaderInitialized) {
-        vertexShader = bp->compileShader(
-            (this->shaderPath + "/vertexShader.shader").c_str(),
-            GL_VERTEX_SHADER);
-
-        fragmentShader = bp->compileShader(
-            (this->shaderPath + "/fragmentShader.shader").c_str(),
-            GL_FRAGMENT_SHADER);
-
-        shaderProgram = bp->linkShaders(vertexShader, fragmentShader);
-        shaderInitialized = true;
+    initializeGL(glfwGetProcAddress);
+    if (backgroundUploadBytes > 0) {
+        loader = new BufferLoader();
+        if (!loader->start(bp->initLoaderContext(window), [this]() { requestRedraw(); })) {
+            delete loader;
+            loader = nullptr;
+        }
     }
-    projectionMatrix = glGetUniformLocation(shaderProgram, "MVP");
+    contextActive = true;
+    framesPending = settleFrames;
+    seenInputEvents = Controls::inputEvents;
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO(); (void)io;
+    ImGui::StyleColorsDark();
+    ImGui_ImplGlfw_InitForOpenGL(window, true);
+    ImGui_ImplOpenGL3_Init("#version 330");
+}
+
+// Shaders, vertex array and fixed state shared by the window and the
+// offscreen context; bp must exist and the context must be current. load
+// is the context's GL function loader.
+void Engine::initializeGL(GLADloadfunc load) {
+    shaders.initialize(load);
     modelAffine = glm::mat4(1.0f);
     glGenVertexArrays(1, &vertexArrayId);
     glBindVertexArray(vertexArrayId);
     vertexArrayInitialized = true;
-    for (auto && pair : *models) {
-        pair.second->initBuffer();
-    }
+    frameScene = sceneSnapshot();
+    // Layers upload their buffers on first draw, once batching has decided
+    // whether they get their own buffers or a slice of a shared batch.
+    batchesDirty = true;
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glEnable(GL_PROGRAM_POINT_SIZE);
@@ -73,16 +103,16 @@ void Engine::initialize() {
     bgcolor = reinterpret_cast<float*>(malloc(sizeof(float) * 4));
     for (int i=0; i < 4; i++) bgcolor[i] = 0.05f;
     glClearColor(bgcolor[0], bgcolor[1], bgcolor[2], bgcolor[3]);
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO(); (void)io;
-    ImGui::StyleColorsDark();
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 330");
 }
 
 
 void Engine::deinitialize() {
+    if (loader != nullptr) {
+        loader->stop();
+        delete loader;
+        loader = nullptr;
+    }
+    deinitializeGL();
     delete controls;
     delete bp;
 
@@ -90,11 +120,503 @@ void Engine::deinitialize() {
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
-    glDeleteShader(shaderProgram);
-    this->shaderInitialized = false;
-
     glfwDestroyWindow(window);
-    glfwTerminate();
+    // Other plots' windows may still be open, a hidden resident one
+    // included.
+    releaseGlfw();
+    contextActive = false;
+}
+
+void Engine::suspendWindow() {
+    glfwHideWindow(window);
+    // Losing the focus releases the keys GLFW saw pressed, Escape included,
+    // so the next loop does not end at once.
+    glfwPollEvents();
+    glfwSetWindowShouldClose(window, GLFW_FALSE);
+    // The next loop may run on another thread.
+    glfwMakeContextCurrent(nullptr);
+    contextActive = false;
+    windowResident = true;
+}
+
+void Engine::resumeWindow() {
+    glfwMakeContextCurrent(window);
+    glfwShowWindow(window);
+    windowResident = false;
+    contextActive = true;
+    framesPending = settleFrames;
+    seenInputEvents = Controls::inputEvents;
+}
+
+void Engine::releaseWindow() {
+    if (!windowResident || loopActive)
+        return;
+    glfwMakeContextCurrent(window);
+    windowResident = false;
+    deinitialize();
+}
+
+void Engine::setKeepResident(bool enabled) {
+    keepResident = enabled;
+    if (!enabled)
+        releaseWindow();
+}
+
+// Takes effect from the next window; layers already on the GPU stay there.
+void Engine::setBackgroundUploads(size_t minBytes) {
+    backgroundUploadBytes = minBytes;
+}
+
+void Engine::deinitializeGL() {
+    clearBatches();
+    batchesDirty = true;
+    releaseQueue->flush();
+    for (auto && pair : frameScene->models) {
+        pair.second->dropBuffers();
+    }
+    frameScene.reset();
+    arena->releaseAll();
+    releaseCursorDepth();
+
+    glDeleteVertexArrays(1, &vertexArrayId);
+    vertexArrayInitialized = false;
+    shaders.release();
+    free(bgcolor);
+    bgcolor = nullptr;
+}
+
+bool Engine::initializeHeadless() {
+    headless = new HeadlessContext();
+    if (!headless->create()) {
+        delete headless;
+        headless = nullptr;
+        return false;
+    }
+    bp = new GLBoilerPlate();
+    bp->stats = &frameStats;
+    initializeGL(headless->loader);
+    return true;
+}
+
+void Engine::closeHeadless() {
+    std::lock_guard<std::mutex> lock(offscreenMutex);
+    if (headless == nullptr)
+        return;
+    headless->makeCurrent();
+    deinitializeGL();
+    delete bp;
+    headless->destroy();
+    delete headless;
+    headless = nullptr;
+}
+
+Camera Engine::fitCamera(int width, int height) {
+    float lowest[3];
+    float highest[3];
+    for (int c = 0; c < 3; c++) {
+        lowest[c] = std::numeric_limits<float>::max();
+        highest[c] = -std::numeric_limits<float>::max();
+    }
+    std::shared_ptr<const SceneSnapshot> current = sceneSnapshot();
+    for (auto && pair : current->models) {
+        pair.second->extendBounds(lowest, highest);
+    }
+    glm::vec3 lower(lowest[0], lowest[1], lowest[2]);
+    glm::vec3 upper(highest[0], highest[1], highest[2]);
+    Camera camera;
+    camera.yaw = 0.0f;
+    camera.pitch = 0.0f;
+    camera.fov = 45.0f;
+    if (lower.x > upper.x) {
+        camera.center = glm::vec3(0.0f);
+        camera.scale = 2.0f / std::max(1, std::min(width, height));
+        camera.distance = 5.0f;
+        return camera;
+    }
+    glm::vec3 extent = glm::max(upper - lower, glm::vec3(1e-6f));
+    camera.center = (lower + upper) * 0.5f;
+    camera.scale = 1.05f * std::max(extent.x / width, extent.y / height);
+    float radius = 0.5f * glm::length(extent);
+    camera.distance = 1.05f * radius / std::sin(glm::radians(camera.fov) * 0.5f);
+    return camera;
+}
+
+glm::mat4 Engine::cameraMatrix(const Camera& camera, int width, int height) {
+    // Same ortho setup as animate(), centered on the camera.
+    float halfWidth = 0.5f * width * camera.scale;
+    float halfHeight = 0.5f * height * camera.scale;
+    glm::mat4 projection = glm::ortho(-halfWidth, halfWidth, -halfHeight, halfHeight, 0.9f, 100.0f);
+    glm::vec3 eye = camera.center + glm::vec3(0.0f, 0.0f, 5.0f);
+    glm::mat4 view = glm::lookAt(eye, camera.center, glm::vec3(0.0f, 1.0f, 0.0f));
+    return projection * view;
+}
+
+bool Engine::beginOffscreen(int width, int height) {
+    if (loopActive) {
+        printf("zenith: offscreen rendering is unavailable while the window is open\n");
+        return false;
+    }
+    if (width <= 0 || height <= 0)
+        return false;
+    releaseWindow();
+    if (headless == nullptr) {
+        if (!initializeHeadless())
+            return false;
+    } else if (!headless->makeCurrent()) {
+        return false;
+    }
+    if (!headless->resize(width, height)) {
+        headless->doneCurrent();
+        return false;
+    }
+    acquireScene();
+    updateTimeline(0.0, false);
+    if (batchesDirty)
+        rebuildBatches();
+    arena->compact(compactBudget);
+    // Nothing is hovered offscreen; keep the picking highlight away.
+    shaders.setPickingPoint(glm::vec3(1e30f));
+    glViewport(0, 0, width, height);
+    // Images come out opaque: clear alpha to one and leave it there.
+    glClearColor(bgcolor[0], bgcolor[1], bgcolor[2], 1.0f);
+    return true;
+}
+
+void Engine::drawOffscreen(const Camera& camera, const std::set<int>* layers) {
+    int width = headless->width;
+    int height = headless->height;
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_FALSE);
+    bp->draw(
+        &frameScene->models,
+        &batches,
+        &shaders,
+        cameraMatrix(camera, width, height),
+        layers);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void Engine::endOffscreen() {
+    if (memoryDirty)
+        checkMemoryBudget();
+    releaseQueue->fence();
+    releaseQueue->collect();
+    frameStats.releaseGpu();
+    headless->doneCurrent();
+}
+
+bool Engine::renderOffscreen(int width, int height, std::vector<OffscreenView>* views) {
+    std::lock_guard<std::mutex> lock(offscreenMutex);
+    if (!beginOffscreen(width, height))
+        return false;
+    for (auto && view : *views) {
+        drawOffscreen(view.camera, view.filterLayers ? &view.layers : nullptr);
+        headless->readPixels(view.pixels);
+    }
+    endOffscreen();
+    return true;
+}
+
+bool Engine::exportFrames(
+    const std::string& path,
+    int format,
+    int width,
+    int height,
+    long frames,
+    int fps,
+    const Camera& camera,
+    int threads,
+    FrameExportStats* stats) {
+    std::lock_guard<std::mutex> lock(offscreenMutex);
+    auto started = std::chrono::steady_clock::now();
+    FrameEncoder encoder(path, format, width, height, fps, threads);
+    if (!encoder.open() || !beginOffscreen(width, height))
+        return false;
+
+    // The playhead moves rate / fps data units per output frame from the
+    // first time, whatever the wall clock does, and is put back afterwards.
+    long playhead = timeline.position;
+    timeline.held = true;
+    double perFrame = timeline.effectiveRate() / std::max(fps, 1);
+    if (frames <= 0) {
+        // One pass over the timeline, or a single still.
+        frames = 1;
+        if (timeline.hasLayers && perFrame > 0.0)
+            frames = std::max(1L, (long) ((timeline.last - timeline.first) / perFrame));
+    }
+
+    // Frame f is read into pixel buffer f % ringSize without waiting; it is
+    // mapped ringSize - 1 frames later, by which time the copy has usually
+    // finished, so readback overlaps drawing the frames in between.
+    const int ringSize = 3;
+    size_t frameBytes = 4 * (size_t) width * height;
+    size_t rowBytes = 4 * (size_t) width;
+    GLuint pixelBuffers[ringSize];
+    GLsync fences[ringSize] = {};
+    glGenBuffers(ringSize, pixelBuffers);
+    for (int i = 0; i < ringSize; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, nullptr, GL_STREAM_READ);
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // False when the frame can't be read back, e.g. after losing the
+    // context; the export then stops and fails.
+    auto retire = [&](long frame) {
+        int slot = frame % ringSize;
+        while (glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+        }
+        glDeleteSync(fences[slot]);
+        fences[slot] = nullptr;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+        auto mapped = static_cast<const unsigned char*>(
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT));
+        if (mapped == nullptr) {
+            fprintf(stderr, "zenith: could not read back frame %ld\n", frame);
+            return false;
+        }
+        std::vector<unsigned char> pixels = encoder.recycle();
+        pixels.resize(frameBytes);
+        // GL rows start at the bottom; images start at the top.
+        for (int row = 0; row < height; row++) {
+            memcpy(pixels.data() + rowBytes * row, mapped + rowBytes * (height - 1 - row), rowBytes);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        encoder.submit(frame, std::move(pixels));
+        return true;
+    };
+
+    bool captured = true;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, headless->framebuffer);
+    for (long frame = 0; frame < frames && captured; frame++) {
+        double target = frame * perFrame;
+        timeline.seek(timeline.first + (long) std::floor(target));
+        timeline.carry = target - std::floor(target);
+        updateTimeline(0.0, false);
+        drawOffscreen(camera, nullptr);
+        int slot = frame % ringSize;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if (frame >= ringSize - 1)
+            captured = retire(frame - (ringSize - 1));
+    }
+    for (long frame = std::max(0L, frames - (ringSize - 1)); frame < frames && captured; frame++) {
+        captured = retire(frame);
+    }
+    // Frames left in flight by a failed readback.
+    for (int i = 0; i < ringSize; i++) {
+        if (fences[i] != nullptr)
+            glDeleteSync(fences[i]);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glDeleteBuffers(ringSize, pixelBuffers);
+
+    timeline.held = false;
+    timeline.seek(playhead);
+    updateTimeline(0.0, false);
+    endOffscreen();
+    bool written = encoder.finish();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    stats->frames = frames;
+    stats->seconds = seconds;
+    stats->fps = seconds > 0.0 ? frames / seconds : 0.0;
+    stats->bytesWritten = encoder.bytesWritten;
+    return captured && written;
+}
+
+void Engine::viewMatrices(
+    const CameraPathSample& sample,
+    glm::mat4* model,
+    glm::mat4* view,
+    glm::mat4* projection,
+    glm::mat4* rotation) {
+    glm::vec3 position = glm::vec3(0, 0, 5);
+    float horizontalAngle = 3.14f;
+    float verticalAngle = 0.0f;
+    glm::vec3 direction(
+        cos(verticalAngle) * sin(horizontalAngle),
+        sin(verticalAngle),
+        cos(verticalAngle) * cos(horizontalAngle));
+    glm::vec3 right = glm::vec3(
+        sin(horizontalAngle - 3.14f / 2.0f),
+        0,
+        cos(horizontalAngle - 3.14f / 2.0f));
+    glm::vec3 up = glm::cross(right, direction);
+    double world_left = -(sample.width / 2.0) * sample.zoom;
+    double world_right = (sample.width / 2.0) * sample.zoom;
+    double world_top = (sample.height / 2.0) * sample.zoom;
+    double world_bottom = -(sample.height / 2.0) * sample.zoom;
+    *projection = glm::ortho<double>(
+        world_left,
+        world_right,
+        world_bottom,
+        world_top,
+        0.9f,
+        100.0f);
+    *view = glm::lookAt(
+        position,
+        position + direction,
+        up);
+    *model = glm::translate(glm::mat4(1.0f), sample.pan);
+    *rotation = glm::mat4(1.0f);
+}
+
+// Circles the center of the layers at a tenth of their extent while
+// zooming between 0.7 and 1.3 times the fitted scale; the cursor sweeps
+// a Lissajous figure so hover picking lands on and off the data. Returns
+// the angle of the turn, 0 to 2 pi over the path.
+static double sweepSample(CameraPathSample* sample, long frame, long frames, double fps, int width, int height) {
+    double phase = frames > 1 ? (double) frame / (frames - 1) : 0.0;
+    double turn = glm::two_pi<double>() * phase;
+    sample->time = frame / fps;
+    sample->width = width;
+    sample->height = height;
+    sample->cursorX = 0.5 * width * (1.0 + 0.8 * std::sin(3.0 * turn));
+    sample->cursorY = 0.5 * height * (1.0 + 0.8 * std::sin(2.0 * turn));
+    sample->angleX = 0.0;
+    sample->angleY = 0.0;
+    return turn;
+}
+
+CameraPath Engine::syntheticCameraPath(int width, int height, long frames, double fps) {
+    Camera fit = fitCamera(width, height);
+    float radius = 0.1f * fit.scale * std::max(width, height);
+    CameraPath path;
+    for (long frame = 0; frame < frames; frame++) {
+        CameraPathSample sample;
+        double turn = sweepSample(&sample, frame, frames, fps, width, height);
+        glm::vec3 offset((float) std::cos(turn), (float) std::sin(turn), 0.0f);
+        // The window never pans in depth.
+        sample.pan = -(fit.center + radius * offset);
+        sample.pan.z = 0.0f;
+        sample.zoom = fit.scale * (1.0 - 0.3 * std::sin(turn));
+        path.samples.push_back(sample);
+    }
+    return path;
+}
+
+CameraPathSample Engine::controlSample(double zoom, double angleX, double angleY) {
+    CameraPathSample sample;
+    sample.time = glfwGetTime();
+    sample.width = width;
+    sample.height = height;
+    sample.pan = glm::vec3(modelAffine[3]);
+    sample.zoom = zoom;
+    sample.angleX = angleX;
+    sample.angleY = angleY;
+    // Framebuffer pixels, which is what picking reads depth in.
+    int windowWidth;
+    int windowHeight;
+    glfwGetCursorPos(window, &sample.cursorX, &sample.cursorY);
+    glfwGetWindowSize(window, &windowWidth, &windowHeight);
+    if (windowWidth > 0 && windowHeight > 0) {
+        sample.cursorX *= (double) width / windowWidth;
+        sample.cursorY *= (double) height / windowHeight;
+    }
+    return sample;
+}
+
+void Engine::recordSample(const CameraPathSample& sample) {
+    if (!recording)
+        return;
+    if (cameraRecording.samples.empty())
+        recordingStart = sample.time;
+    cameraRecording.samples.push_back(sample);
+    cameraRecording.samples.back().time -= recordingStart;
+}
+
+bool Engine::replayCameraPath(const CameraPath& path, ReplayReport* report) {
+    typedef std::chrono::steady_clock Clock;
+    auto seconds = [](Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<double>(to - from).count();
+    };
+    std::lock_guard<std::mutex> lock(offscreenMutex);
+    if (path.samples.empty())
+        return false;
+    if (!beginOffscreen(path.samples[0].width, path.samples[0].height))
+        return false;
+    report->backend = headless->backend;
+    report->width = path.samples[0].width;
+    report->height = path.samples[0].height;
+    report->frames.clear();
+
+    // The recorded times drive playback; the live playhead is put back
+    // afterwards.
+    Timeline live = timeline;
+    timeline.restart = true;
+    bool replayed = true;
+    for (auto && sample : path.samples) {
+        ZENITH_TRACE_ZONE("replay frame");
+        ReplayFrame frame;
+        frameStats.beginFrame();
+        auto started = Clock::now();
+        if (!headless->resize(sample.width, sample.height)) {
+            replayed = false;
+            break;
+        }
+        glViewport(0, 0, sample.width, sample.height);
+        acquireScene();
+        updateTimeline(sample.time, true);
+        if (batchesDirty)
+            rebuildBatches();
+        arena->compact(compactBudget);
+        auto updated = Clock::now();
+
+        // The window's order: pick with the depth read back after the
+        // previous frame, so the highlight lands in this one, then draw.
+        frameStats.beginPhase(PHASE_PICK);
+        glm::mat4 model, view, projection, rotation;
+        viewMatrices(sample, &model, &view, &projection, &rotation);
+        glm::vec3 cursor((float) sample.cursorX, (float) (sample.height - 1 - sample.cursorY), cursorDepth());
+        int index;
+        auto select = [&](GLModel* layer, const std::function<bool(int)>* pickable) {
+            return Controls::selectAt(
+                cursor, sample.width, sample.height,
+                model, view, projection, rotation, layer->tree_index, pickable);
+        };
+        if (pickNearest(&frameScene->models, select, &index) != nullptr)
+            shaders.setPickingPoint(picking_point);
+        auto picked = Clock::now();
+
+        frameStats.beginPhase(PHASE_DRAW);
+        unsigned long drawCalls = RenderCounters::drawCalls;
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_FALSE);
+        bp->draw(
+            &frameScene->models,
+            &batches,
+            &shaders,
+            projection * view * model * rotation,
+            nullptr);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        readCursorDepth((int) cursor.x, (int) cursor.y);
+        frame.drawCalls = RenderCounters::drawCalls - drawCalls;
+        auto drawn = Clock::now();
+
+        // Offscreen there is nothing to swap; waiting for the GPU stands
+        // in for presenting.
+        frameStats.beginPhase(PHASE_PRESENT);
+        glFinish();
+        auto finished = Clock::now();
+        frameStats.endFrame();
+        frame.update = seconds(started, updated);
+        frame.pick = seconds(updated, picked);
+        frame.draw = seconds(picked, drawn);
+        frame.finish = seconds(drawn, finished);
+        frame.total = seconds(started, finished);
+        report->frames.push_back(frame);
+    }
+
+    timeline = live;
+    updateTimeline(0.0, false);
+    shaders.setPickingPoint(glm::vec3(1e30f));
+    endOffscreen();
+    summarizeReplay(report);
+    return replayed;
 }
 
 void Engine::renderSubroutine(
@@ -103,34 +625,224 @@ void Engine::renderSubroutine(
     glm::mat4 view,
     glm::mat4 projection,
     glm::mat4 rotation) {
+    ZENITH_TRACE_ZONE("Engine::renderSubroutine");
+    frameStats.beginFrame();
+    long long input = Controls::takeInput();
+    updateFrame();
+
+    frameStats.beginPhase(PHASE_PICK);
+    int best_id = -1;
+    GLModel* best_model = pickFrame(model, view, projection, rotation, &best_id);
+
+    frameStats.beginPhase(PHASE_DRAW);
+    drawFrame(modelViewProjection);
+
+    frameStats.beginPhase(PHASE_UI);
+    drawUI(best_model, best_id);
+
+    frameStats.beginPhase(PHASE_PRESENT);
+    presentFrame(input);
+    frameStats.endFrame();
+    notifyBudget();
+}
+
+void Engine::updateFrame() {
+    ZENITH_TRACE_ZONE("Engine::updateFrame");
+    updateTimeline(glfwGetTime(), true);
+    if (batchesDirty)
+        rebuildBatches();
+    if (loader != nullptr)
+        updateUploads();
+    compactionActive = arena->compact(compactBudget) > 0;
+}
 
+// Hands new large layers to the loader and publishes the ones whose
+// buffers are complete. Layers removed in the meantime lose theirs.
+void Engine::updateUploads() {
+    ZENITH_TRACE_ZONE("Engine::updateUploads");
+    for (auto && pair : frameScene->models) {
+        GLModel* model = pair.second.get();
+        if (model->bufferInitialized || model->uploadPending || model->batched || !model->backgroundUpload())
+            continue;
+        size_t bytes = sizeof(float) * (size_t) model->numVertices * model->numComponents;
+        if (bytes >= backgroundUploadBytes)
+            loader->submit(pair.first, pair.second);
+    }
+    for (auto && upload : loader->collect()) {
+        auto found = frameScene->models.find(upload.id);
+        if (found == frameScene->models.end() || found->second != upload.model || upload.buffers.empty()) {
+            glDeleteBuffers((GLsizei) upload.buffers.size(), upload.buffers.data());
+            upload.model->uploadPending = false;
+            continue;
+        }
+        upload.model->adoptBuffers(upload.buffers[0], upload.buffers.size() > 1 ? upload.buffers[1] : 0);
+        RenderCounters::uploadBytes += upload.bytes * upload.buffers.size();
+        requestRedraw();
+    }
+}
+
+// Picks before drawing, so the highlight and the info box show the point
+// under the cursor in the frame that is being drawn.
+GLModel* Engine::pickFrame(glm::mat4 model, glm::mat4 view, glm::mat4 projection, glm::mat4 rotation, int* index) {
+    ZENITH_TRACE_ZONE("Engine::pickFrame");
+    float depth = cursorDepth();
+    return pickNearest(
+        &frameScene->models,
+        [&](GLModel* layer, const std::function<bool(int)>* pickable) {
+            return controls->selectWithDepth(depth, model, view, projection, rotation, layer->tree_index, pickable);
+        },
+        index);
+}
+
+void Engine::drawFrame(glm::mat4 modelViewProjection) {
+    ZENITH_TRACE_ZONE("Engine::drawFrame");
+    shaders.setPickingPoint(picking_point);
     glClearColor(bgcolor[0], bgcolor[1], bgcolor[2], bgcolor[3]);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    bp->draw(&frameScene->models, &batches, &shaders, modelViewProjection, nullptr);
+    float x, y;
+    int viewWidth, viewHeight;
+    controls->cursorPixel(&x, &y, &viewWidth, &viewHeight);
+    readCursorDepth((int) x, (int) y);
+    if (memoryDirty)
+        checkMemoryBudget();
+}
 
+void Engine::drawUI(GLModel* picked, int index) {
+    ZENITH_TRACE_ZONE("Engine::drawUI");
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
-    GLint pick_var = glGetUniformLocation(shaderProgram, "picking_point");
-    glUniform3f(pick_var, picking_point.x, picking_point.y, picking_point.z);
 
-    bp->render(
-        window,
-        models,
-        shaderProgram,
-        projectionMatrix,
-        modelViewProjection);
+    ImGui::Begin("Layers");
+    for (auto && pair : frameScene->models) {
+        pair.second->renderUI();
+    }
+    ImGui::End();
 
     ImGui::Begin("Info box");
     ImGui::TextColored(ImVec4(1, 1, 0, 1), "Data Items");
     ImGui::BeginChild("Scrolling");
-    GLModel* best_model;
-    auto best_id = -1;
+    if (picked != nullptr) {
+        ImGui::Text("Model Name: %s", picked->name.c_str());
+        ImGui::Text("Index: %d", index);
+        if (picked->stringReps.size() > 0) {
+            ImGui::Text("Data: %s", picked->stringReps[index].c_str());
+        }
+    }
+    ImGui::EndChild();
+    ImGui::End();
+    ImGui::Begin("Control Panel");
+    ImGui::ColorEdit4("Background Color", bgcolor);
+    timeline.renderUI();
+    renderStatsUI();
+    ImGui::End();
+
+    ImGui::Render();
+    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+}
+
+void Engine::presentFrame(long long input) {
+    ZENITH_TRACE_ZONE("Engine::presentFrame");
+    bp->present(window);
+    // The swap returning is as close to the photons as GL lets us see.
+    if (input != 0)
+        frameStats.setInputLatency((steadyNanoseconds() - input) * 1e-9);
+    releaseQueue->fence();
+    releaseQueue->collect();
+}
+
+void Engine::readCursorDepth(int x, int y) {
+    if (depthReadback == 0) {
+        glGenBuffers(1, &depthReadback);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, depthReadback);
+        glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(float), nullptr, GL_STREAM_READ);
+    } else {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, depthReadback);
+    }
+    glReadPixels(x, y, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    // A read still in flight is superseded; GL keeps the two in order.
+    if (depthFence != nullptr)
+        glDeleteSync(depthFence);
+    depthFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+float Engine::cursorDepth() {
+    if (depthFence == nullptr || glClientWaitSync(depthFence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        return lastCursorDepth;
+    glDeleteSync(depthFence);
+    depthFence = nullptr;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, depthReadback);
+    glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, sizeof(float), &lastCursorDepth);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return lastCursorDepth;
+}
+
+void Engine::releaseCursorDepth() {
+    if (depthFence != nullptr)
+        glDeleteSync(depthFence);
+    if (depthReadback != 0)
+        glDeleteBuffers(1, &depthReadback);
+    depthFence = nullptr;
+    depthReadback = 0;
+    lastCursorDepth = 1.0f;
+}
+
+void Engine::renderStatsUI() {
+    if (!ImGui::CollapsingHeader("Stats"))
+        return;
+    // The previous frame's numbers; this one is still being drawn.
+    FrameStatsSnapshot stats = frameStats.snapshot();
+    std::vector<float> history;
+    float worst = 0.0f;
+    double total = 0.0;
+    for (auto && seconds : stats.history) {
+        history.push_back((float) (seconds * 1000.0));
+        worst = std::max(worst, history.back());
+        total += history.back();
+    }
+    double mean = history.empty() ? 0.0 : total / history.size();
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "mean %.2f ms, max %.2f ms", mean, worst);
+    ImGui::PlotLines("Frame ms", history.data(), (int) history.size(), 0, overlay, 0.0f, worst * 1.2f, ImVec2(0, 60));
+    ImGui::Text("Frame: %.2f ms", stats.last.seconds * 1000.0);
+    const double* phases = stats.last.phaseSeconds;
+    ImGui::Text("  update %.2f, pick %.2f, draw %.2f, ui %.2f, present %.2f",
+                phases[PHASE_UPDATE] * 1000.0, phases[PHASE_PICK] * 1000.0, phases[PHASE_DRAW] * 1000.0,
+                phases[PHASE_UI] * 1000.0, phases[PHASE_PRESENT] * 1000.0);
+    if (!stats.inputLatencies.empty()) {
+        double slowest = *std::max_element(stats.inputLatencies.begin(), stats.inputLatencies.end());
+        ImGui::Text("Input to present: %.2f ms, max %.2f ms",
+                    stats.inputLatencies.back() * 1000.0, slowest * 1000.0);
+    }
+    ImGui::Text("Draw calls: %lu", stats.last.drawCalls);
+    ImGui::Text("Vertices: %lu drawn, %lu culled", stats.last.vertices, stats.last.culledVertices);
+    ImGui::Text("Uploaded: %lu bytes", stats.last.uploadBytes);
+    if (loader != nullptr && loader->pending() > 0)
+        ImGui::Text("Uploading: %lu layers", (unsigned long) loader->pending());
+    for (auto && layer : stats.gpu) {
+        ImGui::Text("GPU %.3f ms  %s", layer.seconds * 1000.0, layer.name.c_str());
+    }
+}
+
+GLModel* Engine::pickNearest(
+    const ModelMap* models,
+    std::function<std::tuple<int, glm::vec3, float>(GLModel*, const std::function<bool(int)>*)> select,
+    int* index) {
+    GLModel* best_model = nullptr;
     float best_dist = 1000000.0f;
+    *index = -1;
     for (auto && gl_model_pair : *models) {
         auto gl_model = gl_model_pair.second;
-        if (gl_model->pickingEnabled) {
-            auto selection = controls->select(
-                model, view, projection,
-                rotation, gl_model->tree_index);
+        // Not drawn yet, so nothing of it is under the cursor.
+        if (gl_model->pickingEnabled && !gl_model->uploadPending) {
+            // Points hidden by an animated layer's time window can't be
+            // picked.
+            GLModel* layer = gl_model.get();
+            std::function<bool(int)> pickable = [layer](int index) { return layer->pickable(index); };
+            long first, last, step;
+            auto selection = select(layer, layer->timeRange(&first, &last, &step) ? &pickable : nullptr);
 
             auto id = std::get<0>(selection);
             if (id >= 0) {
@@ -141,54 +853,377 @@ void Engine::renderSubroutine(
                     picking_point.y = point.y;
                     picking_point.z = point.z;
                     best_dist = distance;
-                    best_model = gl_model;
-                    best_id = id;
+                    best_model = layer;
+                    *index = id;
                 }
             }
         }
     }
-    if (best_id > -1) {
-        ImGui::Text("Model Name: %s", best_model->name.c_str());
-        ImGui::Text("Index: %d", best_id);
-        if (best_model->stringReps.size() > 0) {
-            ImGui::Text("Data: %s", best_model->stringReps[best_id].c_str());
-        }
+    return best_model;
+}
+
+bool Engine::start() {
+#ifdef __APPLE__
+    // Cocoa only lets the main thread own windows.
+    return false;
+#else
+    if (loopActive)
+        return false;
+    if (renderThread.joinable())
+        renderThread.join();
+    // Set before the thread runs so commands submitted from here on wait
+    // for the loop instead of racing its startup.
+    loopActive = true;
+    renderThread = std::thread([this]() { animate(); });
+    return true;
+#endif
+}
+
+void Engine::join() {
+    if (renderThread.joinable())
+        renderThread.join();
+}
+
+void Engine::close() {
+    submit([this]() {
+        if (!contextActive)
+            return false;
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+        return true;
+    });
+}
+
+CommandFuture Engine::submit(std::function<bool()> command) {
+    CommandFuture future = commands->push(command);
+    if (!loopActive || loopThread == std::this_thread::get_id()) {
+        commands->drain();
+        notifyBudget();
+    } else if (contextActive) {
+        glfwPostEmptyEvent();
     }
-    ImGui::EndChild();
-    ImGui::End();
-    ImGui::Begin("Control Panel");
-    ImGui::ColorEdit4("Background Color", bgcolor);
-    ImGui::End();
-    ImGui::Render();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    return future;
 }
 
-bool Engine::addModel(int id, GLModel *model) {
-    this->models->insert(std::pair<int, GLModel*>(id, model));
+void Engine::beginLoop() {
+    ZENITH_TRACE_THREAD("render");
+    loopActive = true;
+    loopThread = std::this_thread::get_id();
+    closeHeadless();
+    if (windowResident) {
+        resumeWindow();
+    } else {
+        initialize();
+    }
+}
+
+void Engine::endLoop() {
+    frameStats.releaseGpu();
+    if (keepResident) {
+        suspendWindow();
+    } else {
+        deinitialize();
+    }
+    loopActive = false;
+    loopThread = std::thread::id();
+    // Whatever arrived after the last frame runs here, or on the submitting
+    // thread once it sees loopActive cleared.
+    commands->drain();
+    notifyBudget();
+}
+
+void Engine::requestRedraw() {
+    redrawRequested = true;
+    if (contextActive)
+        glfwPostEmptyEvent();
+}
+
+std::shared_ptr<const SceneSnapshot> Engine::sceneSnapshot() {
+    return std::atomic_load(&scene);
+}
+
+bool Engine::acquireScene() {
+    std::shared_ptr<const SceneSnapshot> next = sceneSnapshot();
+    if (next == frameScene)
+        return false;
+    std::shared_ptr<const SceneSnapshot> previous = frameScene;
+    for (auto && pair : previous->models) {
+        auto found = next->models.find(pair.first);
+        if (found != next->models.end() && found->second == pair.second)
+            continue;
+        // The queue keeps the layer alive until its buffers are released;
+        // the last reference, here or in Python, frees its CPU data.
+        std::shared_ptr<GLModel> removed = pair.second;
+        releaseQueue->defer([removed]() { removed->releaseBuffers(); });
+    }
+    // Batches still point into the previous snapshot's layers; it is
+    // reclaimed with them once the frames that drew it have finished.
+    releaseQueue->defer([previous]() {});
+    frameScene = next;
+    batchesDirty = true;
+    memoryDirty = true;
     return true;
 }
 
-bool Engine::removeModel(int id) {
-    if (this->modelExists(id)) {
-        this->models->erase(id);
+void Engine::setContinuousRendering(bool enabled) {
+    continuousRendering = enabled;
+    requestRedraw();
+}
+
+double Engine::nextFrameDelay() {
+    double delay = maxIdleWait;
+    double now = glfwGetTime();
+    for (auto && pair : frameScene->models) {
+        double due = pair.second->nextFrameDelay(now);
+        if (due >= 0.0 && due < delay)
+            delay = due;
+    }
+    double due = timeline.nextFrameDelay(now);
+    if (due >= 0.0 && due < delay)
+        delay = due;
+    // Compaction and fenced releases finish over the next few frames.
+    if (compactionActive)
+        delay = 0.0;
+    else if (releaseQueue->pending() > 0 && delay > 0.02)
+        delay = 0.02;
+    return delay;
+}
+
+// Gathers the animated layers' extents, moves the playhead by the wall time
+// since the last frame when advancing, and hands it to every layer.
+void Engine::updateTimeline(double now, bool advance) {
+    const ModelMap& models = frameScene->models;
+    updateTimelineExtent(models);
+    if (advance)
+        timeline.advance(now);
+    for (auto && pair : models) {
+        pair.second->seekClock(timeline.position, timeline.carry);
+    }
+}
+
+// Timeline commands call this with the published scene, so seeks and
+// queries see layers added since the last frame, or before the first.
+void Engine::updateTimelineExtent(const ModelMap& models) {
+    timeline.beginExtent();
+    for (auto && pair : models) {
+        long first, last, step;
+        if (pair.second->timeRange(&first, &last, &step))
+            timeline.addExtent(first, last, step);
+    }
+    timeline.endExtent();
+}
+
+void Engine::waitForEvents() {
+    if (continuousRendering || framesPending > 0) {
+        glfwPollEvents();
+        return;
+    }
+    double delay = nextFrameDelay();
+    if (delay > 0.0)
+        glfwWaitEventsTimeout(delay);
+    else
+        glfwPollEvents();
+}
+
+bool Engine::frameRequested() {
+    bool changed = acquireScene();
+    changed = redrawRequested.exchange(false) || changed;
+    if (Controls::inputEvents != seenInputEvents) {
+        seenInputEvents = Controls::inputEvents;
+        changed = true;
+    }
+    if (changed && framesPending < settleFrames)
+        framesPending = settleFrames;
+    if (framesPending > 0) {
+        framesPending--;
         return true;
     }
+    if (continuousRendering)
+        return true;
+    if (nextFrameDelay() <= 0.0)
+        return true;
+    // Nothing to draw; fences from earlier frames can still retire.
+    releaseQueue->collect();
     return false;
 }
 
+void Engine::clearBatches() {
+    for (auto && batch : batches) {
+        // Members go back to drawing themselves right away; the shared
+        // buffers may still be in use by the previous frame.
+        batch->detachMembers();
+        releaseQueue->defer([batch]() { delete batch; });
+    }
+    batches.clear();
+}
+
+void Engine::rebuildBatches() {
+    // Bounded so the per-layer table stays well inside GL_MAX_TEXTURE_SIZE.
+    const size_t maxBatchLayers = 4096;
+    clearBatches();
+    batchesDirty = false;
+    memoryDirty = true;
+    if (!batchingEnabled)
+        return;
+
+    // Layers stack in id order, so a batch only takes a run of consecutive
+    // layers; any other layer in between starts a new one.
+    GLBatch* open = nullptr;
+    for (auto && pair : frameScene->models) {
+        GLModel* model = pair.second.get();
+        if (!model->batchable() || model->uploadPending || model->numVertices > batchMaxVertices) {
+            open = nullptr;
+            continue;
+        }
+        if (open == nullptr || open->drawType != model->drawType || open->members.size() >= maxBatchLayers) {
+            open = new GLBatch(model->drawType, arena);
+            batches.push_back(open);
+        }
+        open->addMember(model);
+    }
+
+    // A batch of one layer saves nothing over the layer's own buffers.
+    std::vector<GLBatch*> merged;
+    for (auto && batch : batches) {
+        if (batch->members.size() > 1) {
+            merged.push_back(batch);
+        } else {
+            batch->detachMembers();
+            delete batch;
+        }
+    }
+    batches = merged;
+}
+
+void Engine::setBatching(bool enabled, int maxVertices) {
+    batchingEnabled = enabled;
+    batchMaxVertices = maxVertices;
+    batchesDirty = true;
+    requestRedraw();
+}
+
+BufferArenaStats Engine::bufferStats() {
+    return arena->stats();
+}
+
+std::map<int, LayerMemoryStats> Engine::memoryStats() {
+    std::map<int, LayerMemoryStats> result;
+    std::shared_ptr<const SceneSnapshot> current = sceneSnapshot();
+    for (auto && pair : current->models) {
+        result[pair.first] = pair.second->memoryStats();
+    }
+    // Batched layers own no buffers; charge them their slice of the batch.
+    for (auto && batch : batches) {
+        if (!batch->bufferInitialized)
+            continue;
+        for (size_t i = 0; i < batch->members.size(); i++) {
+            auto found = result.find(batch->members[i]->id);
+            if (found == result.end())
+                continue;
+            size_t count = batch->counts[i];
+            found->second.gpuVertexBytes += 3 * sizeof(float) * count;
+            if (batch->useColorData)
+                found->second.gpuColorBytes += 3 * sizeof(float) * count;
+            found->second.gpuBatchSlotBytes += sizeof(float) * count;
+        }
+    }
+    return result;
+}
+
+void Engine::setMemoryBudget(size_t cpuBytes, size_t gpuBytes, std::function<void(size_t, size_t)> hook) {
+    cpuBudget = cpuBytes;
+    gpuBudget = gpuBytes;
+    budgetHook = hook;
+    overBudget = false;
+    checkMemoryBudget();
+}
+
+void Engine::checkMemoryBudget() {
+    memoryDirty = false;
+    if (cpuBudget == 0 && gpuBudget == 0)
+        return;
+    size_t cpuBytes = 0;
+    std::shared_ptr<const SceneSnapshot> current = sceneSnapshot();
+    for (auto && pair : current->models) {
+        cpuBytes += pair.second->memoryStats().cpuBytes();
+    }
+    size_t gpuBytes = arena->stats().reservedBytes;
+    bool exceeded = (cpuBudget > 0 && cpuBytes > cpuBudget)
+        || (gpuBudget > 0 && gpuBytes > gpuBudget);
+    if (exceeded && !overBudget) {
+        if (budgetHook) {
+            std::function<void(size_t, size_t)> hook = budgetHook;
+            std::lock_guard<std::mutex> lock(budgetMutex);
+            budgetNotice = [hook, cpuBytes, gpuBytes]() { hook(cpuBytes, gpuBytes); };
+        } else {
+            printf("zenith: memory budget exceeded, cpu %zu bytes, gpu %zu bytes\n", cpuBytes, gpuBytes);
+        }
+    }
+    overBudget = exceeded;
+}
+
+void Engine::notifyBudget() {
+    std::function<void()> notice;
+    {
+        std::lock_guard<std::mutex> lock(budgetMutex);
+        std::swap(notice, budgetNotice);
+    }
+    if (notice)
+        notice();
+}
+
+bool Engine::addModel(int id, std::shared_ptr<GLModel> model) {
+    model->arena = arena;
+    {
+        std::lock_guard<std::mutex> lock(sceneWriteMutex);
+        std::shared_ptr<const SceneSnapshot> current = sceneSnapshot();
+        if (current->models.find(id) != current->models.end())
+            return true;
+        auto next = std::make_shared<SceneSnapshot>(*current);
+        next->models[id] = model;
+        next->version = current->version + 1;
+        std::atomic_store(&scene, std::shared_ptr<const SceneSnapshot>(next));
+    }
+    // With a render loop running the budget is checked once the layer has
+    // been picked up, on the render thread.
+    if (!loopActive)
+        checkMemoryBudget();
+    requestRedraw();
+    return true;
+}
+
+bool Engine::removeModel(int id) {
+    {
+        std::lock_guard<std::mutex> lock(sceneWriteMutex);
+        std::shared_ptr<const SceneSnapshot> current = sceneSnapshot();
+        if (current->models.find(id) == current->models.end())
+            return false;
+        auto next = std::make_shared<SceneSnapshot>(*current);
+        next->models.erase(id);
+        next->version = current->version + 1;
+        std::atomic_store(&scene, std::shared_ptr<const SceneSnapshot>(next));
+    }
+    requestRedraw();
+    return true;
+}
+
 bool Engine::modelExists(int id) {
-    return this->models->find(id) != this->models->end();
+    std::shared_ptr<const SceneSnapshot> current = sceneSnapshot();
+    return current->models.find(id) != current->models.end();
 }
 
 int Engine::numModels() {
-    return this->models->size();
+    return sceneSnapshot()->models.size();
 }
 
 void Engine::animate() {
-    initialize();
+    beginLoop();
     float slider = 0.0f;
     do {
+        waitForEvents();
+        commands->drain();
+        notifyBudget();
+        if (!frameRequested())
+            continue;
         double scrollFactor;
         double magnitude = (width + height) / 2.0;
         scrollFactor = Controls::scrollOffset / magnitude;
@@ -196,50 +1231,24 @@ void Engine::animate() {
         glfwGetFramebufferSize(window, &width, &height);
         mouseSpeed = magnitude / (1 / scrollFactor);
         controls->mouseSpeed = mouseSpeed;
-        glm::vec3 position = glm::vec3(0, 0, 5);
-        float horizontalAngle = 3.14f;
-        float verticalAngle = 0.0f;
-        float initialFoV = 90.0f;
-        glm::vec3 direction(
-            cos(verticalAngle) * sin(horizontalAngle),
-            sin(verticalAngle),
-            cos(verticalAngle) * cos(horizontalAngle));
-        glm::vec3 right = glm::vec3(
-            sin(horizontalAngle - 3.14f / 2.0f),
-            0,
-            cos(horizontalAngle - 3.14f / 2.0f));
-        glm::vec3 up = glm::cross(right, direction);
-        double world_left = -(width / 2.0) * scrollFactor;
-        double world_right = (width / 2.0) * scrollFactor;
-        double world_top = (height / 2.0) * scrollFactor;
-        double world_bottom = -(height / 2.0) * scrollFactor;
-        glm::mat4 projection = glm::ortho<double>(
-            world_left,
-            world_right,
-            world_bottom,
-            world_top,
-            0.9f,
-            100.0f);
-
-        auto view = glm::lookAt(
-            position,
-            position + direction,
-            up);
 
         glm::vec3 translation = controls->getTranslationVector(width, height);
         modelAffine = glm::translate(modelAffine, translation);
-        glm::mat4 mvp = projection * view * modelAffine;
-        renderSubroutine(mvp, modelAffine, view, projection, glm::mat4(1.0f));
+        CameraPathSample sample = controlSample(scrollFactor, 0.0, 0.0);
+        recordSample(sample);
+        glm::mat4 model, view, projection, rotation;
+        viewMatrices(sample, &model, &view, &projection, &rotation);
+        glm::mat4 mvp = projection * view * model;
+        renderSubroutine(mvp, model, view, projection, rotation);
     } while ((glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
              glfwWindowShouldClose(window) == 0));
 
-    deinitialize();
+    endLoop();
 }
 
 
 
-Engine3d::Engine3d(std::string shaderPath): Engine(shaderPath) {
-    models = new std::map<int, GLModel*>();
+Engine3d::Engine3d(): Engine() {
     mouseSpeed = 20.0f;
     camPosition = glm::vec3(0.0f, 0.0f, 5.0f);
     camLookAt = glm::vec3(0.0f, 0.0f, -1000.0f);
@@ -249,10 +1258,72 @@ void Engine3d::initControls() {
     this->controls = new Controls3d(this->window, this->mouseSpeed);
 }
 
-void Engine3d::animate() {
-    initialize();
+glm::mat4 Engine3d::cameraMatrix(const Camera& camera, int width, int height) {
+    glm::mat4 projection = glm::perspective(
+        glm::radians(camera.fov),
+        static_cast<float>(width) / static_cast<float>(height),
+        0.01f * camera.distance,
+        100.0f * camera.distance);
+    glm::mat4 view = glm::lookAt(
+        camera.center + glm::vec3(0.0f, 0.0f, camera.distance),
+        camera.center,
+        glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 orbit = glm::translate(glm::mat4(1.0f), camera.center);
+    orbit = glm::rotate(orbit, camera.pitch, glm::vec3(1.0f, 0.0f, 0.0f));
+    orbit = glm::rotate(orbit, camera.yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+    orbit = glm::translate(orbit, -camera.center);
+    return projection * view * orbit;
+}
+
+void Engine3d::viewMatrices(
+    const CameraPathSample& sample,
+    glm::mat4* model,
+    glm::mat4* view,
+    glm::mat4* projection,
+    glm::mat4* rotation) {
     float fov = 90.0f;
+    *projection = glm::perspective(
+        fov,
+        static_cast<float>(sample.width) / static_cast<float>(sample.height),
+        0.1f,
+        1000.0f);
+    *view = glm::lookAt(
+        glm::vec3(camPosition.x, camPosition.y, (float) sample.zoom),
+        camLookAt,
+        glm::vec3(0.0f, 1.0f, 0.0f));
+    *model = glm::translate(glm::mat4(1.0f), sample.pan);
+    // As Controls3d::getRotationMatrix builds it.
+    glm::mat4 trans = glm::mat4(1.0f);
+    auto x_rot =
+        glm::rotate<float>(trans, sample.angleX, glm::vec3(0.0f, 1.0f, 0.0f));
+    auto y_rot =
+        glm::rotate<float>(trans, sample.angleY, glm::vec3(1.0f, 0.0f, 0.0f));
+    *rotation = x_rot * y_rot;
+}
+
+CameraPath Engine3d::syntheticCameraPath(int width, int height, long frames, double fps) {
+    Camera fit = fitCamera(width, height);
+    CameraPath path;
+    for (long frame = 0; frame < frames; frame++) {
+        CameraPathSample sample;
+        double turn = sweepSample(&sample, frame, frames, fps, width, height);
+        sample.pan = -fit.center;
+        sample.zoom = fit.distance * (1.0 - 0.3 * std::sin(turn));
+        sample.angleX = turn;
+        sample.angleY = 0.25 * std::sin(2.0 * turn);
+        path.samples.push_back(sample);
+    }
+    return path;
+}
+
+void Engine3d::animate() {
+    beginLoop();
     do {
+        waitForEvents();
+        commands->drain();
+        notifyBudget();
+        if (!frameRequested())
+            continue;
         float scrollFactor;
         scrollFactor = Controls::scrollOffset;
         glfwGetFramebufferSize(window, &width, &height);
@@ -261,26 +1332,22 @@ void Engine3d::animate() {
             / static_cast<float>(height);
 
         controls->mouseSpeed = mouseSpeed;
-        glm::mat4 projection = glm::perspective(
-            fov,
-            static_cast<float>(width) / static_cast<float>(height),
-            0.1f,
-            1000.0f);
 
         glm::vec3 translation = controls->getTranslationVector(width, height);
-        glm::mat4 rotation = controls->getRotationMatrix(width, height);
+        // Updates the drag angles the rotation is rebuilt from below.
+        controls->getRotationMatrix(width, height);
         modelAffine = glm::translate(modelAffine, translation);
         camPosition.z = scrollFactor;
-        glm::mat4 view = glm::lookAt(
-            camPosition,
-            camLookAt,
-            glm::vec3(0.0f, 1.0f, 0.0f));
-
-        glm::mat4 mvp = projection * view * modelAffine * rotation;
-        renderSubroutine(mvp, modelAffine, view, projection, rotation);
+        Controls3d* orbit = static_cast<Controls3d*>(controls);
+        CameraPathSample sample = controlSample(scrollFactor, orbit->angle_x, orbit->angle_y);
+        recordSample(sample);
+        glm::mat4 model, view, projection, rotation;
+        viewMatrices(sample, &model, &view, &projection, &rotation);
+        glm::mat4 mvp = projection * view * model * rotation;
+        renderSubroutine(mvp, model, view, projection, rotation);
     } while ((glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
              glfwWindowShouldClose(window) == 0));
 
-    deinitialize();
+    endLoop();
 }
 #endif
@@ -9,30 +9,85 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "GLBoilerPlate.hpp"
 #include "Controls.hpp"
 #include "GLModel.hpp"
+#include "GLBatch.hpp"
+#include "BufferArena.hpp"
+#include "BufferLoader.hpp"
+#include "ReleaseQueue.hpp"
+#include "CommandQueue.hpp"
+#include "HeadlessContext.hpp"
+#include "FrameExport.hpp"
+#include "Timeline.hpp"
+#include "CameraPath.hpp"
+#include "FrameStats.hpp"
+#include "ShaderLibrary.hpp"
 #include "imgui/imgui.h"
 #include "imgui/backends/imgui_impl_glfw.h"
 #include "imgui/backends/imgui_impl_opengl3.h"
 
+// One immutable version of the layer set. Writers copy the current
+// snapshot, edit the copy and publish it; readers keep whichever snapshot
+// they loaded for as long as they need it.
+struct SceneSnapshot {
+    ModelMap models;
+    unsigned long version;
+};
+
+// Viewpoint for offscreen renders. Engine looks straight down at center,
+// scale world units per pixel; Engine3d orbits center at distance, turned
+// by yaw and pitch (radians), with a vertical field of view of fov degrees.
+struct Camera {
+    glm::vec3 center;
+    float scale;
+    float distance;
+    float yaw;
+    float pitch;
+    float fov;
+};
+
+// One image of an offscreen batch: a camera, optionally the ids of the
+// layers to draw, and where the RGBA pixels go (top row first).
+struct OffscreenView {
+    Camera camera;
+    bool filterLayers;
+    std::set<int> layers;
+    unsigned char* pixels;
+};
+
 class Engine {
  public:
-    std::string shaderPath;
-    std::map<int, GLModel*> *models;
+    // Published snapshot; only touched through std::atomic_load/store.
+    // addModel and removeModel may run on any thread and are serialized by
+    // sceneWriteMutex. The render loop reads frameScene, which it swaps
+    // for the published snapshot between frames.
+    std::shared_ptr<const SceneSnapshot> scene;
+    std::shared_ptr<const SceneSnapshot> frameScene;
+    std::mutex sceneWriteMutex;
+    std::vector<GLBatch*> batches;
+    BufferArena* arena;
+    // GL resources of removed layers and retired batches, freed once the
+    // frames that used them have finished on the GPU.
+    ReleaseQueue* releaseQueue;
     Controls *controls;
     GLFWwindow *window;
     GLBoilerPlate *bp;
 
     glm::mat4 modelAffine;
 
-    GLuint vertexShader;
-    GLuint fragmentShader;
-    GLuint shaderProgram;
+    // Programs belong to the current context; they are built again after
+    // switching between the window and offscreen rendering.
+    ShaderLibrary shaders;
     GLuint vertexArrayId;
-    GLint projectionMatrix;
     float mouseSpeed;
 
     float *bgcolor;
@@ -40,23 +95,204 @@ class Engine {
     int height;
 
     bool vertexArrayInitialized = false;
-    bool shaderInitialized = false;
+    std::atomic<bool> contextActive{false};
+    // With keepResident, closing the window only hides it: the context
+    // keeps the shaders, batches and layer buffers, and the next loop shows
+    // it again instead of creating a window and uploading every layer.
+    // Offscreen rendering uses its own context, so it frees a hidden window
+    // first.
+    bool keepResident = false;
+    bool windowResident = false;
+
+    // Layer changes from other threads are queued here and applied by the
+    // render loop between frames. While loopActive is false, submit() runs
+    // the queue on the caller's thread instead.
+    CommandQueue* commands;
+    std::atomic<bool> loopActive{false};
+    std::thread renderThread;
+    // Set while the loop runs; commands submitted from that thread run at
+    // once instead of waiting for a frame boundary it would never reach.
+    std::atomic<std::thread::id> loopThread{std::thread::id()};
     glm::vec3 picking_point;
 
+    // Runs of consecutive static layers of one draw type, each up to
+    // batchMaxVertices, are packed and drawn with glMultiDrawArrays, in
+    // id order; batches are rebuilt when layers change.
+    bool batchingEnabled = true;
+    int batchMaxVertices = 65536;
+    bool batchesDirty = true;
+
+    // Bytes of arena data compaction may move per frame.
+    GLsizeiptr compactBudget = 8 << 20;
+
+    // In the window, layers of at least backgroundUploadBytes go to the GPU
+    // on the loader thread and are drawn once their buffers are complete;
+    // the rest upload on first draw as before. Zero turns the loader off.
+    // Offscreen rendering always uploads on the render thread.
+    BufferLoader* loader = nullptr;
+    size_t backgroundUploadBytes = 16 << 20;
+
+    // Frames are only drawn when input arrived, layers changed or an
+    // animation is due; otherwise the loop sleeps in glfwWaitEventsTimeout.
+    // continuousRendering restores the old draw-every-iteration loop.
+    bool continuousRendering = false;
+    int framesPending = 0;
+    std::atomic<bool> redrawRequested{false};
+    // ImGui needs a few frames to settle hover and widget state after input.
+    int settleFrames = 3;
+    double maxIdleWait = 1.0;
+    unsigned long seenInputEvents = 0;
+    bool compactionActive = false;
+
+    // Zero means unlimited. The hook fires once each time the layers' CPU
+    // bytes or the arena's reserved GPU bytes go over budget; without one a
+    // warning is printed.
+    size_t cpuBudget = 0;
+    size_t gpuBudget = 0;
+    std::function<void(size_t, size_t)> budgetHook;
+    bool overBudget = false;
+    bool memoryDirty = false;
+    // The hook may call back into the engine, so a crossing is only
+    // recorded by checkMemoryBudget and the hook runs from notifyBudget,
+    // once no command or offscreen frame holds the engine's locks.
+    std::mutex budgetMutex;
+    std::function<void()> budgetNotice;
+
+    // Offscreen rendering keeps its context between calls so batches of
+    // images don't pay for context and buffer setup each time. Layer
+    // buffers belong to one context at a time, so it is only available
+    // while no window is open; opening one tears it down first.
+    HeadlessContext* headless = nullptr;
+    std::mutex offscreenMutex;
+
+    // One clock for every animated layer; see Timeline.
+    Timeline timeline;
+
+    // While recording, every interactive frame appends its control state
+    // to cameraRecording; replayCameraPath draws such a path offscreen.
+    bool recording = false;
+    double recordingStart = 0.0;
+    CameraPath cameraRecording;
+
+    // Counters of the frames drawn in the window or replayed offscreen,
+    // shown in the control panel; readable from any thread.
+    FrameStats frameStats;
+
+    // Picking uses the depth under the cursor from the previous frame,
+    // read back through a pixel pack buffer once the layers are drawn, so
+    // it never waits for the GPU. Only the depth lags; the cursor is
+    // current.
+    GLuint depthReadback = 0;
+    GLsync depthFence = nullptr;
+    float lastCursorDepth = 1.0f;
 
-    explicit Engine(std::string shaderPath);
-    ~Engine();
+    Engine();
+    virtual ~Engine();
     virtual void initControls();
     void initialize();
     void deinitialize();
+    void suspendWindow();
+    void resumeWindow();
+    // Frees a hidden window; the loop must not be running.
+    void releaseWindow();
+    void setKeepResident(bool enabled);
+    void setBackgroundUploads(size_t minBytes);
+    void initializeGL(GLADloadfunc load);
+    void deinitializeGL();
+    bool initializeHeadless();
+    void closeHeadless();
+    Camera fitCamera(int width, int height);
+    virtual glm::mat4 cameraMatrix(const Camera& camera, int width, int height);
+    // Offscreen passes run with offscreenMutex held: beginOffscreen makes
+    // the context current and picks up the scene, drawOffscreen draws one
+    // image into the framebuffer, endOffscreen releases the context.
+    bool beginOffscreen(int width, int height);
+    void drawOffscreen(const Camera& camera, const std::set<int>* layers);
+    void endOffscreen();
+    bool renderOffscreen(int width, int height, std::vector<OffscreenView>* views);
+    // Renders frames images offscreen, moving the timeline a fixed amount
+    // per frame rather than by wall-clock time, and streams them to path in
+    // the given FrameFormat. frames <= 0 exports one pass of the timeline.
+    bool exportFrames(
+        const std::string& path,
+        int format,
+        int width,
+        int height,
+        long frames,
+        int fps,
+        const Camera& camera,
+        int threads,
+        FrameExportStats* stats);
+    // Model, view, projection and rotation matrices for one control state,
+    // as the render loop builds them.
+    virtual void viewMatrices(
+        const CameraPathSample& sample,
+        glm::mat4* model,
+        glm::mat4* view,
+        glm::mat4* projection,
+        glm::mat4* rotation);
+    // A path of frames samples at fps that pans, zooms, turns and sweeps
+    // the cursor across the layers' bounds.
+    virtual CameraPath syntheticCameraPath(int width, int height, long frames, double fps);
+    CameraPathSample controlSample(double zoom, double angleX, double angleY);
+    void recordSample(const CameraPathSample& sample);
+    // Draws every sample offscreen as fast as it can, with hover picking at
+    // the recorded cursor and the timeline following the recorded times,
+    // and reports per-frame phase times and draw calls.
+    bool replayCameraPath(const CameraPath& path, ReplayReport* report);
+    // Nearest pickable point under the cursor over every picking-enabled
+    // layer, which also becomes picking_point; select queries one layer.
+    GLModel* pickNearest(
+        const ModelMap* models,
+        std::function<std::tuple<int, glm::vec3, float>(GLModel*, const std::function<bool(int)>*)> select,
+        int* index);
+    // One window frame: update, pick, draw, UI and present, with a single
+    // buffer swap at the end.
     void renderSubroutine(
         glm::mat4 modelViewProjection,
         glm::mat4 model, glm::mat4 view,
         glm::mat4 projection,
         glm::mat4 rotation
     );
+    void updateFrame();
+    void updateUploads();
+    GLModel* pickFrame(glm::mat4 model, glm::mat4 view, glm::mat4 projection, glm::mat4 rotation, int* index);
+    void drawFrame(glm::mat4 modelViewProjection);
+    void drawUI(GLModel* picked, int index);
+    // input is Controls::takeInput() from the start of the frame.
+    void presentFrame(long long input);
+    // Starts reading back the depth at framebuffer pixel (x, y).
+    void readCursorDepth(int x, int y);
+    // The most recent depth the GPU has delivered, 1 (far) before any.
+    float cursorDepth();
+    void releaseCursorDepth();
     virtual void animate();
-    bool addModel(int id, GLModel* model);
+    void renderStatsUI();
+    // Runs animate() on a render thread that owns the window and context.
+    bool start();
+    void join();
+    void close();
+    CommandFuture submit(std::function<bool()> command);
+    void beginLoop();
+    void endLoop();
+    void requestRedraw();
+    std::shared_ptr<const SceneSnapshot> sceneSnapshot();
+    bool acquireScene();
+    void setContinuousRendering(bool enabled);
+    void updateTimeline(double now, bool advance);
+    void updateTimelineExtent(const ModelMap& models);
+    double nextFrameDelay();
+    void waitForEvents();
+    bool frameRequested();
+    void rebuildBatches();
+    void clearBatches();
+    void setBatching(bool enabled, int maxVertices);
+    BufferArenaStats bufferStats();
+    std::map<int, LayerMemoryStats> memoryStats();
+    void setMemoryBudget(size_t cpuBytes, size_t gpuBytes, std::function<void(size_t, size_t)> hook);
+    void checkMemoryBudget();
+    void notifyBudget();
+    bool addModel(int id, std::shared_ptr<GLModel> model);
     bool removeModel(int id);
     bool modelExists(int id);
     int numModels();
@@ -67,17 +303,25 @@ class Engine3d: public Engine {
     glm::vec3 camPosition;
     glm::vec3 camLookAt;
 
-    explicit Engine3d(std::string shaderPath);
+    Engine3d();
     void initControls() override;
+    glm::mat4 cameraMatrix(const Camera& camera, int width, int height) override;
+    void viewMatrices(
+        const CameraPathSample& sample,
+        glm::mat4* model,
+        glm::mat4* view,
+        glm::mat4* projection,
+        glm::mat4* rotation) override;
+    CameraPath syntheticCameraPath(int width, int height, long frames, double fps) override;
     void animate() override;
 };
 
-static Engine* create2dWorld(std::string shaderPath) {
-    return new Engine(shaderPath);
+static Engine* create2dWorld() {
+    return new Engine();
 }
 
-static Engine3d* create3dWorld(std::string shaderPath) {
-    return new Engine3d(shaderPath);
+static Engine3d* create3dWorld() {
+    return new Engine3d();
 }
 
 
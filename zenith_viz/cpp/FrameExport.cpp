@@ -0,0 +1,329 @@
+#ifndef ZENITH_CPP_FRAMEEXPORT_CPP_
+#define ZENITH_CPP_FRAMEEXPORT_CPP_
+
+#include "FrameExport.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+static uint32_t crcTable[256];
+static std::once_flag crcTableOnce;
+
+static uint32_t crc32(const unsigned char* data, size_t length, uint32_t crc = 0) {
+    std::call_once(crcTableOnce, []() {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            crcTable[n] = c;
+        }
+    });
+    crc = crc ^ 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) {
+        crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static void appendBigEndian(std::vector<unsigned char>* out, uint32_t value) {
+    out->push_back((unsigned char) (value >> 24));
+    out->push_back((unsigned char) (value >> 16));
+    out->push_back((unsigned char) (value >> 8));
+    out->push_back((unsigned char) value);
+}
+
+static void appendChunk(std::vector<unsigned char>* out, const char* tag, const unsigned char* data, size_t length) {
+    appendBigEndian(out, (uint32_t) length);
+    size_t start = out->size();
+    out->insert(out->end(), tag, tag + 4);
+    if (length > 0)
+        out->insert(out->end(), data, data + length);
+    appendBigEndian(out, crc32(out->data() + start, length + 4));
+}
+
+void encodePng(std::vector<unsigned char>* out, const unsigned char* rgba, int width, int height) {
+    static const unsigned char signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    out->insert(out->end(), signature, signature + 8);
+
+    std::vector<unsigned char> header;
+    appendBigEndian(&header, (uint32_t) width);
+    appendBigEndian(&header, (uint32_t) height);
+    const unsigned char format[] = {8, 6, 0, 0, 0};  // 8 bit RGBA, no interlace
+    header.insert(header.end(), format, format + 5);
+    appendChunk(out, "IHDR", header.data(), header.size());
+
+    // Scanlines with filter type 0, wrapped in stored deflate blocks.
+    size_t rowBytes = 4 * (size_t) width;
+    size_t rawBytes = (rowBytes + 1) * height;
+    const size_t maxBlock = 65535;
+    size_t blocks = std::max<size_t>(1, (rawBytes + maxBlock - 1) / maxBlock);
+    std::vector<unsigned char> zlib;
+    zlib.reserve(2 + rawBytes + 5 * blocks + 4);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+    size_t row = 0;
+    size_t column = 0;  // 0 is the filter byte, 1.. the pixel bytes
+    size_t done = 0;
+    do {
+        size_t length = std::min(maxBlock, rawBytes - done);
+        zlib.push_back(done + length == rawBytes ? 1 : 0);
+        zlib.push_back((unsigned char) (length & 0xFF));
+        zlib.push_back((unsigned char) (length >> 8));
+        zlib.push_back((unsigned char) (~length & 0xFF));
+        zlib.push_back((unsigned char) ((~length >> 8) & 0xFF));
+        for (size_t i = 0; i < length; i++) {
+            unsigned char byte = column == 0 ? 0 : rgba[row * rowBytes + column - 1];
+            if (++column > rowBytes) {
+                column = 0;
+                row++;
+            }
+            zlib.push_back(byte);
+            adlerA = (adlerA + byte) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+        done += length;
+    } while (done < rawBytes);
+    appendBigEndian(&zlib, (adlerB << 16) | adlerA);
+    appendChunk(out, "IDAT", zlib.data(), zlib.size());
+    appendChunk(out, "IEND", nullptr, 0);
+}
+
+void encodeY4mFrame(std::vector<unsigned char>* out, const unsigned char* rgba, int width, int height) {
+    static const char marker[] = "FRAME\n";
+    out->insert(out->end(), marker, marker + 6);
+    int chromaWidth = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    size_t lumaStart = out->size();
+    size_t uStart = lumaStart + (size_t) width * height;
+    size_t vStart = uStart + (size_t) chromaWidth * chromaHeight;
+    out->resize(vStart + (size_t) chromaWidth * chromaHeight);
+    unsigned char* luma = out->data() + lumaStart;
+    unsigned char* u = out->data() + uStart;
+    unsigned char* v = out->data() + vStart;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const unsigned char* p = rgba + 4 * ((size_t) y * width + x);
+            luma[(size_t) y * width + x] = (unsigned char) (((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16);
+        }
+    }
+    // Chroma from the average of each 2x2 block.
+    for (int cy = 0; cy < chromaHeight; cy++) {
+        for (int cx = 0; cx < chromaWidth; cx++) {
+            int r = 0, g = 0, b = 0, n = 0;
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    int x = 2 * cx + dx;
+                    int y = 2 * cy + dy;
+                    if (x >= width || y >= height)
+                        continue;
+                    const unsigned char* p = rgba + 4 * ((size_t) y * width + x);
+                    r += p[0];
+                    g += p[1];
+                    b += p[2];
+                    n++;
+                }
+            }
+            r /= n;
+            g /= n;
+            b /= n;
+            u[(size_t) cy * chromaWidth + cx] = (unsigned char) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            v[(size_t) cy * chromaWidth + cx] = (unsigned char) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+}
+
+// Substitutes the frame index for the first %d (optionally zero padded,
+// e.g. %05d) in pattern, or appends _000042 before the extension when
+// there is none. The pattern never reaches printf.
+static std::string frameFileName(const std::string& pattern, long index) {
+    size_t percent = pattern.find('%');
+    while (percent != std::string::npos) {
+        size_t end = percent + 1;
+        while (end < pattern.size() && isdigit((unsigned char) pattern[end])) {
+            end++;
+        }
+        if (end < pattern.size() && pattern[end] == 'd') {
+            int padding = end > percent + 1 ? atoi(pattern.substr(percent + 1, end - percent - 1).c_str()) : 0;
+            std::string number = std::to_string(index);
+            if ((int) number.size() < padding)
+                number = std::string(padding - number.size(), '0') + number;
+            return pattern.substr(0, percent) + number + pattern.substr(end + 1);
+        }
+        percent = pattern.find('%', percent + 1);
+    }
+    std::string number = std::to_string(index);
+    number = std::string(number.size() < 6 ? 6 - number.size() : 0, '0') + number;
+    size_t dot = pattern.find_last_of('.');
+    size_t slash = pattern.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return pattern + "_" + number;
+    return pattern.substr(0, dot) + "_" + number + pattern.substr(dot);
+}
+
+FrameEncoder::FrameEncoder(std::string path, int format, int width, int height, int fps, int threads) {
+    this->path = path;
+    this->format = format;
+    this->width = width;
+    this->height = height;
+    this->fps = fps > 0 ? fps : 30;
+    this->bytesWritten = 0;
+    this->failed = false;
+    this->stream = nullptr;
+    this->nextToWrite = 0;
+    this->closing = false;
+    int count = threads > 0 ? threads : static_cast<int>(std::thread::hardware_concurrency());
+    count = std::max(1, count);
+    this->maxQueued = 2 * (size_t) count;
+    for (int i = 0; i < count; i++) {
+        workers.emplace_back([this]() { work(); });
+    }
+}
+
+FrameEncoder::~FrameEncoder() {
+    finish();
+}
+
+bool FrameEncoder::open() {
+    if (format == FRAME_FORMAT_PNG)
+        return true;
+    stream = std::fopen(path.c_str(), "wb");
+    if (stream == nullptr) {
+        printf("zenith: could not open %s for writing\n", path.c_str());
+        failed = true;
+        return false;
+    }
+    if (format == FRAME_FORMAT_Y4M) {
+        std::string header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height)
+            + " F" + std::to_string(fps) + ":1 Ip A1:1 C420jpeg\n";
+        bytesWritten += std::fwrite(header.data(), 1, header.size(), stream);
+    }
+    return true;
+}
+
+std::vector<unsigned char> FrameEncoder::recycle() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spare.empty())
+        return std::vector<unsigned char>();
+    std::vector<unsigned char> buffer = std::move(spare.back());
+    spare.pop_back();
+    return buffer;
+}
+
+void FrameEncoder::submit(long index, std::vector<unsigned char> rgba) {
+    std::unique_lock<std::mutex> lock(mutex);
+    jobTaken.wait(lock, [this]() { return jobs.size() < maxQueued; });
+    Job job;
+    job.index = index;
+    job.rgba = std::move(rgba);
+    jobs.push_back(std::move(job));
+    jobReady.notify_one();
+}
+
+bool FrameEncoder::finish() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    jobReady.notify_all();
+    for (auto && worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    if (stream != nullptr) {
+        if (std::fclose(stream) != 0)
+            failed = true;
+        stream = nullptr;
+    }
+    return !failed;
+}
+
+void FrameEncoder::work() {
+    std::vector<unsigned char> bytes;
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobReady.wait(lock, [this]() { return closing || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        jobTaken.notify_one();
+
+        if (format == FRAME_FORMAT_RAW) {
+            writeInOrder(job.index, std::move(job.rgba));
+            continue;
+        }
+        bytes.clear();
+        if (format == FRAME_FORMAT_Y4M) {
+            encodeY4mFrame(&bytes, job.rgba.data(), width, height);
+        } else {
+            encodePng(&bytes, job.rgba.data(), width, height);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            spare.push_back(std::move(job.rgba));
+        }
+        if (format == FRAME_FORMAT_PNG) {
+            if (!writeFile(job.index, bytes)) {
+                std::lock_guard<std::mutex> lock(writeMutex);
+                failed = true;
+            }
+        } else {
+            writeInOrder(job.index, std::move(bytes));
+            bytes = std::vector<unsigned char>();
+        }
+    }
+}
+
+bool FrameEncoder::writeFile(long index, const std::vector<unsigned char>& bytes) {
+    std::string name = frameFileName(path, index);
+    std::FILE* file = std::fopen(name.c_str(), "wb");
+    if (file == nullptr) {
+        printf("zenith: could not open %s for writing\n", name.c_str());
+        return false;
+    }
+    size_t written = std::fwrite(bytes.data(), 1, bytes.size(), file);
+    bool ok = std::fclose(file) == 0 && written == bytes.size();
+    std::lock_guard<std::mutex> lock(writeMutex);
+    bytesWritten += written;
+    return ok;
+}
+
+void FrameEncoder::writeInOrder(long index, std::vector<unsigned char> bytes) {
+    std::vector<std::vector<unsigned char>> written;
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        encoded[index] = std::move(bytes);
+        while (!encoded.empty() && encoded.begin()->first == nextToWrite) {
+            std::vector<unsigned char>& next = encoded.begin()->second;
+            if (stream != nullptr) {
+                size_t count = std::fwrite(next.data(), 1, next.size(), stream);
+                bytesWritten += count;
+                if (count != next.size())
+                    failed = true;
+            }
+            if (format == FRAME_FORMAT_RAW)
+                written.push_back(std::move(next));
+            encoded.erase(encoded.begin());
+            nextToWrite++;
+        }
+    }
+    if (!written.empty()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto && buffer : written) {
+            spare.push_back(std::move(buffer));
+        }
+    }
+}
+
+#endif
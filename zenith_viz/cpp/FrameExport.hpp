@@ -0,0 +1,86 @@
+#ifndef ZENITH_CPP_FRAMEEXPORT_HPP_
+#define ZENITH_CPP_FRAMEEXPORT_HPP_
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum FrameFormat {
+    FRAME_FORMAT_RAW = 0,
+    FRAME_FORMAT_Y4M = 1,
+    FRAME_FORMAT_PNG = 2
+};
+
+struct FrameExportStats {
+    long frames;
+    double seconds;
+    double fps;
+    size_t bytesWritten;
+};
+
+// Appends a PNG of an RGBA image (top row first) to out. The image data is
+// stored in uncompressed deflate blocks, which keeps the encoder
+// dependency-free and fast; use Y4M when file size matters.
+void encodePng(std::vector<unsigned char>* out, const unsigned char* rgba, int width, int height);
+
+// Appends one Y4M frame (BT.601 studio range, 4:2:0) of an RGBA image.
+void encodeY4mFrame(std::vector<unsigned char>* out, const unsigned char* rgba, int width, int height);
+
+// Turns captured RGBA frames into files on a pool of worker threads.
+// RAW and Y4M frames are encoded in parallel and appended to one stream in
+// frame order; PNG frames go to separate files named by formatting path
+// with the frame index (e.g. "frames/%05d.png").
+//
+// submit() blocks once a bounded number of frames are waiting, so capture
+// can't run ahead of the encoders by more than a few frames of memory.
+// Frame buffers are handed back through recycle() to avoid reallocating
+// width * height * 4 bytes per frame.
+class FrameEncoder {
+ public:
+    std::string path;
+    int format;
+    int width;
+    int height;
+    int fps;
+    size_t maxQueued;
+    size_t bytesWritten;
+    bool failed;
+
+    FrameEncoder(std::string path, int format, int width, int height, int fps, int threads);
+    ~FrameEncoder();
+    // Opens the output stream (and writes the Y4M header).
+    bool open();
+    std::vector<unsigned char> recycle();
+    void submit(long index, std::vector<unsigned char> rgba);
+    // Waits for every submitted frame to be written and closes the stream.
+    bool finish();
+
+ private:
+    struct Job {
+        long index;
+        std::vector<unsigned char> rgba;
+    };
+
+    std::FILE* stream;
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    std::vector<std::vector<unsigned char>> spare;
+    std::map<long, std::vector<unsigned char>> encoded;
+    long nextToWrite;
+    bool closing;
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    std::condition_variable jobTaken;
+    std::mutex writeMutex;
+
+    void work();
+    bool writeFile(long index, const std::vector<unsigned char>& bytes);
+    void writeInOrder(long index, std::vector<unsigned char> bytes);
+};
+
+#endif  // ZENITH_CPP_FRAMEEXPORT_HPP_
@@ -0,0 +1,190 @@
+#ifndef ZENITH_CPP_FRAMESTATS_CPP_
+#define ZENITH_CPP_FRAMESTATS_CPP_
+
+#include "FrameStats.hpp"
+#include <algorithm>
+#include "Tracing.hpp"
+
+unsigned long RenderCounters::drawCalls = 0;
+unsigned long RenderCounters::vertices = 0;
+unsigned long RenderCounters::culledVertices = 0;
+unsigned long RenderCounters::uploadBytes = 0;
+
+// Beyond this many queries in flight the GPU is falling behind; frames go
+// untimed until it catches up rather than piling up more queries.
+static const size_t MAX_PENDING_QUERIES = 1024;
+
+static FrameSample counterTotals() {
+    FrameSample totals = FrameSample();
+    totals.drawCalls = RenderCounters::drawCalls;
+    totals.vertices = RenderCounters::vertices;
+    totals.culledVertices = RenderCounters::culledVertices;
+    totals.uploadBytes = RenderCounters::uploadBytes;
+    return totals;
+}
+
+static const char* FRAME_PHASE_NAMES[FRAME_PHASES] = {"update", "pick", "draw", "ui", "present"};
+
+const char* framePhaseName(int phase) {
+    return FRAME_PHASE_NAMES[phase];
+}
+
+// Per-frame values are kept in rings that grow to FrameStats::HISTORY and
+// then overwrite the oldest.
+static void pushRing(std::vector<double>* ring, size_t* next, double value) {
+    if (ring->size() < FrameStats::HISTORY) {
+        ring->push_back(value);
+    } else {
+        (*ring)[*next] = value;
+    }
+    *next = (*next + 1) % FrameStats::HISTORY;
+}
+
+static void copyRing(const std::vector<double>& ring, size_t next, std::vector<double>* ordered) {
+    ordered->clear();
+    if (ring.size() < FrameStats::HISTORY) {
+        *ordered = ring;
+    } else {
+        ordered->insert(ordered->end(), ring.begin() + next, ring.end());
+        ordered->insert(ordered->end(), ring.begin(), ring.begin() + next);
+    }
+}
+
+FrameStats::FrameStats() {
+    frameOpen = false;
+    gpuOpen = false;
+    frame = 0;
+    frameQueries = 0;
+    frameStart = 0;
+    phase = PHASE_UPDATE;
+    phaseStart = 0;
+    current = FrameSample();
+    totalsAtStart = FrameSample();
+    historyNext = 0;
+    latencyNext = 0;
+    collectingFrame = 0;
+    front = 0;
+    snapshots[0] = FrameStatsSnapshot();
+    snapshots[1] = FrameStatsSnapshot();
+}
+
+void FrameStats::beginFrame() {
+    frameOpen = true;
+    frameQueries = 0;
+    frameStart = steadyNanoseconds();
+    phase = PHASE_UPDATE;
+    phaseStart = frameStart;
+    current = FrameSample();
+    current.inputLatency = -1.0;
+    totalsAtStart = counterTotals();
+}
+
+void FrameStats::beginGpu(const std::string& name) {
+    if (!frameOpen || gpuOpen || pending.size() >= MAX_PENDING_QUERIES)
+        return;
+    GLuint query;
+    if (freeQueries.empty()) {
+        glGenQueries(1, &query);
+    } else {
+        query = freeQueries.back();
+        freeQueries.pop_back();
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    gpuOpen = true;
+    frameQueries++;
+    pending.push_back({query, name, frame, steadyNanoseconds()});
+}
+
+void FrameStats::endGpu() {
+    if (!gpuOpen)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    gpuOpen = false;
+}
+
+void FrameStats::beginPhase(FramePhase next) {
+    if (!frameOpen)
+        return;
+    long long now = steadyNanoseconds();
+    current.phaseSeconds[phase] += (now - phaseStart) * 1e-9;
+    phase = next;
+    phaseStart = now;
+}
+
+void FrameStats::setInputLatency(double seconds) {
+    current.inputLatency = seconds;
+}
+
+void FrameStats::endFrame() {
+    if (!frameOpen)
+        return;
+    long long now = steadyNanoseconds();
+    FrameSample totals = counterTotals();
+    current.drawCalls = totals.drawCalls - totalsAtStart.drawCalls;
+    current.vertices = totals.vertices - totalsAtStart.vertices;
+    current.culledVertices = totals.culledVertices - totalsAtStart.culledVertices;
+    current.uploadBytes = totals.uploadBytes - totalsAtStart.uploadBytes;
+    current.seconds = (now - frameStart) * 1e-9;
+    current.phaseSeconds[phase] += (now - phaseStart) * 1e-9;
+    frameOpen = false;
+
+    pushRing(&history, &historyNext, current.seconds);
+    if (current.inputLatency >= 0.0)
+        pushRing(&latencies, &latencyNext, current.inputLatency);
+    frame++;
+    // Nothing drawn, nothing to time.
+    if (frameQueries == 0 && pending.empty())
+        gpuLatest.clear();
+    collectGpu(false);
+
+    // Readers only touch the front snapshot, and only under the mutex.
+    FrameStatsSnapshot& back = snapshots[1 - front];
+    back.frames = frame;
+    back.last = current;
+    copyRing(history, historyNext, &back.history);
+    copyRing(latencies, latencyNext, &back.inputLatencies);
+    back.gpu = gpuLatest;
+    std::lock_guard<std::mutex> lock(mutex);
+    front = 1 - front;
+}
+
+void FrameStats::collectGpu(bool wait) {
+    while (!pending.empty()) {
+        PendingQuery& query = pending.front();
+        if (!wait) {
+            GLint available = 0;
+            glGetQueryObjectiv(query.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            // Queries finish in submission order.
+            if (!available)
+                break;
+        }
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query.query, GL_QUERY_RESULT, &elapsed);
+        ZENITH_TRACE_GPU(query.name.c_str(), query.submitted, (long long) elapsed);
+        if (query.frame != collectingFrame) {
+            collecting.clear();
+            collectingFrame = query.frame;
+        }
+        collecting.push_back({query.name, elapsed * 1e-9});
+        freeQueries.push_back(query.query);
+        pending.pop_front();
+        bool frameDone = pending.empty() ? collectingFrame < frame : pending.front().frame != collectingFrame;
+        if (frameDone)
+            gpuLatest = collecting;
+    }
+}
+
+void FrameStats::releaseGpu() {
+    endGpu();
+    collectGpu(true);
+    if (!freeQueries.empty())
+        glDeleteQueries((GLsizei) freeQueries.size(), freeQueries.data());
+    freeQueries.clear();
+}
+
+FrameStatsSnapshot FrameStats::snapshot() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return snapshots[front];
+}
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef ZENITH_CPP_FRAMESTATS_HPP_
+#define ZENITH_CPP_FRAMESTATS_HPP_
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "glad/gl.h"
+
+// Running totals of the work the renderer hands to GL, bumped where it
+// happens. Only the thread that owns the context draws, so they are plain
+// counters; FrameStats turns them into per-frame numbers.
+struct RenderCounters {
+    static unsigned long drawCalls;
+    static unsigned long vertices;
+    // Vertices of drawn layers left out: outside the time windows, or in
+    // layers filtered out of an offscreen view.
+    static unsigned long culledVertices;
+    // Bytes copied into buffers and textures.
+    static unsigned long uploadBytes;
+};
+
+// The parts of a frame, in the order the window runs them.
+enum FramePhase {
+    PHASE_UPDATE,
+    PHASE_PICK,
+    PHASE_DRAW,
+    PHASE_UI,
+    PHASE_PRESENT,
+    FRAME_PHASES
+};
+
+const char* framePhaseName(int phase);
+
+struct FrameSample {
+    // From beginFrame to endFrame, including any wait in the buffer swap.
+    // The loop idles between frames when nothing changes, so this is not
+    // the interval between frames.
+    double seconds;
+    double phaseSeconds[FRAME_PHASES];
+    // From the oldest input event the frame handled until its swap
+    // returned; negative when it handled none.
+    double inputLatency;
+    unsigned long drawCalls;
+    unsigned long vertices;
+    unsigned long culledVertices;
+    unsigned long uploadBytes;
+};
+
+// GPU time of a layer's draws, or of a batch's single multi-draw.
+struct LayerGpuTime {
+    std::string name;
+    double seconds;
+};
+
+struct FrameStatsSnapshot {
+    unsigned long frames;
+    FrameSample last;
+    // The frame times of up to FrameStats::HISTORY recent frames, oldest
+    // first.
+    std::vector<double> history;
+    // The input latencies of up to FrameStats::HISTORY recent frames that
+    // handled input, oldest first.
+    std::vector<double> inputLatencies;
+    // GPU times of the latest frame whose queries have all completed,
+    // usually one or two frames behind.
+    std::vector<LayerGpuTime> gpu;
+};
+
+// Statistics of the frames drawn on the render thread, published once a
+// frame into one of two snapshots while readers copy the other, so
+// reading them never waits on rendering and rendering waits at most for a
+// copy. GPU times come from GL_TIME_ELAPSED queries around each layer,
+// read back without stalling once the results arrive.
+class FrameStats {
+ public:
+    static const size_t HISTORY = 240;
+
+    FrameStats();
+    // Render thread, with the context current.
+    // Starts the frame in PHASE_UPDATE.
+    void beginFrame();
+    // Ends the current phase and starts the next; a phase entered more than
+    // once adds up. endFrame ends the last one.
+    void beginPhase(FramePhase phase);
+    // Times the GL commands until endGpu on the GPU. Ignored outside a
+    // frame and while a query is open (GL can't nest them).
+    void beginGpu(const std::string& name);
+    void endGpu();
+    void setInputLatency(double seconds);
+    void endFrame();
+    // Waits for the outstanding queries and frees them; call before the
+    // context is destroyed or released to another thread.
+    void releaseGpu();
+
+    // Any thread.
+    FrameStatsSnapshot snapshot();
+
+ private:
+    struct PendingQuery {
+        GLuint query;
+        std::string name;
+        unsigned long frame;
+        long long submitted;
+    };
+
+    // Render thread only.
+    bool frameOpen;
+    bool gpuOpen;
+    unsigned long frame;
+    int frameQueries;
+    long long frameStart;
+    FramePhase phase;
+    long long phaseStart;
+    FrameSample current;
+    FrameSample totalsAtStart;
+    std::vector<double> history;
+    size_t historyNext;
+    std::vector<double> latencies;
+    size_t latencyNext;
+    std::vector<GLuint> freeQueries;
+    std::deque<PendingQuery> pending;
+    unsigned long collectingFrame;
+    std::vector<LayerGpuTime> collecting;
+    std::vector<LayerGpuTime> gpuLatest;
+
+    std::mutex mutex;
+    FrameStatsSnapshot snapshots[2];
+    int front;
+
+    void collectGpu(bool wait);
+};
+
+#endif  // ZENITH_CPP_FRAMESTATS_HPP_
@@ -0,0 +1,170 @@
+#ifndef ZENITH_CPP_GLBATCH_CPP_
+#define ZENITH_CPP_GLBATCH_CPP_
+
+#include "GLBatch.hpp"
+#include <set>
+#include <vector>
+#include "glad/gl.h"
+
+GLBatch::GLBatch(GLuint drawType, BufferArena* arena) {
+    this->drawType = drawType;
+    this->arena = arena;
+    this->numVertices = 0;
+    this->useColorData = false;
+    this->bufferInitialized = false;
+    this->vertexAllocation = -1;
+    this->colorAllocation = -1;
+    this->slotAllocation = -1;
+    this->layerTable = 0;
+}
+
+GLBatch::~GLBatch() {
+    if (bufferInitialized) {
+        arena->release(vertexAllocation);
+        arena->release(colorAllocation);
+        arena->release(slotAllocation);
+        glDeleteTextures(1, &layerTable);
+    }
+}
+
+void GLBatch::addMember(GLModel* model) {
+    firsts.push_back(numVertices);
+    counts.push_back(model->numVertices);
+    numVertices += model->numVertices;
+    useColorData = useColorData || model->useColorData;
+    name += (members.empty() ? "batch: " : ", ") + model->name;
+    members.push_back(model);
+    model->batched = true;
+}
+
+void GLBatch::detachMembers() {
+    for (auto && model : members) {
+        model->batched = false;
+    }
+    members.clear();
+}
+
+void GLBatch::initBuffer() {
+    GLsizeiptr vertexBytes = sizeof(float) * 3 * (GLsizeiptr) numVertices;
+
+    vertexAllocation = arena->allocate(vertexBytes, nullptr);
+    for (size_t i = 0; i < members.size(); i++) {
+        arena->update(
+            vertexAllocation,
+            sizeof(float) * 3 * (GLintptr) firsts[i],
+            sizeof(float) * 3 * (GLsizeiptr) counts[i],
+            members[i]->vertexData);
+    }
+
+    if (useColorData) {
+        colorAllocation = arena->allocate(vertexBytes, nullptr);
+        for (size_t i = 0; i < members.size(); i++) {
+            if (!members[i]->useColorData)
+                continue;
+            arena->update(
+                colorAllocation,
+                sizeof(float) * 3 * (GLintptr) firsts[i],
+                sizeof(float) * 3 * (GLsizeiptr) counts[i],
+                members[i]->colorData);
+        }
+    }
+
+    std::vector<float> slots(numVertices);
+    for (size_t i = 0; i < members.size(); i++) {
+        for (int v = 0; v < counts[i]; v++) {
+            slots[firsts[i] + v] = (float) i;
+        }
+    }
+    slotAllocation = arena->allocate(sizeof(float) * slots.size(), slots.data());
+
+    layerTableData.assign(members.size() * 8, 0.0f);
+    glGenTextures(1, &layerTable);
+    glBindTexture(GL_TEXTURE_2D, layerTable);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, (GLsizei) members.size(), 2, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    bufferInitialized = true;
+}
+
+void GLBatch::updateLayerTable() {
+    size_t width = members.size();
+    for (size_t i = 0; i < width; i++) {
+        GLModel* model = members[i];
+        for (int c = 0; c < 4; c++) {
+            layerTableData[i * 4 + c] = model->color[c];
+        }
+        float* params = &layerTableData[(width + i) * 4];
+        params[0] = model->size;
+        params[1] = model->useColorData ? 1.0f : 0.0f;
+    }
+    glBindTexture(GL_TEXTURE_2D, layerTable);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, (GLsizei) width, 2, GL_RGBA, GL_FLOAT, layerTableData.data());
+    RenderCounters::uploadBytes += sizeof(float) * layerTableData.size();
+}
+
+unsigned int GLBatch::shaderFeatures() {
+    unsigned int features = SHADER_LAYER_TABLE | (drawType == GL_POINTS ? SHADER_POINTS : 0);
+    for (auto && model : members) {
+        if (model->pickingEnabled)
+            features |= SHADER_PICKING;
+    }
+    return features;
+}
+
+void GLBatch::render(const std::set<int>* visible) {
+    if (!bufferInitialized)
+        initBuffer();
+
+    glActiveTexture(GL_TEXTURE0 + LAYER_TABLE_UNIT);
+    updateLayerTable();
+
+    BufferSlice vertices = arena->slice(vertexAllocation);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, vertices.buffer);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const void*) vertices.offset);
+
+    if (useColorData) {
+        BufferSlice colors = arena->slice(colorAllocation);
+        glEnableVertexAttribArray(1);
+        glBindBuffer(GL_ARRAY_BUFFER, colors.buffer);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (const void*) colors.offset);
+    }
+
+    BufferSlice slots = arena->slice(slotAllocation);
+    glEnableVertexAttribArray(2);
+    glBindBuffer(GL_ARRAY_BUFFER, slots.buffer);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, (const void*) slots.offset);
+
+    if (visible == nullptr) {
+        glMultiDrawArrays(drawType, firsts.data(), counts.data(), (GLsizei) firsts.size());
+        RenderCounters::drawCalls++;
+        RenderCounters::vertices += numVertices;
+    } else {
+        std::vector<GLint> visibleFirsts;
+        std::vector<GLsizei> visibleCounts;
+        for (size_t i = 0; i < members.size(); i++) {
+            if (visible->count(members[i]->id) == 0) {
+                RenderCounters::culledVertices += counts[i];
+                continue;
+            }
+            visibleFirsts.push_back(firsts[i]);
+            visibleCounts.push_back(counts[i]);
+            RenderCounters::vertices += counts[i];
+        }
+        if (!visibleFirsts.empty()) {
+            glMultiDrawArrays(drawType, visibleFirsts.data(), visibleCounts.data(), (GLsizei) visibleFirsts.size());
+            RenderCounters::drawCalls++;
+        }
+    }
+
+    glDisableVertexAttribArray(2);
+    if (useColorData)
+        glDisableVertexAttribArray(1);
+    glDisableVertexAttribArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef ZENITH_CPP_GLBATCH_HPP_
+#define ZENITH_CPP_GLBATCH_HPP_
+
+#include <set>
+#include <string>
+#include <vector>
+#include "glad/gl.h"
+#include "GLModel.hpp"
+#include "BufferArena.hpp"
+
+// Static layers that share a draw type, packed into one set of arena ranges
+// and submitted with a single glMultiDrawArrays. Each vertex carries the
+// slot of its layer; per-layer color, size and color-data flag live in a
+// small RGBA32F texture (row 0: color, row 1: size, use_color_data) so the
+// layers keep their own ImGui controls.
+class GLBatch {
+ public:
+    GLuint drawType;
+    // "batch: " and the names of its layers.
+    std::string name;
+    std::vector<GLModel*> members;
+    std::vector<GLint> firsts;
+    std::vector<GLsizei> counts;
+
+    BufferArena* arena;
+    int vertexAllocation;
+    int colorAllocation;
+    int slotAllocation;
+    GLuint layerTable;
+
+    int numVertices;
+    bool useColorData;
+    bool bufferInitialized;
+    std::vector<float> layerTableData;
+
+    GLBatch(GLuint drawType, BufferArena* arena);
+    ~GLBatch();
+    void addMember(GLModel* model);
+    // Hands the members back to their own buffers. The batch must not be
+    // drawn afterwards; its GL objects are freed by the destructor.
+    void detachMembers();
+    void initBuffer();
+    void updateLayerTable();
+    unsigned int shaderFeatures();
+    // With visible set, only members whose layer id is in it are drawn.
+    void render(const std::set<int>* visible = nullptr);
+};
+
+#endif  // ZENITH_CPP_GLBATCH_HPP_
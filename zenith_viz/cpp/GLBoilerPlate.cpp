@@ -4,14 +4,14 @@
 #include <iostream>
 
 #include <string>
-#include <sstream>
-#include <fstream>
 #include <vector>
 #include <glm/fwd.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "Controls.hpp"
 #include "GLModel.hpp"
+#include "GlfwLibrary.hpp"
+#include "Tracing.hpp"
 #include "imgui/imgui.h"
 #include "imgui/backends/imgui_impl_glfw.h"
 #include "imgui/backends/imgui_impl_opengl3.h"
@@ -29,7 +29,8 @@ GLFWwindow* GLBoilerPlate::initWindow() {
 
 
     glfwSetErrorCallback(&glfwError);
-    if (!glfwInit()) {
+    // Released by Engine::deinitialize.
+    if (!acquireGlfw()) {
         fprintf(stderr, "Couldn't initialize GLFW\n");
     }
 
@@ -41,7 +42,6 @@ GLFWwindow* GLBoilerPlate::initWindow() {
     GLFWwindow* window = glfwCreateWindow(1024, 768, "Zenith", nullptr, nullptr);
     if( window == nullptr ) {
         fprintf( stderr, "Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible." );
-        glfwTerminate();
     }
     glfwMakeContextCurrent(window);
 
@@ -51,111 +51,64 @@ GLFWwindow* GLBoilerPlate::initWindow() {
     return window;
 };
 
-void GLBoilerPlate::render(GLFWwindow *window, std::map<int, GLModel*>* models, GLuint shaderProgram, GLint matrixId, glm::mat4 mvp) {
-    glUseProgram(shaderProgram);
-    glUniformMatrix4fv(matrixId, 1, GL_FALSE, &mvp[0][0]);
-    GLint resolutionVar = glGetUniformLocation(shaderProgram, "u_resolution");
-    GLint mouseVar = glGetUniformLocation(shaderProgram, "u_mouse");
-    GLint timeVar = glGetUniformLocation(shaderProgram, "u_time");
-
-    int fb_width, fb_height;
-    glfwGetFramebufferSize(window, &fb_width, &fb_height);
-
-    int width = 0;
-    int height = 0;
-
-    glfwGetWindowSize(window, &width, &height);
-    float resData[] = {
-            (float) width,
-            (float) height
-    };
-
-    float fb_factor_x = (float) fb_width / width;
-    float fb_factor_y = (float) fb_height / height;
-
-    GLint isPoint = glGetUniformLocation(shaderProgram, "is_point");
-
-    double mouse_x = 0.0;
-    double mouse_y = 0.0;
-    glfwGetCursorPos(window, &mouse_x, &mouse_y);
-    float mouseData[] = {
-            (float) (mouse_x / width) * fb_factor_x,
-            (float) ((height - (float) mouse_y) / height) * fb_factor_y
-    };
+GLFWwindow* GLBoilerPlate::initLoaderContext(GLFWwindow* window) {
+    // The context hints are still the ones initWindow set.
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* context = glfwCreateWindow(1, 1, "Zenith loader", nullptr, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (context == nullptr)
+        fprintf(stderr, "zenith: no shared context, layers upload on the render thread\n");
+    return context;
+}
 
-    glUniform2fv(resolutionVar, 1, resData);
-    glUniform2fv(mouseVar, 1, mouseData);
+void GLBoilerPlate::present(GLFWwindow *window) {
+    ZENITH_TRACE_ZONE("glfwSwapBuffers");
+    glfwSwapBuffers(window);
+}
 
+void GLBoilerPlate::draw(const ModelMap* models, std::vector<GLBatch*>* batches, ShaderLibrary* shaders, glm::mat4 mvp, const std::set<int>* visible) {
+    ZENITH_TRACE_ZONE("GLBoilerPlate::draw");
+    items.clear();
+    layers.clear();
+    // Batches hold runs of consecutive layers in id order, so each one is
+    // drawn where its first layer would be.
+    size_t nextBatch = 0;
     for (auto && kvPair : *models) {
-        if (kvPair.second->drawType == GL_POINTS) {
-            glUniform1i(isPoint, 1);
+        if (kvPair.second->batched) {
+            if (nextBatch < batches->size() && (*batches)[nextBatch]->members.front() == kvPair.second.get()) {
+                GLBatch* batch = (*batches)[nextBatch++];
+                items.push_back({batch->shaderFeatures(), batch, nullptr, 0});
+            }
+            continue;
+        }
+        if (kvPair.second->uploadPending)
+            continue;
+        if (visible != nullptr && visible->count(kvPair.first) == 0) {
+            RenderCounters::culledVertices += kvPair.second->numVertices;
+            continue;
+        }
+        layers.emplace_back();
+        kvPair.second->layerUniforms(&layers.back());
+        items.push_back({kvPair.second->shaderFeatures(), nullptr, kvPair.second.get(), layers.size() - 1});
+    }
+    // Layers are drawn in order: with GL_ALWAYS and blending, the order is
+    // what stacks them. use() only rebinds when the program changes, so
+    // runs of layers of one kind share a bind.
+    shaders->setMatrix(mvp);
+    shaders->beginDraw(layers);
+    for (auto && item : items) {
+        if (shaders->use(item.features) == 0)
+            continue;
+        // A batch is one multi-draw, so its layers are timed together.
+        if (stats != nullptr)
+            stats->beginGpu(item.batch != nullptr ? item.batch->name : item.model->name);
+        if (item.batch != nullptr) {
+            item.batch->render(visible);
         } else {
-            glUniform1i(isPoint, 0);
+            shaders->bindLayer(item.layer);
+            item.model->render();
         }
-        kvPair.second->render(shaderProgram);
+        if (stats != nullptr)
+            stats->endGpu();
     }
-    glfwSwapBuffers(window);
-    glfwPollEvents();
 };
-
-GLuint GLBoilerPlate::compileShader(const char* file_path, GLenum shaderType) {
-    GLuint shaderId = glCreateShader(shaderType);
-    std::string shaderCode;
-    std::ifstream shaderStream(file_path, std::ios::in);
-    if (shaderStream.is_open()) {
-        std::stringstream sstr;
-        sstr << shaderStream.rdbuf();
-        shaderCode = sstr.str();
-        shaderStream.close();
-    } else {
-        getchar();
-        return 0;
-    }
-    char const* sourcePointer = shaderCode.c_str();
-    glShaderSource(shaderId, 1, &sourcePointer, nullptr);
-    glCompileShader(shaderId);
-    this->checkProgram(shaderId, GL_COMPILE_STATUS);
-
-    return shaderId;
-}
-
-GLuint GLBoilerPlate::linkShaders(GLuint vertexProgram, GLuint fragmentProgram) {
-    GLuint programId = glCreateProgram();
-
-    glAttachShader(programId, vertexProgram);
-    glAttachShader(programId, fragmentProgram);
-    glLinkProgram(programId);
-
-    this->checkProgram(programId, GL_LINK_STATUS);
-
-    glDetachShader(programId, vertexProgram);
-    glDetachShader(programId, fragmentProgram);
-
-    glDeleteShader(vertexProgram);
-    glDeleteShader(fragmentProgram);
-
-    return programId;
-}
-
-void GLBoilerPlate::checkProgram(GLuint program, GLenum pname) {
-
-    GLint result = GL_FALSE;
-    int infoLogLength;
-
-    if (pname == GL_LINK_STATUS) {
-        glGetProgramiv(program, GL_LINK_STATUS, &result);
-        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
-    } else {
-        glGetShaderiv(program, GL_COMPILE_STATUS, &result);
-        glGetShaderiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
-    }
-
-    if (infoLogLength > 0) {
-        std::vector<char> msg(infoLogLength + (uint64_t) 1);
-        if (pname == GL_LINK_STATUS)
-            glGetProgramInfoLog(program, infoLogLength, nullptr, &msg[0]);
-        else
-            glGetShaderInfoLog(program, infoLogLength, nullptr, &msg[0]);
-        printf("%s\n", &msg[0]);
-    }
-}
\ No newline at end of file
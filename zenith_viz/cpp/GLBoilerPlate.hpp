@@ -4,14 +4,40 @@
 #include "glad/gl.h"
 #include <GLFW/glfw3.h>
 #include <map>
+#include <set>
+#include <vector>
 #include "GLModel.hpp"
+#include "GLBatch.hpp"
+#include "FrameStats.hpp"
+#include "ShaderLibrary.hpp"
 
 class GLBoilerPlate {
 public:
+    // When set, draw() times each batch and layer on the GPU into it.
+    FrameStats* stats = nullptr;
+
     GLFWwindow* initWindow();
-    void render(GLFWwindow *window, std::map<int, GLModel*>* models, GLuint shaderProgram, GLint matrixId, glm::mat4 mvp);
-    GLuint compileShader(const char* file_path, GLenum shaderType);
-    GLuint linkShaders(GLuint vertexProgram, GLuint fragmentProgram);
-    void checkProgram(GLuint program, GLenum pname);
+    // A hidden window whose context shares objects with window's, for the
+    // BufferLoader; nullptr if it cannot be created.
+    GLFWwindow* initLoaderContext(GLFWwindow* window);
+    void present(GLFWwindow *window);
+    // Draws layers by id into the bound framebuffer, each batch in place of
+    // its first layer, each with its shader variant; consecutive draws with
+    // one variant share a program bind. With visible set, only layers whose id
+    // is in it are drawn.
+    void draw(const ModelMap* models, std::vector<GLBatch*>* batches, ShaderLibrary* shaders, glm::mat4 mvp, const std::set<int>* visible);
+
+private:
+    struct DrawItem {
+        unsigned int features;
+        GLBatch* batch;
+        GLModel* model;
+        // The model's entry in layers.
+        size_t layer;
+    };
+
+    // Reused from frame to frame.
+    std::vector<DrawItem> items;
+    std::vector<LayerUniforms> layers;
 };
 #endif //ZENITH_GLBOILERPLATE_H
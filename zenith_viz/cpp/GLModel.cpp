@@ -5,53 +5,77 @@
 #include "glad/gl.h"
 #include <GLFW/glfw3.h>
 #include <string>
+#include <algorithm>
 #include <cstdlib>
+#include <cmath>
+#include <limits>
 #include "vector"
 #include "imgui/imgui.h"
+#include "Parallel.hpp"
+#include "Tracing.hpp"
+
+static void copyVertices(float* dst, const float* src, int numVertices, int numComponents,
+                         const std::vector<unsigned int>& permutation) {
+    if (permutation.empty()) {
+        for (int i=0; i < numVertices * numComponents; i++) {
+            dst[i] = src[i];
+        }
+        return;
+    }
+    for (int i=0; i < numVertices; i++) {
+        const float* vertex = &src[(size_t) permutation[i] * numComponents];
+        for (int c=0; c < numComponents; c++) {
+            dst[(size_t) i * numComponents + c] = vertex[c];
+        }
+    }
+}
+
+static const char* drawStyleNames[] = {
+    "GL_POINTS",
+    "GL_LINES",
+    "GL_LINE_LOOP",
+    "GL_LINE_STRIP",
+    "GL_TRIANGLES",
+    "GL_TRIANGLE_STRIP",
+    "GL_TRIANGLE_FAN",
+    "GL_QUADS",
+    "GL_QUAD_STRIP",
+    "GL_POLYGON"
+};
 
 GLModel::GLModel(const float* vertexData, int numVertices, int numComponents, int stride,
                  GLuint drawType, std::string name, const float* color, const float* colordata, int useColorData, int id,
-                 std::vector<std::string> stringReps, bool pickingEnabled) {
+                 std::vector<std::string> stringReps, bool pickingEnabled, int spatialOrder,
+                 std::vector<unsigned int> order) {
+    ZENITH_TRACE_ZONE("GLModel::GLModel");
     this->pickingEnabled = pickingEnabled;
-    this->drawStyles = new std::vector<std::string*>;
-    this->drawStyles->push_back(new std::string("GL_POINTS"));
-    this->drawStyles->push_back(new std::string("GL_LINES"));
-    this->drawStyles->push_back(new std::string("GL_LINE_LOOP"));
-    this->drawStyles->push_back(new std::string("GL_LINE_STRIP"));
-    this->drawStyles->push_back(new std::string("GL_TRIANGLES"));
-    this->drawStyles->push_back(new std::string("GL_TRIANGLE_STRIP"));
-    this->drawStyles->push_back(new std::string("GL_TRIANGLE_FAN"));
-    this->drawStyles->push_back(new std::string("GL_QUADS"));
-    this->drawStyles->push_back(new std::string("GL_QUAD_STRIP"));
-    this->drawStyles->push_back(new std::string("GL_POLYGON"));
     this->size = 3.0f;
-    this->vertexData = (float*) malloc(sizeof(float) * numVertices * numComponents);
-    for (int i=0; i < numVertices * numComponents; i++) {
-        this->vertexData[i] = vertexData[i];
+
+    // Lines and triangles are defined by vertex order, so only point layers
+    // can be stored in spatial order. An explicit order wins over both.
+    if (!order.empty()) {
+        this->permutation = std::move(order);
+    } else if (spatialOrder != SPATIAL_ORDER_NONE && drawType == GL_POINTS) {
+        this->permutation = spatialPermutation(vertexData, numVertices, numComponents, spatialOrder);
     }
 
+    this->vertexData = (float*) malloc(sizeof(float) * numVertices * numComponents);
+    copyVertices(this->vertexData, vertexData, numVertices, numComponents, this->permutation);
+
     this->useColorData = useColorData;
 
     if (useColorData > 0) {
         this->colorData = (float*) malloc(sizeof(float) * numVertices * numComponents);
-        for (int i=0; i < numVertices * numComponents; i++) {
-            this->colorData[i] = colordata[i];
-        }
+        copyVertices(this->colorData, colordata, numVertices, numComponents, this->permutation);
     }
 
     if (pickingEnabled) {
+        ZENITH_TRACE_ZONE("picking index");
         this->tree_index = new VpTree<DataPoint, euclidean_distance>();
         this->idxVertices = new std::vector<DataPoint>();
-        int vertexIdx = 0;
-        for (int i = 0; i < numVertices * numComponents; i = i + 3) {
-            auto point = (float *) malloc(sizeof(float) * 3);
-            point[0] = vertexData[i];
-            point[1] = vertexData[i + 1];
-            point[2] = vertexData[i + 2];
-            auto datapoint = new DataPoint(3, vertexIdx, point);
-            this->idxVertices->push_back(*datapoint);
-            free(point);
-            vertexIdx++;
+        this->idxVertices->reserve(numVertices);
+        for (int i = 0; i < numVertices; i++) {
+            this->idxVertices->emplace_back(3, this->originalIndex(i), &this->vertexData[i * numComponents]);
         }
         this->tree_index->create(*this->idxVertices);
         this->pickingEnabled = true;
@@ -69,34 +93,70 @@ GLModel::GLModel(const float* vertexData, int numVertices, int numComponents, in
     this->id = id;
     this->stringReps = stringReps;
     this->bufferInitialized = false;
+    this->batched = false;
+    this->uploadPending = false;
+    this->arena = nullptr;
+    this->vertexAllocation = -1;
+    this->colorAllocation = -1;
 }
 
 GLModel::~GLModel() {
     free(this->vertexData);
     free(this->color);
-    this->drawStyles->clear();
-    if (bufferInitialized)
-        glDeleteBuffers(1, &this->vertexBuffer);
-    this->bufferInitialized = false;
+    if (bufferInitialized && this->arena == nullptr)
+        this->releaseBuffers();
     if (this->pickingEnabled) {
-        this->idxVertices->clear();
         delete this->tree_index;
+        delete this->idxVertices;
     }
 
     if (this->useColorData) {
-        glDeleteBuffers(1, &this->colorBuffer);
         free(this->colorData);
     }
 }
 
+const char* GLModel::drawStyleName(GLuint drawType) {
+    if (drawType >= sizeof(drawStyleNames) / sizeof(drawStyleNames[0]))
+        return "unknown";
+    return drawStyleNames[drawType];
+}
+
+int GLModel::originalIndex(int storageIndex) {
+    if (this->permutation.empty())
+        return storageIndex;
+    return (int) this->permutation[storageIndex];
+}
+
+int GLModel::nearestIndex(const float* point) {
+    if (!this->pickingEnabled)
+        return -1;
+    float query[3] = {point[0], point[1], point[2]};
+    std::vector<DataPoint> results;
+    std::vector<float> distances;
+    std::function<bool(int)> accept = [this](int index) { return this->pickable(index); };
+    this->tree_index->search(DataPoint(3, 0, query), 1, &results, &distances, &accept);
+    if (results.empty())
+        return -1;
+    return results[0].index();
+}
+
 void GLModel::initBuffer() {
     if (this->bufferInitialized){
-        glDeleteBuffers(1, &this->vertexBuffer);
+        this->releaseBuffers();
+    }
+    if (this->arena != nullptr) {
+        GLsizeiptr bytes = sizeof(float) * (GLsizeiptr) numVertices * numComponents;
+        this->vertexAllocation = arena->allocate(bytes, vertexData);
+        if (this->useColorData)
+            this->colorAllocation = arena->allocate(bytes, colorData);
+        this->bufferInitialized = true;
+        return;
     }
     GLuint vertexbuffer;
     glGenBuffers(1, &vertexbuffer);
     glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(float) * numVertices * numComponents, vertexData, GL_STATIC_DRAW);
+    RenderCounters::uploadBytes += sizeof(float) * numVertices * numComponents;
     this->vertexBuffer = vertexbuffer;
 
     if (this->useColorData) {
@@ -104,64 +164,198 @@ void GLModel::initBuffer() {
         glGenBuffers(1, &vertexColorBuffer);
         glBindBuffer(GL_ARRAY_BUFFER, vertexColorBuffer);
         glBufferData(GL_ARRAY_BUFFER, sizeof(float) * numVertices * numComponents, this->colorData, GL_STATIC_DRAW);
+        RenderCounters::uploadBytes += sizeof(float) * numVertices * numComponents;
         this->colorBuffer = vertexColorBuffer;
     }
     this->bufferInitialized = true;
 }
 
-void GLModel::bindVertexBuffer() {
+void GLModel::releaseBuffers() {
+    if (!this->bufferInitialized)
+        return;
+    if (this->arena != nullptr) {
+        arena->release(this->vertexAllocation);
+        arena->release(this->colorAllocation);
+    } else {
+        glDeleteBuffers(1, &this->vertexBuffer);
+        if (this->useColorData)
+            glDeleteBuffers(1, &this->colorBuffer);
+    }
+    this->dropBuffers();
+}
+
+void GLModel::dropBuffers() {
+    this->vertexAllocation = -1;
+    this->colorAllocation = -1;
+    this->bufferInitialized = false;
+}
+
+const void* GLModel::bindVertexBuffer() {
+    if (this->arena != nullptr) {
+        BufferSlice slice = arena->slice(this->vertexAllocation);
+        glBindBuffer(GL_ARRAY_BUFFER, slice.buffer);
+        return (const void*) slice.offset;
+    }
     glBindBuffer(GL_ARRAY_BUFFER, this->vertexBuffer);
+    return nullptr;
+}
+
+const void* GLModel::bindColorBuffer() {
+    if (this->arena != nullptr) {
+        BufferSlice slice = arena->slice(this->colorAllocation);
+        glBindBuffer(GL_ARRAY_BUFFER, slice.buffer);
+        return (const void*) slice.offset;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, this->colorBuffer);
+    return nullptr;
+}
+
+LayerMemoryStats GLModel::memoryStats() {
+    LayerMemoryStats stats = LayerMemoryStats();
+    size_t values = (size_t) this->numVertices * this->numComponents;
+    stats.vertexBytes = sizeof(float) * values;
+    if (this->useColorData)
+        stats.colorBytes = sizeof(float) * values;
+    stats.stringBytes = this->stringReps.capacity() * sizeof(std::string);
+    for (auto && rep : this->stringReps) {
+        // Short strings live inside the std::string itself.
+        if (rep.capacity() >= sizeof(std::string))
+            stats.stringBytes += rep.capacity() + 1;
+    }
+    if (this->pickingEnabled) {
+        // The point list and the tree's own copy of it, plus one node per
+        // point.
+        size_t point = sizeof(DataPoint) + 3 * sizeof(float);
+        stats.pickingBytes = this->idxVertices->capacity() * point
+            + this->tree_index->_items.capacity() * point
+            + (size_t) this->numVertices * sizeof(VpTree<DataPoint, euclidean_distance>::Node);
+    }
+    stats.permutationBytes = this->permutation.capacity() * sizeof(unsigned int);
+
+    if (this->bufferInitialized) {
+        if (this->arena != nullptr) {
+            stats.gpuVertexBytes = arena->slice(this->vertexAllocation).size;
+            if (this->useColorData)
+                stats.gpuColorBytes = arena->slice(this->colorAllocation).size;
+        } else {
+            stats.gpuVertexBytes = stats.vertexBytes;
+            stats.gpuColorBytes = stats.colorBytes;
+        }
+    }
+    return stats;
+}
+
+void GLModel::extendBounds(float* lower, float* upper) {
+    int components = std::min(this->numComponents, 3);
+    for (int i = 0; i < this->numVertices; i++) {
+        const float* vertex = &this->vertexData[(size_t) i * this->numComponents];
+        for (int c = 0; c < components; c++) {
+            lower[c] = std::min(lower[c], vertex[c]);
+            upper[c] = std::max(upper[c], vertex[c]);
+        }
+    }
+}
+
+double GLModel::nextFrameDelay(double now) {
+    return -1.0;
+}
+
+bool GLModel::timeRange(long* first, long* last, long* step) {
+    return false;
+}
+
+void GLModel::seekClock(long position, double fraction) {
+}
+
+bool GLModel::setTimeWindows(const std::vector<TimeWindow>& windows, float fade) {
+    return false;
+}
+
+bool GLModel::pickable(int index) {
+    return true;
+}
+
+bool GLModel::batchable() {
+    return this->numComponents == 3
+        && (this->stride == 0 || this->stride == (int) (sizeof(float) * 3));
+}
+
+bool GLModel::backgroundUpload() {
+    return true;
+}
+
+void GLModel::adoptBuffers(GLuint vertexBuffer, GLuint colorBuffer) {
+    // From here on the layer owns its buffers, outside the arena.
+    this->arena = nullptr;
+    this->vertexBuffer = vertexBuffer;
+    this->colorBuffer = colorBuffer;
+    this->bufferInitialized = true;
+    this->uploadPending = false;
+}
+
+unsigned int GLModel::shaderFeatures() {
+    unsigned int features = this->drawType == GL_POINTS ? SHADER_POINTS : 0;
+    if (this->useColorData)
+        features |= SHADER_COLOR_DATA;
+    if (this->pickingEnabled)
+        features |= SHADER_PICKING;
+    return features;
 }
 
-void GLModel::render(GLuint shaderProgram) {
+void GLModel::renderUI() {
+    ImGui::PushID(this->id);
     ImGui::BeginChild(this->name.c_str(), ImVec2(400, 65));
     ImGui::Text(
         "Model Name: %s, Vertices: %d, draw-type: %s",
         this->name.c_str(),
         this->numVertices,
-        this->drawStyles->at(this->drawType)->c_str()
+        drawStyleName(this->drawType)
     );
     ImGui::ColorEdit4(this->name.c_str(), this->color);
     ImGui::SliderFloat("size", &size, 0.0f, 40.0f);
     ImGui::EndChild();
-    ImGui::End();
-    glEnableVertexAttribArray(0);
-    GLint colorVar = glGetUniformLocation(shaderProgram, "color");
-    GLint sizeVar = glGetUniformLocation(shaderProgram, "point_size");
-    GLint useColor = glGetUniformLocation(shaderProgram, "use_color_data");
+    ImGui::PopID();
+}
 
-    glUniform4f(colorVar, (GLfloat) color[0], (GLfloat) color[1], (GLfloat) color[2], (GLfloat) color[3]);
-    glUniform1f(sizeVar, (GLfloat) size);
+void GLModel::layerUniforms(LayerUniforms* uniforms) {
+    *uniforms = LayerUniforms();
+    for (int i = 0; i < 4; i++) {
+        uniforms->color[i] = (float) color[i];
+    }
+    uniforms->pointSize = (float) size;
+}
 
-    if (this->useColorData)
-        glUniform1f(useColor, (GLfloat) 1.0f);
-    else
-        glUniform1f(useColor, (GLfloat) 0.0f);
+void GLModel::render() {
+    ZENITH_TRACE_ZONE("GLModel::render");
+    if (!this->bufferInitialized)
+        this->initBuffer();
+    glEnableVertexAttribArray(0);
 
-    this->bindVertexBuffer();
+    const void* vertexOffset = this->bindVertexBuffer();
     glVertexAttribPointer(
         0,
         this->numComponents,
         GL_FLOAT,
         GL_FALSE,
         this->stride,
-        nullptr
+        vertexOffset
     );
 
-    glDrawArrays(this->drawType, 0, this->numVertices);
     if (this->useColorData) {
         glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, this->colorBuffer);
+        const void* colorOffset = this->bindColorBuffer();
         glVertexAttribPointer(
             1,
             this->numComponents,
             GL_FLOAT,
             GL_FALSE,
             this->stride,
-            nullptr
+            colorOffset
         );
     }
     glDrawArrays(this->drawType, 0, this->numVertices);
+    RenderCounters::drawCalls++;
+    RenderCounters::vertices += this->numVertices;
     if (this->useColorData)
         glDisableVertexAttribArray(1);
     glDisableVertexAttribArray(0);
@@ -183,144 +377,496 @@ GLModelAnimated::GLModelAnimated(
     int id,
     std::vector<std::string> stringReps,
     bool pickingEnabled
-): GLModel::GLModel(vertexData, numVertices, numComponents, stride, drawType, name, color, colordata, useColorData, id, stringReps, pickingEnabled) {
+): GLModel::GLModel(vertexData, numVertices, numComponents, stride, drawType, name, color, colordata, useColorData, id,
+                   stringReps, pickingEnabled, SPATIAL_ORDER_NONE, timePermutation(timeData, numVertices)) {
+    // Unsorted times are stored sorted, with vertices and colors following
+    // the same permutation; picking still reports the caller's indices.
     this->timeData = (long*) malloc(sizeof(long) * numVertices);
     for (int i=0; i < numVertices; i++) {
-        this->timeData[i] = timeData[i];
+        this->timeData[i] = timeData[this->originalIndex(i)];
     }
     this->windowSize = windowSize;
-    this->time = glfwGetTime();
-    this->curIndex = 0;
-    this->stepSize = stepSize;
+    this->stepSize = stepSize > 0 ? stepSize : 1;
     this->createTimeSteps();
-    this->fps = 30.0f;
-    this->endStep = 1;
     this->windowSteps = 1;
-    this->paused = true;
+    this->playhead = this->minTime;
+    this->timeBuffer = 0;
+    this->timeAllocation = -1;
+    this->timeFade = 0.0f;
 }
 
 GLModelAnimated::~GLModelAnimated() {
+    // The base destructor can't reach the time buffer through the override.
+    if (this->bufferInitialized && this->arena == nullptr)
+        this->releaseBuffers();
     free(this->timeData);
-    free(this->startOffsets);
-    free(this->endOffsets);
 }
 
-void GLModelAnimated::timeUpdate(int next) {
-    if (this->curIndex >= (this->numSteps - 1)) {
-        this->curIndex = 0;
+void GLModelAnimated::initBuffer() {
+    GLModel::initBuffer();
+    std::vector<unsigned int> offsets(this->numVertices);
+    for (int i = 0; i < this->numVertices; i++) {
+        offsets[i] = timeOffset(this->timeData[i]);
+    }
+    GLsizeiptr bytes = sizeof(unsigned int) * (GLsizeiptr) this->numVertices;
+    if (this->arena != nullptr) {
+        this->timeAllocation = arena->allocate(bytes, offsets.data());
+        return;
+    }
+    glGenBuffers(1, &this->timeBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, this->timeBuffer);
+    glBufferData(GL_ARRAY_BUFFER, bytes, offsets.data(), GL_STATIC_DRAW);
+    RenderCounters::uploadBytes += bytes;
+}
+
+void GLModelAnimated::releaseBuffers() {
+    if (!this->bufferInitialized)
+        return;
+    if (this->arena != nullptr) {
+        arena->release(this->timeAllocation);
     } else {
-        this->curIndex = this->curIndex + next;
+        glDeleteBuffers(1, &this->timeBuffer);
     }
-    int last = this->curIndex + this->windowSteps;
-    if (last > this->numSteps - 1) {
-        last = this->numSteps - 1;
+    GLModel::releaseBuffers();
+}
+
+void GLModelAnimated::dropBuffers() {
+    this->timeBuffer = 0;
+    this->timeAllocation = -1;
+    GLModel::dropBuffers();
+}
+
+LayerMemoryStats GLModelAnimated::memoryStats() {
+    LayerMemoryStats stats = GLModel::memoryStats();
+    stats.timeBytes = sizeof(long) * (size_t) this->numVertices;
+    stats.permutationBytes += this->storagePositions.capacity() * sizeof(unsigned int);
+    if (this->bufferInitialized) {
+        stats.gpuTimeBytes = this->arena != nullptr
+            ? arena->slice(this->timeAllocation).size
+            : sizeof(unsigned int) * (size_t) this->numVertices;
     }
-    this->endStep = last;
+    return stats;
+}
+
+bool GLModelAnimated::timeRange(long* first, long* last, long* step) {
+    *first = this->minTime;
+    *last = this->maxTime;
+    *step = (long) this->stepSize;
+    return true;
 }
 
-void GLModelAnimated::render(GLuint shaderProgram) {
+void GLModelAnimated::seekClock(long position, double fraction) {
+    this->playhead = position;
+}
+
+bool GLModelAnimated::setTimeWindows(const std::vector<TimeWindow>& windows, float fade) {
+    if (windows.size() > (size_t) MAX_TIME_WINDOWS)
+        printf("zenith: layer %s shows only its first %d time windows\n", this->name.c_str(), MAX_TIME_WINDOWS);
+    this->timeWindows.assign(windows.begin(), windows.begin() + std::min(windows.size(), (size_t) MAX_TIME_WINDOWS));
+    this->timeFade = std::min(std::max(fade, 0.0f), 1.0f);
+    return true;
+}
+
+bool GLModelAnimated::pickable(int index) {
+    if (!this->permutation.empty() && this->storagePositions.empty()) {
+        this->storagePositions.resize(this->permutation.size());
+        for (size_t i = 0; i < this->permutation.size(); i++) {
+            this->storagePositions[this->permutation[i]] = (unsigned int) i;
+        }
+    }
+    long time = this->timeData[this->permutation.empty() ? index : (int) this->storagePositions[index]];
+    for (auto && window : visibleWindows()) {
+        if (time >= window.begin && time < window.end)
+            return true;
+    }
+    return false;
+}
+
+bool GLModelAnimated::batchable() {
+    return false;
+}
+
+// The time offsets need a buffer of their own.
+bool GLModelAnimated::backgroundUpload() {
+    return false;
+}
+
+unsigned int GLModelAnimated::shaderFeatures() {
+    return GLModel::shaderFeatures() | SHADER_TIME_WINDOWS;
+}
+
+void GLModelAnimated::renderUI() {
     ImGui::Begin("Animated Models");
+    ImGui::PushID(this->id);
     ImGui::BeginChild(this->name.c_str(), ImVec2(450, 175));
     ImGui::Text(
         "Model Name: %s, Vertices: %d, draw-type: %s",
         this->name.c_str(),
         this->numVertices,
-        drawStyles->at(this->drawType)->c_str()
+        drawStyleName(this->drawType)
     );
 
     ImGui::ColorEdit4(this->name.c_str(), this->color);
     ImGui::SliderFloat("size", &size, 0.0f, 40.0f);
-    ImGui::SliderInt("Begin Step", (int *) &this->curIndex, 0, this->numSteps-1);
-    ImGui::SliderInt("Window Steps", (int *) &this->windowSteps, 1, this->numSteps-2);
-    ImGui::SliderFloat("FPS", &this->fps, 1.0, 200.0f);
-
-    if (ImGui::Button("Play/Pause")) {
-        paused = !paused;
-    }
+    // Playback itself is driven from the control panel's timeline.
+    ImGui::SliderInt("Window Steps", (int *) &this->windowSteps, 1, (int) std::min(this->numSteps, 1000L));
     ImGui::EndChild();
+    ImGui::PopID();
     ImGui::End();
-    double curTime = glfwGetTime();
+}
 
-    if (curTime > this->time + (1.0f / this->fps) && !paused) {
-        timeUpdate(1);
-        this->time = curTime;
-    } else {
-        if (paused) {
-           timeUpdate(0);
-        }
+void GLModelAnimated::layerUniforms(LayerUniforms* uniforms) {
+    GLModel::layerUniforms(uniforms);
+    std::vector<TimeWindow> windows = visibleWindows();
+    for (size_t i = 0; i < windows.size(); i++) {
+        uniforms->timeWindows[2 * i] = timeOffset(windows[i].begin);
+        uniforms->timeWindows[2 * i + 1] = timeOffset(windows[i].end);
     }
+    uniforms->numTimeWindows = (GLint) windows.size();
+    uniforms->timeFade = this->timeFade;
+}
 
-    glEnableVertexAttribArray(0);
-    GLint colorVar = glGetUniformLocation(shaderProgram, "color");
-    GLint sizeVar = glGetUniformLocation(shaderProgram, "point_size");
-    GLint useColor = glGetUniformLocation(shaderProgram, "use_color_data");
-
-    glUniform4f(colorVar, (GLfloat) color[0], (GLfloat) color[1], (GLfloat) color[2], (GLfloat) color[3]);
-    glUniform1f(sizeVar, (GLfloat) size);
+void GLModelAnimated::render() {
+    if (!this->bufferInitialized)
+        this->initBuffer();
 
-    if (useColorData)
-        glUniform1f(useColor, (GLfloat) 1.0f);
-    else
-        glUniform1f(useColor, (GLfloat) 0.0f);
+    // Only the span covering every window is drawn; the shader drops the
+    // vertices between windows.
+    std::vector<TimeWindow> windows = visibleWindows();
+    long first = windows[0].begin;
+    long last = windows[0].end;
+    for (auto && window : windows) {
+        first = std::min(first, window.begin);
+        last = std::max(last, window.end);
+    }
+    auto start = first == std::numeric_limits<long>::min()
+        ? (GLuint) 0
+        : (GLuint) firstTimeAfter(this->timeData, (size_t) this->numVertices, first - 1);
+    auto stop = (GLuint) firstTimeAfter(this->timeData, (size_t) this->numVertices, last - 1);
+    if (stop < start)
+        stop = start;
 
     glEnableVertexAttribArray(0);
-    this->bindVertexBuffer();
-    auto start = (GLuint) this->startOffsets[this->curIndex];
-    auto stop = (GLuint) this->endOffsets[this->endStep - 1];
+    const void* vertexOffset = this->bindVertexBuffer();
     glVertexAttribPointer(
         0,
         this->numComponents,
         GL_FLOAT,
         GL_FALSE,
         this->stride,
-        nullptr
+        vertexOffset
     );
 
     if (this->useColorData) {
         glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, this->colorBuffer);
+        const void* colorOffset = this->bindColorBuffer();
         glVertexAttribPointer(
             1,
             this->numComponents,
             GL_FLOAT,
             GL_FALSE,
             this->stride,
-            nullptr
+            colorOffset
         );
     }
+    glEnableVertexAttribArray(3);
+    if (this->arena != nullptr) {
+        BufferSlice slice = arena->slice(this->timeAllocation);
+        glBindBuffer(GL_ARRAY_BUFFER, slice.buffer);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, 0, (const void*) slice.offset);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, this->timeBuffer);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, 0, nullptr);
+    }
     glDrawArrays(this->drawType, start, stop - start);
-    if (this->vertexBuffer)
+    RenderCounters::drawCalls++;
+    RenderCounters::vertices += stop - start;
+    RenderCounters::culledVertices += this->numVertices - (stop - start);
+    glDisableVertexAttribArray(3);
+    if (this->useColorData)
         glDisableVertexAttribArray(1);
     glDisableVertexAttribArray(0);
-
 }
 
 void GLModelAnimated::createTimeSteps() {
-    long minTime = timeData[0];
-    long maxTime = timeData[numVertices - 1];
+    // Windows are found on demand by searching the sorted times, so memory
+    // stays proportional to the points however long the time span.
+    this->minTime = numVertices > 0 ? timeData[0] : 0;
+    this->maxTime = numVertices > 0 ? timeData[numVertices - 1] : 0;
     this->numSteps = (maxTime - minTime) / stepSize;
-    this->startOffsets = (unsigned int*) malloc(sizeof(unsigned int) * numSteps);
-    this->endOffsets = (unsigned int*) malloc(sizeof(unsigned int) * numSteps);
-    long curTime = minTime;
-    this->startOffsets[0] = 0;
-    int stepIdx = 1;
-    for (unsigned int i=0; i < numVertices; i++) {
-        long recordTime = timeData[i];
-        if (curTime + stepSize < recordTime) {
-            this->startOffsets[stepIdx] = i;
-            curTime = curTime + stepSize;
-            stepIdx++;
-        }
+    if (this->numSteps < 1)
+        this->numSteps = 1;
+    // Keep the largest offset below UINT32_MAX, which stands for "after
+    // every point" in window bounds.
+    this->timeShift = 0;
+    while (((unsigned long) (maxTime - minTime) >> this->timeShift) >= 0xffffffffUL) {
+        this->timeShift++;
     }
-    stepIdx = 0;
-    curTime = minTime;
-    for (unsigned int i=0; i < numVertices; i++) {
-        long recordTime = timeData[i];
-        if (curTime + stepSize + windowSize < recordTime) {
-            this->endOffsets[stepIdx] = i;
-            curTime = curTime + stepSize;
-            stepIdx++;
+}
+
+// The playback window, or the fixed windows when any are set.
+std::vector<TimeWindow> GLModelAnimated::visibleWindows() {
+    if (!this->timeWindows.empty())
+        return this->timeWindows;
+    TimeWindow playback;
+    playback.begin = this->playhead;
+    playback.end = playback.begin + (long) this->windowSteps * (long) stepSize + (long) windowSize + 1;
+    return std::vector<TimeWindow>(1, playback);
+}
+
+unsigned int GLModelAnimated::timeOffset(long time) {
+    if (time <= minTime)
+        return 0;
+    unsigned long offset = (unsigned long) (time - minTime) >> this->timeShift;
+    return offset >= 0xffffffffUL ? 0xffffffffU : (unsigned int) offset;
+}
+
+// Storage order of track samples: by entity, then by time.
+static std::vector<unsigned int> trackPermutation(const long* entityIds, const long* timeData, int numVertices) {
+    std::vector<unsigned int> order(numVertices);
+    for (int i = 0; i < numVertices; i++) {
+        order[i] = (unsigned int) i;
+    }
+    std::sort(order.begin(), order.end(), [entityIds, timeData](unsigned int a, unsigned int b) {
+        if (entityIds[a] != entityIds[b])
+            return entityIds[a] < entityIds[b];
+        if (timeData[a] != timeData[b])
+            return timeData[a] < timeData[b];
+        return a < b;
+    });
+    return order;
+}
+
+GLModelTracks::GLModelTracks(
+    const float* vertexData,
+    int numVertices,
+    int numComponents,
+    int stride,
+    GLuint drawType,
+    unsigned int stepSize,
+    const long* entityIds,
+    const long* timeData,
+    std::string name,
+    const float* color,
+    int id
+): GLModel::GLModel(vertexData, numVertices, numComponents, stride, drawType, name, color, nullptr, 0, id,
+                   std::vector<std::string>(), false, SPATIAL_ORDER_NONE,
+                   trackPermutation(entityIds, timeData, numVertices)) {
+    this->timeData = (long*) malloc(sizeof(long) * numVertices);
+    this->minTime = numVertices > 0 ? timeData[0] : 0;
+    this->maxTime = this->minTime;
+    for (int i = 0; i < numVertices; i++) {
+        int original = this->originalIndex(i);
+        this->timeData[i] = timeData[original];
+        this->minTime = std::min(this->minTime, timeData[original]);
+        this->maxTime = std::max(this->maxTime, timeData[original]);
+        if (i == 0 || entityIds[original] != entityIds[this->originalIndex(i - 1)])
+            this->entityStarts.push_back(i);
+    }
+    this->numEntities = (int) this->entityStarts.size();
+    this->entityStarts.push_back(numVertices);
+    this->stepSize = stepSize > 0 ? stepSize : 1;
+    // One keyframe past the last sample when the span isn't a whole number
+    // of steps, so the end of every track is reached.
+    this->numKeyframes = (this->maxTime - this->minTime + (long) this->stepSize - 1) / (long) this->stepSize + 1;
+    this->playhead = this->minTime;
+    this->playheadFraction = 0.0;
+    this->keyframeBuffers[0] = 0;
+    this->keyframeBuffers[1] = 0;
+    this->loadedKeyframes[0] = -1;
+    this->loadedKeyframes[1] = -1;
+    this->prefetchedKeyframe = -1;
+}
+
+GLModelTracks::~GLModelTracks() {
+    // The worker reads the samples freed below.
+    if (this->prefetch.valid())
+        this->prefetch.wait();
+    if (this->bufferInitialized && this->arena == nullptr)
+        this->releaseBuffers();
+    free(this->timeData);
+}
+
+// Every entity's position at minTime + index * stepSize, interpolated
+// between the samples either side; entities whose track doesn't cover
+// that time are flagged absent and sit at their nearest sample.
+std::vector<float> GLModelTracks::keyframe(long index) const {
+    std::vector<float> values(4 * (size_t) this->numEntities);
+    long time = this->minTime + index * (long) this->stepSize;
+    int components = std::min(this->numComponents, 3);
+    parallelFor(0, (size_t) this->numEntities, 4096, [&](size_t begin, size_t end, int) {
+        for (size_t e = begin; e < end; e++) {
+            const long* first = this->timeData + this->entityStarts[e];
+            const long* last = this->timeData + this->entityStarts[e + 1];
+            const long* after = std::upper_bound(first, last, time);
+            int from = (int) (std::max(after, first + 1) - 1 - this->timeData);
+            int to = (int) (std::min(after, last - 1) - this->timeData);
+            double weight = 0.0;
+            if (to > from)
+                weight = (double) (time - this->timeData[from]) / (double) (this->timeData[to] - this->timeData[from]);
+            weight = std::min(std::max(weight, 0.0), 1.0);
+            float* out = &values[4 * e];
+            out[0] = 0.0f;
+            out[1] = 0.0f;
+            out[2] = 0.0f;
+            for (int c = 0; c < components; c++) {
+                float a = this->vertexData[(size_t) from * this->numComponents + c];
+                float b = this->vertexData[(size_t) to * this->numComponents + c];
+                out[c] = (float) (a + (b - a) * weight);
+            }
+            out[3] = time >= *first && time <= *(last - 1) ? 1.0f : 0.0f;
         }
+    });
+    return values;
+}
+
+void GLModelTracks::loadKeyframe(long index) {
+    int slot = (int) (index & 1);
+    if (this->loadedKeyframes[slot] == index)
+        return;
+    std::vector<float> values;
+    if (this->prefetchedKeyframe == index && this->prefetch.valid()) {
+        values = this->prefetch.get();
+        this->prefetchedKeyframe = -1;
+    } else {
+        values = keyframe(index);
     }
+    // Respecifying the store lets the driver hand out fresh memory rather
+    // than wait for draws still reading the old keyframe.
+    glBindBuffer(GL_ARRAY_BUFFER, this->keyframeBuffers[slot]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * values.size(), values.data(), GL_STREAM_DRAW);
+    RenderCounters::uploadBytes += sizeof(float) * values.size();
+    this->loadedKeyframes[slot] = index;
+}
+
+void GLModelTracks::prefetchKeyframe(long index) {
+    if (index >= this->numKeyframes || index == this->prefetchedKeyframe
+        || this->loadedKeyframes[index & 1] == index)
+        return;
+    // A prefetch overtaken by a seek is finished and dropped.
+    if (this->prefetch.valid())
+        this->prefetch.wait();
+    this->prefetch = std::async(std::launch::async, [this, index]() { return keyframe(index); });
+    this->prefetchedKeyframe = index;
+}
+
+void GLModelTracks::initBuffer() {
+    // The samples stay on the CPU; only keyframes are drawn.
+    glGenBuffers(2, this->keyframeBuffers);
+    this->loadedKeyframes[0] = -1;
+    this->loadedKeyframes[1] = -1;
+    this->bufferInitialized = true;
+}
+
+void GLModelTracks::releaseBuffers() {
+    if (!this->bufferInitialized)
+        return;
+    glDeleteBuffers(2, this->keyframeBuffers);
+    this->dropBuffers();
+}
+
+void GLModelTracks::dropBuffers() {
+    this->keyframeBuffers[0] = 0;
+    this->keyframeBuffers[1] = 0;
+    this->loadedKeyframes[0] = -1;
+    this->loadedKeyframes[1] = -1;
+    GLModel::dropBuffers();
+}
+
+LayerMemoryStats GLModelTracks::memoryStats() {
+    // Nothing comes from the arena, so the base accounting doesn't apply.
+    LayerMemoryStats stats = LayerMemoryStats();
+    stats.vertexBytes = sizeof(float) * (size_t) this->numVertices * this->numComponents;
+    stats.timeBytes = sizeof(long) * (size_t) this->numVertices + sizeof(int) * this->entityStarts.capacity();
+    stats.permutationBytes = this->permutation.capacity() * sizeof(unsigned int);
+    for (int slot = 0; slot < 2; slot++) {
+        if (this->loadedKeyframes[slot] >= 0)
+            stats.gpuVertexBytes += 4 * sizeof(float) * (size_t) this->numEntities;
+    }
+    return stats;
+}
+
+bool GLModelTracks::timeRange(long* first, long* last, long* step) {
+    *first = this->minTime;
+    *last = this->maxTime;
+    *step = (long) this->stepSize;
+    return true;
+}
+
+void GLModelTracks::seekClock(long position, double fraction) {
+    this->playhead = position;
+    this->playheadFraction = fraction;
+}
+
+bool GLModelTracks::batchable() {
+    return false;
+}
+
+// Keyframes are built on the render thread as playback reaches them.
+bool GLModelTracks::backgroundUpload() {
+    return false;
+}
+
+unsigned int GLModelTracks::shaderFeatures() {
+    return GLModel::shaderFeatures() | SHADER_KEYFRAMES;
+}
+
+void GLModelTracks::renderUI() {
+    ImGui::Begin("Animated Models");
+    ImGui::PushID(this->id);
+    ImGui::BeginChild(this->name.c_str(), ImVec2(450, 90));
+    ImGui::Text(
+        "Model Name: %s, Entities: %d, Samples: %d, draw-type: %s",
+        this->name.c_str(),
+        this->numEntities,
+        this->numVertices,
+        drawStyleName(this->drawType)
+    );
+    ImGui::ColorEdit4(this->name.c_str(), this->color);
+    ImGui::SliderFloat("size", &size, 0.0f, 40.0f);
+    ImGui::EndChild();
+    ImGui::PopID();
+    ImGui::End();
+}
+
+double GLModelTracks::keyframeMix(long* from, long* to) {
+    double offset = (double) (this->playhead - this->minTime) + this->playheadFraction;
+    *from = std::min(std::max((long) std::floor(offset / this->stepSize), 0L), this->numKeyframes - 1);
+    *to = std::min(*from + 1, this->numKeyframes - 1);
+    double weight = (offset - (double) *from * this->stepSize) / this->stepSize;
+    return *to > *from ? std::min(std::max(weight, 0.0), 1.0) : 0.0;
+}
+
+void GLModelTracks::layerUniforms(LayerUniforms* uniforms) {
+    GLModel::layerUniforms(uniforms);
+    long from;
+    long to;
+    uniforms->keyframeMix = (float) keyframeMix(&from, &to);
+}
+
+void GLModelTracks::render() {
+    if (!this->bufferInitialized)
+        this->initBuffer();
+    if (this->numEntities == 0)
+        return;
+
+    long from;
+    long to;
+    keyframeMix(&from, &to);
+    loadKeyframe(from);
+    loadKeyframe(to);
+    prefetchKeyframe(to + 1);
+
+    glEnableVertexAttribArray(4);
+    glBindBuffer(GL_ARRAY_BUFFER, this->keyframeBuffers[from & 1]);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glEnableVertexAttribArray(5);
+    glBindBuffer(GL_ARRAY_BUFFER, this->keyframeBuffers[to & 1]);
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glDrawArrays(this->drawType, 0, this->numEntities);
+    RenderCounters::drawCalls++;
+    RenderCounters::vertices += this->numEntities;
+    glDisableVertexAttribArray(5);
+    glDisableVertexAttribArray(4);
 }
 #endif
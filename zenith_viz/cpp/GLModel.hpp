@@ -3,23 +3,60 @@
 
 #include <string>
 #include <cstdlib>
+#include <map>
+#include <memory>
 #include <cstdio>
+#include <future>
 #include "glad/gl.h"
 #include <GLFW/glfw3.h>
 #include "vector"
 #include "imgui/imgui.h"
 #include "Controls.hpp"
+#include "SpatialSort.hpp"
+#include "TimeIndex.hpp"
+#include "BufferArena.hpp"
+#include "FrameStats.hpp"
+#include "ShaderLibrary.hpp"
+
+// Bytes one layer holds, by component. CPU figures are the sizes the layer
+// asked for (allocator overhead excluded); GPU figures are the buffer ranges
+// its vertices are drawn from, including its share of a batch.
+struct LayerMemoryStats {
+    size_t vertexBytes;
+    size_t colorBytes;
+    size_t timeBytes;
+    size_t stringBytes;
+    size_t pickingBytes;
+    size_t permutationBytes;
+    size_t gpuVertexBytes;
+    size_t gpuColorBytes;
+    size_t gpuTimeBytes;
+    size_t gpuBatchSlotBytes;
+
+    size_t cpuBytes() const {
+        return vertexBytes + colorBytes + timeBytes + stringBytes + pickingBytes + permutationBytes;
+    }
+    size_t gpuBytes() const {
+        return gpuVertexBytes + gpuColorBytes + gpuTimeBytes + gpuBatchSlotBytes;
+    }
+};
 
 class GLModel {
 public:
     int id;
-    std::vector<std::string*>* drawStyles;
     std::string name;
     std::vector<std::string> stringReps;
-    GLuint colorBuffer;
-    GLuint vertexBuffer;
+    // Zero for layers whose data lives in the arena.
+    GLuint colorBuffer = 0;
+    GLuint vertexBuffer = 0;
     GLuint drawType;
 
+    // When set, vertex and color data live in ranges of the engine's arena
+    // instead of dedicated buffers.
+    BufferArena* arena;
+    int vertexAllocation;
+    int colorAllocation;
+
     int numVertices;
     int numComponents;
     int stride;
@@ -32,6 +69,15 @@ public:
     int useColorData;
     bool bufferInitialized;
     bool pickingEnabled;
+    // Set while the vertices live in a shared GLBatch instead of own buffers.
+    bool batched;
+    // Set while the engine's BufferLoader fills the layer's buffers; the
+    // layer is not drawn or picked until they are adopted.
+    bool uploadPending;
+
+    // Storage position -> caller's vertex index, empty when the layer kept
+    // the caller's order. Picking results and stringReps use caller indices.
+    std::vector<unsigned int> permutation;
 
     std::vector<DataPoint>* idxVertices;
     VpTree<DataPoint, euclidean_distance>* tree_index;
@@ -48,32 +94,85 @@ public:
         int useColorData,
         int id,
         std::vector<std::string> stringReps,
-        bool pickingEnabled
+        bool pickingEnabled,
+        int spatialOrder = SPATIAL_ORDER_NONE,
+        std::vector<unsigned int> order = std::vector<unsigned int>()
     );
 
-    ~GLModel();
-    void initBuffer();
-    void bindVertexBuffer();
-    virtual void render(GLuint shaderProgram);
+    virtual ~GLModel();
+    static const char* drawStyleName(GLuint drawType);
+    int originalIndex(int storageIndex);
+    // The caller's index of the pickable vertex nearest to point (3 floats,
+    // in data coordinates), as picking under the cursor finds it; -1
+    // without picking.
+    int nearestIndex(const float* point);
+    virtual void initBuffer();
+    virtual void releaseBuffers();
+    virtual void dropBuffers();
+    const void* bindVertexBuffer();
+    const void* bindColorBuffer();
+    virtual LayerMemoryStats memoryStats();
+    // Grows lower and upper (3 floats each) to cover the layer's vertices.
+    virtual void extendBounds(float* lower, float* upper);
+    // Seconds until the layer needs to be drawn again on its own, or a
+    // negative value when it only changes in response to input.
+    virtual double nextFrameDelay(double now);
+    // Animated layers follow the engine's Timeline: they report the span
+    // and step of their times, and are handed the playhead (with the
+    // fraction of a time unit it has advanced past position) before each
+    // frame. Static layers have no times and return false.
+    virtual bool timeRange(long* first, long* last, long* step);
+    virtual void seekClock(long position, double fraction);
+    // Animated layers can show fixed time windows instead of following
+    // playback; static layers have no times and return false.
+    virtual bool setTimeWindows(const std::vector<TimeWindow>& windows, float fade);
+    // False for points hidden by a time window, which picking skips. Takes
+    // the caller's index, like picking results.
+    virtual bool pickable(int index);
+    virtual bool batchable();
+    // Whether the BufferLoader may upload the layer: only plain vertex and
+    // color data qualify.
+    virtual bool backgroundUpload();
+    // Takes over dedicated buffers filled by the BufferLoader.
+    void adoptBuffers(GLuint vertexBuffer, GLuint colorBuffer);
+    // The ShaderFeature mask of the program render() draws with.
+    virtual unsigned int shaderFeatures();
+    // The layer's uniforms for this frame, gathered before any layer draws.
+    virtual void layerUniforms(LayerUniforms* uniforms);
+    virtual void renderUI();
+    // Draws with the program and Layer uniforms bound by GLBoilerPlate.
+    virtual void render();
 };
 
 class GLModelAnimated: public GLModel {
 public:
-    int endStep;
-    unsigned int curIndex;
     unsigned int stepSize;
     unsigned int windowSize;
     unsigned int windowSteps;
-    unsigned int* startOffsets;
-    unsigned int* endOffsets;
 
+    // Sorted copy of the caller's times; vertices are stored in the same
+    // order, so every step is a contiguous range found by searching here.
     long* timeData;
+    long minTime;
+    long maxTime;
     long numSteps;
+    // Data time at the engine's playhead; the playback window shows
+    // windowSteps steps plus windowSize from there on.
+    long playhead;
 
-    float fps;
-    bool paused;
-
-    double time;
+    // The GPU gets each time as a 32 bit offset from minTime, shifted right
+    // by timeShift when the span needs more bits (window edges are then
+    // exact to 2^timeShift units). The shader hides vertices outside the
+    // windows and, when timeFade > 0, fades older ones within a window.
+    // Without fixed windows the one window follows playback.
+    int timeShift;
+    GLuint timeBuffer;
+    int timeAllocation;
+    std::vector<TimeWindow> timeWindows;
+    float timeFade;
+    // Caller index -> storage position, built on the first pick of a layer
+    // whose times were sorted.
+    std::vector<unsigned int> storagePositions;
 
     GLModelAnimated(
         const float* vertexData,
@@ -94,8 +193,93 @@ public:
     );
 
     ~GLModelAnimated();
-    void timeUpdate(int next);
-    void render(GLuint shaderProgram);
+    std::vector<TimeWindow> visibleWindows();
+    unsigned int timeOffset(long time);
+    void initBuffer() override;
+    void releaseBuffers() override;
+    void dropBuffers() override;
+    LayerMemoryStats memoryStats() override;
+    bool timeRange(long* first, long* last, long* step) override;
+    void seekClock(long position, double fraction) override;
+    bool setTimeWindows(const std::vector<TimeWindow>& windows, float fade) override;
+    bool pickable(int index) override;
+    bool batchable() override;
+    bool backgroundUpload() override;
+    unsigned int shaderFeatures() override;
+    void layerUniforms(LayerUniforms* uniforms) override;
+    void renderUI() override;
+    void render() override;
     void createTimeSteps();
 };
+
+// Entity tracks: every sample carries an entity id and a time, and each
+// entity is drawn as one vertex moving through its samples. Positions are
+// resampled on the CPU at keyframes stepSize apart, exactly when samples
+// fall on that grid, and the shader interpolates between the two keyframes
+// around the playhead, so motion stays smooth however slowly the data is
+// sampled.
+//
+// Two keyframe buffers are used as a ring. While a pair is drawn the one
+// after it is computed on a worker thread, so steady playback only uploads
+// a ready keyframe once per step; seeking computes what it lands on in
+// place.
+class GLModelTracks: public GLModel {
+public:
+    unsigned int stepSize;
+    // Sorted by entity and then time; vertices are stored in the same
+    // order, and entity e owns [entityStarts[e], entityStarts[e + 1]).
+    long* timeData;
+    std::vector<int> entityStarts;
+    int numEntities;
+    long minTime;
+    long maxTime;
+    long numKeyframes;
+    long playhead;
+    double playheadFraction;
+
+    // Keyframe k lives in keyframeBuffers[k % 2] as 4 floats per entity:
+    // the position, and 1 in w when the entity exists at that time.
+    GLuint keyframeBuffers[2];
+    long loadedKeyframes[2];
+    std::future<std::vector<float>> prefetch;
+    long prefetchedKeyframe;
+
+    GLModelTracks(
+        const float* vertexData,
+        int numVertices,
+        int numComponents,
+        int stride,
+        GLuint drawType,
+        unsigned int stepSize,
+        const long* entityIds,
+        const long* timeData,
+        std::string name,
+        const float* color,
+        int id
+    );
+
+    ~GLModelTracks();
+    std::vector<float> keyframe(long index) const;
+    void loadKeyframe(long index);
+    void prefetchKeyframe(long index);
+    // The keyframes either side of the playhead and how far it is from
+    // the first to the second.
+    double keyframeMix(long* from, long* to);
+    void initBuffer() override;
+    void releaseBuffers() override;
+    void dropBuffers() override;
+    LayerMemoryStats memoryStats() override;
+    bool timeRange(long* first, long* last, long* step) override;
+    void seekClock(long position, double fraction) override;
+    bool batchable() override;
+    bool backgroundUpload() override;
+    unsigned int shaderFeatures() override;
+    void layerUniforms(LayerUniforms* uniforms) override;
+    void renderUI() override;
+    void render() override;
+};
+
+// Layers are shared between Python, which created them, and the engine,
+// which draws them; whichever lets go last frees the layer.
+typedef std::map<int, std::shared_ptr<GLModel>> ModelMap;
 #endif //ZENITH_GLMODEL_H
@@ -0,0 +1,402 @@
+#ifndef ZENITH_CPP_GLMODELSTREAMED_CPP_
+#define ZENITH_CPP_GLMODELSTREAMED_CPP_
+
+#include "GLModelStreamed.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include "Parallel.hpp"
+#include "TimeIndex.hpp"
+
+GLModelStreamed::GLModelStreamed(
+    int numComponents,
+    GLuint drawType,
+    unsigned int stepSize,
+    unsigned int windowSize,
+    size_t chunkPoints,
+    std::string name,
+    const float* color,
+    int id
+): GLModel::GLModel(nullptr, 0, numComponents, 0, drawType, name, color, nullptr, 0, id,
+                   std::vector<std::string>(), false) {
+    this->stepSize = stepSize > 0 ? stepSize : 1;
+    this->windowSize = windowSize;
+    this->windowSteps = 1;
+    // Multiples of 6 keep GL_LINES pairs and GL_TRIANGLES triples from
+    // straddling two chunks.
+    this->chunkPoints = std::max((chunkPoints + 5) / 6 * 6, (size_t) 6);
+    this->lookahead = 2;
+    this->numSamples = 0;
+    this->numChunks = 0;
+    this->samples = nullptr;
+    this->sampleTimes = nullptr;
+    this->minTime = 0;
+    this->maxTime = 0;
+    this->numSteps = 1;
+    this->playhead = 0;
+    this->direction = 1;
+    for (int c = 0; c < 3; c++) {
+        this->lower[c] = 0.0f;
+        this->upper[c] = 0.0f;
+    }
+    this->uploadedBytes = 0;
+    this->stopping = false;
+}
+
+GLModelStreamed::~GLModelStreamed() {
+    if (this->prefetcher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(this->prefetchMutex);
+            this->stopping = true;
+        }
+        this->prefetchWanted.notify_all();
+        this->prefetcher.join();
+    }
+    // The base destructor can't reach the ring through the override.
+    if (this->bufferInitialized && this->arena == nullptr)
+        this->releaseBuffers();
+}
+
+bool GLModelStreamed::loadSamples(const float* vertices, const long* times, size_t count) {
+    this->ownedSamples.assign(vertices, vertices + count * this->numComponents);
+    this->ownedTimes.assign(times, times + count);
+    this->samples = this->ownedSamples.data();
+    this->sampleTimes = this->ownedTimes.data();
+    this->numSamples = count;
+    return prepare();
+}
+
+bool GLModelStreamed::mapFiles(const std::string& vertexPath, const std::string& timePath) {
+    if (!this->vertexFile.open(vertexPath) || !this->timeFile.open(timePath))
+        return false;
+    size_t vertexBytes = sizeof(float) * this->numComponents;
+    if (this->vertexFile.size % vertexBytes != 0 || this->timeFile.size % sizeof(long) != 0
+        || this->vertexFile.size / vertexBytes != this->timeFile.size / sizeof(long)) {
+        fprintf(stderr, "zenith: %s and %s don't hold the same number of samples\n",
+                vertexPath.c_str(), timePath.c_str());
+        return false;
+    }
+    this->samples = (const float*) this->vertexFile.data;
+    this->sampleTimes = (const long*) this->timeFile.data;
+    this->numSamples = this->timeFile.size / sizeof(long);
+    return prepare();
+}
+
+bool GLModelStreamed::prepare() {
+    if (this->numSamples == 0) {
+        fprintf(stderr, "zenith: streamed layer %s has no samples\n", this->name.c_str());
+        return false;
+    }
+    if (!timesSorted(this->sampleTimes, this->numSamples)) {
+        fprintf(stderr, "zenith: streamed layer %s needs its times sorted\n", this->name.c_str());
+        return false;
+    }
+    this->minTime = this->sampleTimes[0];
+    this->maxTime = this->sampleTimes[this->numSamples - 1];
+    this->numSteps = std::max((this->maxTime - this->minTime) / (long) this->stepSize, 1L);
+    this->playhead = this->minTime;
+    this->numChunks = (this->numSamples + this->chunkPoints - 1) / this->chunkPoints;
+
+    // Bounds for fitting the camera, in one parallel pass.
+    int components = std::min(this->numComponents, 3);
+    int workers = parallelWorkers(this->numSamples, 1 << 16);
+    std::vector<float> lowest(3 * workers, std::numeric_limits<float>::max());
+    std::vector<float> highest(3 * workers, -std::numeric_limits<float>::max());
+    parallelFor(0, this->numSamples, 1 << 16, [&](size_t begin, size_t end, int w) {
+        for (size_t i = begin; i < end; i++) {
+            const float* vertex = &this->samples[i * this->numComponents];
+            for (int c = 0; c < components; c++) {
+                lowest[3 * w + c] = std::min(lowest[3 * w + c], vertex[c]);
+                highest[3 * w + c] = std::max(highest[3 * w + c], vertex[c]);
+            }
+        }
+    });
+    for (int c = 0; c < 3; c++) {
+        this->lower[c] = c < components ? lowest[c] : 0.0f;
+        this->upper[c] = c < components ? highest[c] : 0.0f;
+        for (int w = 1; w < workers && c < components; w++) {
+            this->lower[c] = std::min(this->lower[c], lowest[3 * w + c]);
+            this->upper[c] = std::max(this->upper[c], highest[3 * w + c]);
+        }
+    }
+
+    // Samples already in memory need no prefetching.
+    if (this->vertexFile.mapped && !this->prefetcher.joinable())
+        this->prefetcher = std::thread(&GLModelStreamed::prefetchLoop, this);
+    return true;
+}
+
+size_t GLModelStreamed::chunkBegin(long chunk) {
+    return (size_t) chunk * this->chunkPoints;
+}
+
+size_t GLModelStreamed::chunkEnd(long chunk) {
+    return std::min(chunkBegin(chunk) + this->chunkPoints + 1, this->numSamples);
+}
+
+bool GLModelStreamed::chunkWarm(long chunk) {
+    if (!this->vertexFile.mapped)
+        return true;
+    std::lock_guard<std::mutex> lock(this->prefetchMutex);
+    return this->warmChunks.count(chunk) > 0;
+}
+
+// Replaces the prefetch queue with the chunks not yet in memory, in the
+// order given; chunks no longer wanted are forgotten.
+void GLModelStreamed::requestChunks(const std::vector<long>& chunks) {
+    if (!this->prefetcher.joinable())
+        return;
+    bool added = false;
+    {
+        std::lock_guard<std::mutex> lock(this->prefetchMutex);
+        for (auto it = this->warmChunks.begin(); it != this->warmChunks.end();) {
+            if (std::find(chunks.begin(), chunks.end(), *it) == chunks.end())
+                it = this->warmChunks.erase(it);
+            else
+                ++it;
+        }
+        std::deque<long> pending;
+        for (long chunk : chunks) {
+            if (this->warmChunks.count(chunk) == 0)
+                pending.push_back(chunk);
+        }
+        added = pending != this->pendingChunks;
+        this->pendingChunks.swap(pending);
+    }
+    if (added)
+        this->prefetchWanted.notify_one();
+}
+
+void GLModelStreamed::prefetchLoop() {
+    std::unique_lock<std::mutex> lock(this->prefetchMutex);
+    while (!this->stopping) {
+        if (this->pendingChunks.empty()) {
+            this->prefetchWanted.wait(lock);
+            continue;
+        }
+        long chunk = this->pendingChunks.front();
+        this->pendingChunks.pop_front();
+        lock.unlock();
+        size_t begin = chunkBegin(chunk);
+        size_t count = chunkEnd(chunk) - begin;
+        size_t vertexBytes = sizeof(float) * this->numComponents;
+        this->vertexFile.warm(begin * vertexBytes, count * vertexBytes);
+        this->timeFile.warm(begin * sizeof(long), count * sizeof(long));
+        lock.lock();
+        this->warmChunks.insert(chunk);
+    }
+}
+
+GLModelStreamed::Slot* GLModelStreamed::residentSlot(long chunk) {
+    for (auto && slot : this->slots) {
+        if (slot.chunk == chunk)
+            return &slot;
+    }
+    return nullptr;
+}
+
+// A slot for a chunk outside the visible chunks [first, last]: a new one
+// while the ring is smaller than the window plus lookahead, otherwise the
+// one holding the chunk farthest from the window.
+GLModelStreamed::Slot* GLModelStreamed::claimSlot(long first, long last) {
+    size_t capacity = (size_t) (last - first + 1) + this->lookahead;
+    Slot* farthest = nullptr;
+    long farthestDistance = -1;
+    for (auto && slot : this->slots) {
+        if (slot.chunk < 0)
+            return &slot;
+        long distance = slot.chunk < first ? first - slot.chunk : slot.chunk - last;
+        if (distance > farthestDistance) {
+            farthest = &slot;
+            farthestDistance = distance;
+        }
+    }
+    if (this->slots.size() < capacity || farthestDistance <= 0) {
+        Slot slot;
+        glGenBuffers(1, &slot.buffer);
+        slot.chunk = -1;
+        this->slots.push_back(slot);
+        return &this->slots.back();
+    }
+    return farthest;
+}
+
+void GLModelStreamed::upload(Slot* slot, long chunk) {
+    size_t begin = chunkBegin(chunk);
+    size_t values = (chunkEnd(chunk) - begin) * this->numComponents;
+    // Every slot is sized for a whole chunk; respecifying the store lets
+    // the driver hand out fresh memory instead of waiting on earlier draws.
+    GLsizeiptr capacity = sizeof(float) * (GLsizeiptr) (this->chunkPoints + 1) * this->numComponents;
+    glBindBuffer(GL_ARRAY_BUFFER, slot->buffer);
+    glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * values, this->samples + begin * this->numComponents);
+    slot->chunk = chunk;
+    this->uploadedBytes += sizeof(float) * values;
+    RenderCounters::uploadBytes += sizeof(float) * values;
+}
+
+TimeWindow GLModelStreamed::visibleWindow() {
+    TimeWindow window;
+    window.begin = this->playhead;
+    window.end = window.begin + (long) this->windowSteps * (long) this->stepSize + (long) this->windowSize + 1;
+    return window;
+}
+
+void GLModelStreamed::initBuffer() {
+    // The ring fills as playback reaches each chunk.
+    this->bufferInitialized = true;
+}
+
+void GLModelStreamed::releaseBuffers() {
+    if (!this->bufferInitialized)
+        return;
+    for (auto && slot : this->slots) {
+        glDeleteBuffers(1, &slot.buffer);
+    }
+    this->dropBuffers();
+}
+
+void GLModelStreamed::dropBuffers() {
+    this->slots.clear();
+    GLModel::dropBuffers();
+}
+
+LayerMemoryStats GLModelStreamed::memoryStats() {
+    // Mapped files live in the page cache, which the kernel reclaims as it
+    // needs; only copies the layer owns count against the CPU budget.
+    LayerMemoryStats stats = LayerMemoryStats();
+    stats.vertexBytes = sizeof(float) * this->ownedSamples.capacity();
+    stats.timeBytes = sizeof(long) * this->ownedTimes.capacity();
+    for (auto && slot : this->slots) {
+        if (slot.chunk >= 0)
+            stats.gpuVertexBytes += sizeof(float) * (this->chunkPoints + 1) * this->numComponents;
+    }
+    return stats;
+}
+
+void GLModelStreamed::extendBounds(float* lower, float* upper) {
+    if (this->numSamples == 0)
+        return;
+    for (int c = 0; c < 3; c++) {
+        lower[c] = std::min(lower[c], this->lower[c]);
+        upper[c] = std::max(upper[c], this->upper[c]);
+    }
+}
+
+bool GLModelStreamed::timeRange(long* first, long* last, long* step) {
+    if (this->numSamples == 0)
+        return false;
+    *first = this->minTime;
+    *last = this->maxTime;
+    *step = (long) this->stepSize;
+    return true;
+}
+
+void GLModelStreamed::seekClock(long position, double fraction) {
+    // A jump back of more than half the span is a loop, not a rewind.
+    if (position > this->playhead)
+        this->direction = 1;
+    else if (position < this->playhead && this->playhead - position < (this->maxTime - this->minTime) / 2)
+        this->direction = -1;
+    this->playhead = position;
+}
+
+bool GLModelStreamed::batchable() {
+    return false;
+}
+
+// Chunks are already uploaded as playback reaches them.
+bool GLModelStreamed::backgroundUpload() {
+    return false;
+}
+
+void GLModelStreamed::renderUI() {
+    ImGui::Begin("Animated Models");
+    ImGui::PushID(this->id);
+    ImGui::BeginChild(this->name.c_str(), ImVec2(450, 110));
+    ImGui::Text(
+        "Model Name: %s, Samples: %zu, draw-type: %s",
+        this->name.c_str(),
+        this->numSamples,
+        drawStyleName(this->drawType)
+    );
+    ImGui::Text("Resident chunks: %zu of %zu", this->slots.size(), this->numChunks);
+    ImGui::ColorEdit4(this->name.c_str(), this->color);
+    ImGui::SliderFloat("size", &size, 0.0f, 40.0f);
+    ImGui::SliderInt("Window Steps", (int *) &this->windowSteps, 1, (int) std::min(this->numSteps, 1000L));
+    ImGui::EndChild();
+    ImGui::PopID();
+    ImGui::End();
+}
+
+void GLModelStreamed::render() {
+    if (!this->bufferInitialized)
+        this->initBuffer();
+    if (this->numSamples == 0)
+        return;
+
+    TimeWindow window = visibleWindow();
+    size_t start = firstTimeAfter(this->sampleTimes, this->numSamples, window.begin - 1);
+    size_t stop = firstTimeAfter(this->sampleTimes, this->numSamples, window.end - 1);
+    long first = (long) std::min(start / this->chunkPoints, this->numChunks - 1);
+    long last = stop > start ? (long) ((stop - 1) / this->chunkPoints) : first;
+    std::vector<long> wanted;
+    for (long chunk = first; chunk <= last; chunk++) {
+        wanted.push_back(chunk);
+    }
+    std::vector<long> ahead;
+    for (size_t i = 1; i <= this->lookahead; i++) {
+        long chunk = this->direction >= 0 ? last + (long) i : first - (long) i;
+        if (chunk >= 0 && chunk < (long) this->numChunks)
+            ahead.push_back(chunk);
+    }
+    wanted.insert(wanted.end(), ahead.begin(), ahead.end());
+    requestChunks(wanted);
+
+    glEnableVertexAttribArray(0);
+    for (long chunk = first; chunk <= last && stop > start; chunk++) {
+        Slot* slot = residentSlot(chunk);
+        if (slot == nullptr) {
+            slot = claimSlot(first, last);
+            upload(slot, chunk);
+        }
+        size_t begin = chunkBegin(chunk);
+        // Whole primitives only: the window may start or end inside one.
+        size_t primitive = this->drawType == GL_LINES ? 2 : this->drawType == GL_TRIANGLES ? 3 : 1;
+        size_t drawFrom = begin + (std::max(start, begin) - begin + primitive - 1) / primitive * primitive;
+        // Strips also draw the sample shared with the next chunk.
+        size_t drawTo = std::min(stop, begin + this->chunkPoints + (this->drawType == GL_LINE_STRIP ? 1 : 0));
+        if (drawTo <= drawFrom)
+            continue;
+        drawTo = drawFrom + (drawTo - drawFrom) / primitive * primitive;
+        glBindBuffer(GL_ARRAY_BUFFER, slot->buffer);
+        glVertexAttribPointer(0, this->numComponents, GL_FLOAT, GL_FALSE, 0, nullptr);
+        glDrawArrays(this->drawType, (GLint) (drawFrom - begin), (GLsizei) (drawTo - drawFrom));
+        RenderCounters::drawCalls++;
+        RenderCounters::vertices += drawTo - drawFrom;
+    }
+    RenderCounters::culledVertices += this->numSamples - (stop > start ? stop - start : 0);
+    glDisableVertexAttribArray(0);
+
+    // Keep one chunk ahead of need per frame, once it is in memory.
+    for (long chunk : ahead) {
+        if (residentSlot(chunk) == nullptr && chunkWarm(chunk)) {
+            upload(claimSlot(first, last), chunk);
+            break;
+        }
+    }
+
+    // Give slots back when the window shrinks.
+    size_t capacity = (size_t) (last - first + 1) + this->lookahead;
+    for (size_t i = 0; i < this->slots.size() && this->slots.size() > capacity;) {
+        long chunk = this->slots[i].chunk;
+        if (chunk < first - (long) this->lookahead || chunk > last + (long) this->lookahead) {
+            glDeleteBuffers(1, &this->slots[i].buffer);
+            this->slots.erase(this->slots.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef ZENITH_CPP_GLMODELSTREAMED_HPP_
+#define ZENITH_CPP_GLMODELSTREAMED_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "GLModel.hpp"
+#include "MappedFile.hpp"
+
+// Animated layer for series too long to keep on the GPU. Samples stay in
+// RAM, or in files mapped from disk, sorted by time and cut into chunks of
+// chunkPoints; only the chunks the playback window touches are resident,
+// in a ring of GPU buffers sized to the window plus lookahead chunks.
+//
+// A prefetch thread pulls the chunks just ahead of the play direction in
+// from disk, so the render thread only ever copies resident memory, and
+// each frame uploads at most one chunk ahead of need. Consecutive chunks
+// share a sample, which keeps line strips joined across them; loops, fans
+// and triangle strips can't be split into chunks at all.
+class GLModelStreamed: public GLModel {
+public:
+    unsigned int stepSize;
+    unsigned int windowSize;
+    unsigned int windowSteps;
+    size_t chunkPoints;
+    size_t lookahead;
+
+    size_t numSamples;
+    size_t numChunks;
+    const float* samples;
+    const long* sampleTimes;
+    std::vector<float> ownedSamples;
+    std::vector<long> ownedTimes;
+    MappedFile vertexFile;
+    MappedFile timeFile;
+
+    long minTime;
+    long maxTime;
+    long numSteps;
+    long playhead;
+    // +1 while time moves forward, -1 while it moves back.
+    int direction;
+    float lower[3];
+    float upper[3];
+
+    struct Slot {
+        GLuint buffer;
+        long chunk;
+    };
+    std::vector<Slot> slots;
+    size_t uploadedBytes;
+
+    GLModelStreamed(
+        int numComponents,
+        GLuint drawType,
+        unsigned int stepSize,
+        unsigned int windowSize,
+        size_t chunkPoints,
+        std::string name,
+        const float* color,
+        int id
+    );
+
+    ~GLModelStreamed();
+    // Copies count samples into memory the layer owns.
+    bool loadSamples(const float* vertices, const long* times, size_t count);
+    // Maps a file of numComponents float32 values per sample and one of
+    // int64 times. Times must already be sorted.
+    bool mapFiles(const std::string& vertexPath, const std::string& timePath);
+    TimeWindow visibleWindow();
+    void initBuffer() override;
+    void releaseBuffers() override;
+    void dropBuffers() override;
+    LayerMemoryStats memoryStats() override;
+    void extendBounds(float* lower, float* upper) override;
+    bool timeRange(long* first, long* last, long* step) override;
+    void seekClock(long position, double fraction) override;
+    bool batchable() override;
+    bool backgroundUpload() override;
+    void renderUI() override;
+    void render() override;
+
+private:
+    std::thread prefetcher;
+    std::mutex prefetchMutex;
+    std::condition_variable prefetchWanted;
+    std::deque<long> pendingChunks;
+    std::set<long> warmChunks;
+    bool stopping;
+
+    bool prepare();
+    size_t chunkBegin(long chunk);
+    size_t chunkEnd(long chunk);
+    bool chunkWarm(long chunk);
+    void requestChunks(const std::vector<long>& chunks);
+    void prefetchLoop();
+    Slot* residentSlot(long chunk);
+    Slot* claimSlot(long first, long last);
+    void upload(Slot* slot, long chunk);
+};
+
+#endif  // ZENITH_CPP_GLMODELSTREAMED_HPP_
@@ -0,0 +1,27 @@
+#ifndef ZENITH_CPP_GLFWLIBRARY_CPP_
+#define ZENITH_CPP_GLFWLIBRARY_CPP_
+
+#include "GlfwLibrary.hpp"
+#include <mutex>
+#include <GLFW/glfw3.h>
+
+static std::mutex glfwMutex;
+static int glfwUsers = 0;
+
+bool acquireGlfw() {
+    std::lock_guard<std::mutex> lock(glfwMutex);
+    if (glfwUsers == 0 && !glfwInit())
+        return false;
+    glfwUsers++;
+    return true;
+}
+
+void releaseGlfw() {
+    std::lock_guard<std::mutex> lock(glfwMutex);
+    if (glfwUsers == 0)
+        return;
+    if (--glfwUsers == 0)
+        glfwTerminate();
+}
+
+#endif
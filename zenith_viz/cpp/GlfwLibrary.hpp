@@ -0,0 +1,11 @@
+#ifndef ZENITH_CPP_GLFWLIBRARY_HPP_
+#define ZENITH_CPP_GLFWLIBRARY_HPP_
+
+// GLFW is initialized once per process, but the windows and headless
+// contexts of several plots come and go independently, and glfwTerminate
+// destroys every window left. Each user acquires the library and releases
+// it when its window is gone; the last release terminates it.
+bool acquireGlfw();
+void releaseGlfw();
+
+#endif  // ZENITH_CPP_GLFWLIBRARY_HPP_
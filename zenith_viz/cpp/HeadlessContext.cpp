@@ -0,0 +1,301 @@
+#ifndef ZENITH_CPP_HEADLESSCONTEXT_CPP_
+#define ZENITH_CPP_HEADLESSCONTEXT_CPP_
+
+#include "HeadlessContext.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "glad/gl.h"
+#include <GLFW/glfw3.h>
+#include "GlfwLibrary.hpp"
+
+#ifdef __linux__
+#include <dlfcn.h>
+#include <map>
+#include <mutex>
+
+// Just the slice of EGL used here, so building needs no EGL headers.
+typedef void (*EglProc)();
+typedef EglProc (*EglGetProcAddress)(const char* name);
+typedef void* (*EglGetDisplay)(void* nativeDisplay);
+typedef void* (*EglGetPlatformDisplay)(unsigned int platform, void* nativeDisplay, const int32_t* attribs);
+typedef unsigned int (*EglInitialize)(void* display, int32_t* major, int32_t* minor);
+typedef unsigned int (*EglTerminate)(void* display);
+typedef unsigned int (*EglBindAPI)(unsigned int api);
+typedef unsigned int (*EglChooseConfig)(void* display, const int32_t* attribs, void** configs, int32_t size, int32_t* count);
+typedef void* (*EglCreateContext)(void* display, void* config, void* share, const int32_t* attribs);
+typedef unsigned int (*EglDestroyContext)(void* display, void* context);
+typedef unsigned int (*EglMakeCurrent)(void* display, void* draw, void* read, void* context);
+
+static const unsigned int EGL_PLATFORM_SURFACELESS_MESA = 0x31DD;
+static const unsigned int EGL_OPENGL_API = 0x30A2;
+static const int32_t EGL_NONE = 0x3038;
+static const int32_t EGL_SURFACE_TYPE = 0x3033;
+static const int32_t EGL_PBUFFER_BIT = 0x0001;
+static const int32_t EGL_RENDERABLE_TYPE = 0x3040;
+static const int32_t EGL_OPENGL_BIT = 0x0008;
+static const int32_t EGL_CONTEXT_MAJOR_VERSION = 0x3098;
+static const int32_t EGL_CONTEXT_MINOR_VERSION = 0x30FB;
+static const int32_t EGL_CONTEXT_OPENGL_PROFILE_MASK = 0x30FD;
+static const int32_t EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT = 0x0001;
+
+static EglGetProcAddress getEglProcAddress = nullptr;
+
+// Every context gets the same display from EGL, and eglTerminate ends it for
+// all of them, so it is only terminated along with its last context.
+static std::mutex eglDisplayMutex;
+static std::map<void*, int> eglDisplayUsers;
+
+static bool initializeDisplay(void* display, EglInitialize initialize) {
+    std::lock_guard<std::mutex> lock(eglDisplayMutex);
+    int32_t major = 0;
+    int32_t minor = 0;
+    if (!initialize(display, &major, &minor))
+        return false;
+    eglDisplayUsers[display]++;
+    return true;
+}
+
+// True when the caller held the last reference and should terminate it.
+static bool releaseDisplay(void* display) {
+    std::lock_guard<std::mutex> lock(eglDisplayMutex);
+    auto found = eglDisplayUsers.find(display);
+    if (found == eglDisplayUsers.end() || --found->second > 0)
+        return false;
+    eglDisplayUsers.erase(found);
+    return true;
+}
+
+template <typename T>
+static T eglFunction(void* library, const char* name) {
+    return reinterpret_cast<T>(dlsym(library, name));
+}
+
+static GLADapiproc eglLoader(const char* name) {
+    return reinterpret_cast<GLADapiproc>(getEglProcAddress(name));
+}
+#endif
+
+HeadlessContext::HeadlessContext() {
+    this->window = nullptr;
+    this->eglLibrary = nullptr;
+    this->eglDisplay = nullptr;
+    this->eglContext = nullptr;
+    this->loader = nullptr;
+    this->framebuffer = 0;
+    this->colorBuffer = 0;
+    this->depthBuffer = 0;
+    this->width = 0;
+    this->height = 0;
+}
+
+HeadlessContext::~HeadlessContext() {
+    // GL objects die with the context; Engine calls destroy() while it is
+    // current.
+}
+
+bool HeadlessContext::create() {
+    if (createEGL()) {
+        backend = "egl";
+    } else if (createWindow()) {
+        backend = "glfw";
+    } else {
+        fprintf(stderr, "zenith: could not create an offscreen GL 3.3 context\n");
+        return false;
+    }
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &colorBuffer);
+    glGenRenderbuffers(1, &depthBuffer);
+    return true;
+}
+
+bool HeadlessContext::createEGL() {
+#ifdef __linux__
+    eglLibrary = dlopen("libEGL.so.1", RTLD_NOW | RTLD_LOCAL);
+    if (eglLibrary == nullptr)
+        return false;
+    getEglProcAddress = eglFunction<EglGetProcAddress>(eglLibrary, "eglGetProcAddress");
+    auto getDisplay = eglFunction<EglGetDisplay>(eglLibrary, "eglGetDisplay");
+    auto initialize = eglFunction<EglInitialize>(eglLibrary, "eglInitialize");
+    auto bindAPI = eglFunction<EglBindAPI>(eglLibrary, "eglBindAPI");
+    auto chooseConfig = eglFunction<EglChooseConfig>(eglLibrary, "eglChooseConfig");
+    auto createContext = eglFunction<EglCreateContext>(eglLibrary, "eglCreateContext");
+    auto makeCurrent = eglFunction<EglMakeCurrent>(eglLibrary, "eglMakeCurrent");
+    if (!getEglProcAddress || !getDisplay || !initialize || !bindAPI
+        || !chooseConfig || !createContext || !makeCurrent) {
+        dlclose(eglLibrary);
+        eglLibrary = nullptr;
+        return false;
+    }
+
+    auto getPlatformDisplay = reinterpret_cast<EglGetPlatformDisplay>(
+        getEglProcAddress("eglGetPlatformDisplayEXT"));
+    if (getPlatformDisplay != nullptr) {
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, nullptr, nullptr);
+        if (eglDisplay != nullptr && !initializeDisplay(eglDisplay, initialize))
+            eglDisplay = nullptr;
+    }
+    if (eglDisplay == nullptr) {
+        eglDisplay = getDisplay(nullptr);
+        if (eglDisplay != nullptr && !initializeDisplay(eglDisplay, initialize))
+            eglDisplay = nullptr;
+    }
+    if (eglDisplay == nullptr || !bindAPI(EGL_OPENGL_API)) {
+        destroy();
+        return false;
+    }
+
+    // Surfaceless displays may offer no configs at all; a context without
+    // one (EGL_KHR_no_config_context) works as long as nothing is drawn to
+    // a window surface, which is the point here.
+    const int32_t configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    void* config = nullptr;
+    int32_t numConfigs = 0;
+    if (!chooseConfig(eglDisplay, configAttribs, &config, 1, &numConfigs) || numConfigs < 1)
+        config = nullptr;
+
+    const int32_t contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    eglContext = createContext(eglDisplay, config, nullptr, contextAttribs);
+    if (eglContext == nullptr || !makeCurrent(eglDisplay, nullptr, nullptr, eglContext)
+        || !gladLoadGL(eglLoader)) {
+        destroy();
+        return false;
+    }
+    loader = eglLoader;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool HeadlessContext::createWindow() {
+    if (!acquireGlfw())
+        return false;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    window = glfwCreateWindow(16, 16, "Zenith", nullptr, nullptr);
+    glfwDefaultWindowHints();
+    if (window == nullptr) {
+        releaseGlfw();
+        return false;
+    }
+    glfwMakeContextCurrent(window);
+    gladLoadGL(glfwGetProcAddress);
+    loader = glfwGetProcAddress;
+    return true;
+}
+
+bool HeadlessContext::makeCurrent() {
+#ifdef __linux__
+    if (eglContext != nullptr) {
+        auto makeCurrent = eglFunction<EglMakeCurrent>(eglLibrary, "eglMakeCurrent");
+        return makeCurrent(eglDisplay, nullptr, nullptr, eglContext) != 0;
+    }
+#endif
+    if (window == nullptr)
+        return false;
+    glfwMakeContextCurrent(window);
+    return true;
+}
+
+void HeadlessContext::doneCurrent() {
+#ifdef __linux__
+    if (eglContext != nullptr) {
+        auto makeCurrent = eglFunction<EglMakeCurrent>(eglLibrary, "eglMakeCurrent");
+        makeCurrent(eglDisplay, nullptr, nullptr, nullptr);
+        return;
+    }
+#endif
+    if (window != nullptr)
+        glfwMakeContextCurrent(nullptr);
+}
+
+bool HeadlessContext::resize(int width, int height) {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    if (width == this->width && height == this->height)
+        return true;
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "zenith: offscreen framebuffer of %dx%d is incomplete\n", width, height);
+        this->width = 0;
+        this->height = 0;
+        return false;
+    }
+    this->width = width;
+    this->height = height;
+    return true;
+}
+
+void HeadlessContext::readPixels(unsigned char* rgba) {
+    size_t rowBytes = 4 * (size_t) width;
+    std::vector<unsigned char> flipped(rowBytes * height);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, flipped.data());
+    // GL rows start at the bottom; images start at the top.
+    for (int row = 0; row < height; row++) {
+        memcpy(rgba + rowBytes * row, flipped.data() + rowBytes * (height - 1 - row), rowBytes);
+    }
+}
+
+void HeadlessContext::releaseFramebuffer() {
+    if (framebuffer != 0)
+        glDeleteFramebuffers(1, &framebuffer);
+    if (colorBuffer != 0)
+        glDeleteRenderbuffers(1, &colorBuffer);
+    if (depthBuffer != 0)
+        glDeleteRenderbuffers(1, &depthBuffer);
+    framebuffer = 0;
+    colorBuffer = 0;
+    depthBuffer = 0;
+    width = 0;
+    height = 0;
+}
+
+void HeadlessContext::destroy() {
+    if (eglContext != nullptr || window != nullptr)
+        releaseFramebuffer();
+#ifdef __linux__
+    if (eglLibrary != nullptr) {
+        auto makeCurrent = eglFunction<EglMakeCurrent>(eglLibrary, "eglMakeCurrent");
+        auto destroyContext = eglFunction<EglDestroyContext>(eglLibrary, "eglDestroyContext");
+        auto terminate = eglFunction<EglTerminate>(eglLibrary, "eglTerminate");
+        if (eglContext != nullptr) {
+            makeCurrent(eglDisplay, nullptr, nullptr, nullptr);
+            destroyContext(eglDisplay, eglContext);
+        }
+        if (eglDisplay != nullptr && releaseDisplay(eglDisplay))
+            terminate(eglDisplay);
+        dlclose(eglLibrary);
+    }
+#endif
+    eglLibrary = nullptr;
+    eglDisplay = nullptr;
+    eglContext = nullptr;
+    if (window != nullptr) {
+        glfwDestroyWindow(window);
+        releaseGlfw();
+        window = nullptr;
+    }
+}
+
+#endif
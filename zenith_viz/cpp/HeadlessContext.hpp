@@ -0,0 +1,52 @@
+#ifndef ZENITH_CPP_HEADLESSCONTEXT_HPP_
+#define ZENITH_CPP_HEADLESSCONTEXT_HPP_
+
+#include <string>
+#include "glad/gl.h"
+#include <GLFW/glfw3.h>
+
+// GL 3.3 core context that draws into a framebuffer object instead of a
+// window, for rendering without a display. On Linux it first tries EGL,
+// loaded with dlopen so there is no link-time dependency: Mesa's
+// surfaceless platform (llvmpipe included), then the default display.
+// Otherwise, and on other platforms, it falls back to an invisible GLFW
+// window.
+//
+// The context is only current between makeCurrent() and doneCurrent(), so
+// successive renders may come from different threads, one at a time.
+class HeadlessContext {
+ public:
+    std::string backend;
+    GLFWwindow* window;
+    void* eglLibrary;
+    void* eglDisplay;
+    void* eglContext;
+    // The GL function loader for this context.
+    GLADloadfunc loader;
+    GLuint framebuffer;
+    GLuint colorBuffer;
+    GLuint depthBuffer;
+    int width;
+    int height;
+
+    HeadlessContext();
+    ~HeadlessContext();
+    // Creates the context and leaves it current.
+    bool create();
+    bool makeCurrent();
+    void doneCurrent();
+    // (Re)allocates the color and depth attachments and binds the
+    // framebuffer; a no-op when the size is unchanged.
+    bool resize(int width, int height);
+    // Copies the color attachment into rgba, top row first.
+    void readPixels(unsigned char* rgba);
+    // Deletes the framebuffer and the context; must be current.
+    void destroy();
+
+ private:
+    bool createEGL();
+    bool createWindow();
+    void releaseFramebuffer();
+};
+
+#endif  // ZENITH_CPP_HEADLESSCONTEXT_HPP_
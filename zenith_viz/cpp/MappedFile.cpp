@@ -0,0 +1,114 @@
+#ifndef ZENITH_CPP_MAPPEDFILE_CPP_
+#define ZENITH_CPP_MAPPEDFILE_CPP_
+
+#include "MappedFile.hpp"
+#include <algorithm>
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ZENITH_HAVE_MMAP
+#endif
+
+MappedFile::MappedFile() {
+    this->data = nullptr;
+    this->size = 0;
+    this->mapped = false;
+    this->mapping = nullptr;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    this->path = path;
+#ifdef ZENITH_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "zenith: could not open %s\n", path.c_str());
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        fprintf(stderr, "zenith: could not stat %s\n", path.c_str());
+        return false;
+    }
+    this->size = (size_t) info.st_size;
+    if (this->size > 0) {
+        void* region = mmap(nullptr, this->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (region == MAP_FAILED) {
+            ::close(fd);
+            this->size = 0;
+            fprintf(stderr, "zenith: could not map %s\n", path.c_str());
+            return false;
+        }
+        // Playback reads forward through the file.
+        madvise(region, this->size, MADV_SEQUENTIAL);
+        this->mapping = region;
+        this->data = (const unsigned char*) region;
+        this->mapped = true;
+    }
+    // The mapping keeps the file alive.
+    ::close(fd);
+    return true;
+#else
+    std::FILE* stream = std::fopen(path.c_str(), "rb");
+    if (stream == nullptr) {
+        fprintf(stderr, "zenith: could not open %s\n", path.c_str());
+        return false;
+    }
+    unsigned char buffer[1 << 16];
+    size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), stream)) > 0) {
+        this->contents.insert(this->contents.end(), buffer, buffer + read);
+    }
+    bool failed = std::ferror(stream) != 0;
+    std::fclose(stream);
+    if (failed) {
+        this->contents.clear();
+        fprintf(stderr, "zenith: could not read %s\n", path.c_str());
+        return false;
+    }
+    this->data = this->contents.data();
+    this->size = this->contents.size();
+    return true;
+#endif
+}
+
+void MappedFile::warm(size_t offset, size_t length) const {
+#ifdef ZENITH_HAVE_MMAP
+    if (!this->mapped || offset >= this->size)
+        return;
+    length = std::min(length, this->size - offset);
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t begin = offset / page * page;
+    madvise((void*) (this->data + begin), offset + length - begin, MADV_WILLNEED);
+    // WILLNEED only starts the reads; touching each page waits for them.
+    volatile unsigned char sink = 0;
+    for (size_t at = begin; at < offset + length; at += page) {
+        sink += this->data[at];
+    }
+    (void) sink;
+#endif
+}
+
+void MappedFile::close() {
+#ifdef ZENITH_HAVE_MMAP
+    if (this->mapping != nullptr)
+        munmap(this->mapping, this->size);
+#endif
+    this->mapping = nullptr;
+    this->contents.clear();
+    this->contents.shrink_to_fit();
+    this->data = nullptr;
+    this->size = 0;
+    this->mapped = false;
+}
+
+#endif
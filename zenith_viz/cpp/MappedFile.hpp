@@ -0,0 +1,31 @@
+#ifndef ZENITH_CPP_MAPPEDFILE_HPP_
+#define ZENITH_CPP_MAPPEDFILE_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. On POSIX systems the file is mapped, so
+// pages are read from disk on first touch and the kernel can drop them
+// again under memory pressure; elsewhere the file is read into memory.
+class MappedFile {
+ public:
+    std::string path;
+    const unsigned char* data;
+    size_t size;
+    bool mapped;
+
+    MappedFile();
+    ~MappedFile();
+    bool open(const std::string& path);
+    // Pulls [offset, offset + length) into memory, so a later read of it
+    // doesn't wait on the disk. Returns at once for files read into memory.
+    void warm(size_t offset, size_t length) const;
+    void close();
+
+ private:
+    void* mapping;
+    std::vector<unsigned char> contents;
+};
+
+#endif  // ZENITH_CPP_MAPPEDFILE_HPP_
@@ -0,0 +1,63 @@
+#ifndef ZENITH_CPP_PARALLEL_CPP_
+#define ZENITH_CPP_PARALLEL_CPP_
+
+#include "Parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+static int defaultThreadCount() {
+    const char* env = getenv("ZENITH_THREADS");
+    if (env != nullptr && atoi(env) > 0) {
+        return atoi(env);
+    }
+    int hw = static_cast<int>(std::thread::hardware_concurrency());
+    return hw > 0 ? hw : 1;
+}
+
+static std::atomic<int> threadCount(defaultThreadCount());
+
+int parallelThreadCount() {
+    return threadCount.load();
+}
+
+void setParallelThreadCount(int threads) {
+    threadCount.store(threads > 0 ? threads : defaultThreadCount());
+}
+
+int parallelWorkers(size_t n, size_t minChunk) {
+    if (minChunk == 0) minChunk = 1;
+    size_t byWork = n / minChunk;
+    size_t workers = std::min(
+        static_cast<size_t>(parallelThreadCount()), byWork);
+    return workers > 1 ? static_cast<int>(workers) : 1;
+}
+
+void parallelFor(
+    size_t begin,
+    size_t end,
+    size_t minChunk,
+    const std::function<void(size_t, size_t, int)>& fn) {
+    if (end <= begin) return;
+    size_t n = end - begin;
+    int workers = parallelWorkers(n, minChunk);
+    if (workers == 1) {
+        fn(begin, end, 0);
+        return;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (int w = 1; w < workers; w++) {
+        size_t lo = begin + n * w / workers;
+        size_t hi = begin + n * (w + 1) / workers;
+        threads.emplace_back(fn, lo, hi, w);
+    }
+    fn(begin, begin + n / workers, 0);
+    for (auto && thread : threads) {
+        thread.join();
+    }
+}
+
+#endif
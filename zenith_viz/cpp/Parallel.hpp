@@ -0,0 +1,24 @@
+#ifndef ZENITH_CPP_PARALLEL_HPP_
+#define ZENITH_CPP_PARALLEL_HPP_
+
+#include <cstddef>
+#include <functional>
+
+// Number of worker threads used by the CPU ingest paths. Defaults to the
+// ZENITH_THREADS environment variable, or the hardware concurrency.
+int parallelThreadCount();
+void setParallelThreadCount(int threads);
+
+// Number of chunks parallelFor will split n items into.
+int parallelWorkers(size_t n, size_t minChunk);
+
+// Runs fn(chunkBegin, chunkEnd, worker) over contiguous chunks of
+// [begin, end). Chunk w always covers the same items for a given range, so
+// callers can size per-worker scratch with parallelWorkers().
+void parallelFor(
+    size_t begin,
+    size_t end,
+    size_t minChunk,
+    const std::function<void(size_t, size_t, int)>& fn);
+
+#endif  // ZENITH_CPP_PARALLEL_HPP_
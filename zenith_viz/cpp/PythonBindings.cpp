@@ -1,14 +1,17 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/numpy.h>
+#include <pybind11/functional.h>
 
 #include "Engine.hpp"
 #include "GLModel.hpp"
+#include "GLModelStreamed.hpp"
+#include "Tracing.hpp"
 
 
 namespace py = pybind11;
 
-GLModel* create_gl_model(
+std::shared_ptr<GLModel> create_gl_model(
     py::array_t<float> vertex_data,
     int num_vertices,
     int num_components,
@@ -20,12 +23,14 @@ GLModel* create_gl_model(
     int use_color_data,
     int id,
     std::vector<std::string> string_reps,
-    bool picking_enabled
+    bool picking_enabled,
+    int spatial_order
 ) {
+    ZENITH_TRACE_ZONE("create_gl_model");
     const float* vertex_data_ptr = static_cast<const float*>(vertex_data.data());
     const float* color_ptr = static_cast<const float*>(color.data());
     const float* color_data_ptr = static_cast<const float*>(color_data.data());
-    auto model = new GLModel(
+    auto model = std::make_shared<GLModel>(
         vertex_data_ptr,
         num_vertices,
         num_components,
@@ -37,13 +42,14 @@ GLModel* create_gl_model(
         use_color_data,
         id,
         string_reps,
-        picking_enabled
+        picking_enabled,
+        spatial_order
     );
     return model;
 }
 
 
-GLModelAnimated* create_gl_model_animated(
+std::shared_ptr<GLModelAnimated> create_gl_model_animated(
     py::array_t<float> vertex_data,
     int num_vertices,
     int num_components,
@@ -60,11 +66,12 @@ GLModelAnimated* create_gl_model_animated(
     std::vector<std::string> string_reps,
     bool picking_enabled
 ) {
+    ZENITH_TRACE_ZONE("create_gl_model_animated");
     const float* vertex_data_ptr = static_cast<const float*>(vertex_data.data());
     const float* color_ptr = static_cast<const float*>(color.data());
     const float* color_data_ptr = static_cast<const float*>(color_data.data());
     const long* time_data_ptr = static_cast<const long*>(time_data.data());
-    auto model = new GLModelAnimated(
+    auto model = std::make_shared<GLModelAnimated>(
         vertex_data_ptr,
         num_vertices,
         num_components,
@@ -84,26 +91,690 @@ GLModelAnimated* create_gl_model_animated(
     return model;
 }
 
+std::shared_ptr<GLModelTracks> create_gl_model_tracks(
+    py::array_t<float> vertex_data,
+    int num_vertices,
+    int num_components,
+    int stride,
+    int draw_type,
+    unsigned int step_size,
+    py::array_t<long> entity_ids,
+    py::array_t<long> time_data,
+    std::string name,
+    py::array_t<float> color,
+    int id
+) {
+    ZENITH_TRACE_ZONE("create_gl_model_tracks");
+    const float* vertex_data_ptr = static_cast<const float*>(vertex_data.data());
+    const float* color_ptr = static_cast<const float*>(color.data());
+    const long* entity_ids_ptr = static_cast<const long*>(entity_ids.data());
+    const long* time_data_ptr = static_cast<const long*>(time_data.data());
+    auto model = std::make_shared<GLModelTracks>(
+        vertex_data_ptr,
+        num_vertices,
+        num_components,
+        stride,
+        draw_type,
+        step_size,
+        entity_ids_ptr,
+        time_data_ptr,
+        name,
+        color_ptr,
+        id
+    );
+    return model;
+}
+
+// Both return None when the samples can't be used; the reason is printed.
+std::shared_ptr<GLModelStreamed> create_gl_model_streamed(
+    py::array_t<float> vertex_data,
+    py::array_t<long> time_data,
+    int num_components,
+    int draw_type,
+    unsigned int step_size,
+    unsigned int window_size,
+    size_t chunk_points,
+    std::string name,
+    py::array_t<float> color,
+    int id
+) {
+    ZENITH_TRACE_ZONE("create_gl_model_streamed");
+    auto model = std::make_shared<GLModelStreamed>(
+        num_components, draw_type, step_size, window_size, chunk_points, name,
+        static_cast<const float*>(color.data()), id);
+    bool loaded = model->loadSamples(
+        static_cast<const float*>(vertex_data.data()),
+        static_cast<const long*>(time_data.data()),
+        (size_t) time_data.size());
+    return loaded ? model : nullptr;
+}
+
+std::shared_ptr<GLModelStreamed> create_gl_model_streamed_from_files(
+    std::string vertex_path,
+    std::string time_path,
+    int num_components,
+    int draw_type,
+    unsigned int step_size,
+    unsigned int window_size,
+    size_t chunk_points,
+    std::string name,
+    py::array_t<float> color,
+    int id
+) {
+    ZENITH_TRACE_ZONE("create_gl_model_streamed_from_files");
+    auto model = std::make_shared<GLModelStreamed>(
+        num_components, draw_type, step_size, window_size, chunk_points, name,
+        static_cast<const float*>(color.data()), id);
+    return model->mapFiles(vertex_path, time_path) ? model : nullptr;
+}
+
+// GPU-side state belongs to the render loop; queries about it run as
+// commands between frames and wait for the answer without holding the GIL.
+template <typename T>
+T query(Engine* engine, std::function<T()> read) {
+    T value = T();
+    CommandFuture future = engine->submit([&value, read]() {
+        value = read();
+        return true;
+    });
+    py::gil_scoped_release release;
+    future.wait(-1.0);
+    return value;
+}
+
+py::dict buffer_stats(Engine* engine) {
+    BufferArenaStats stats = query<BufferArenaStats>(engine, [engine]() { return engine->bufferStats(); });
+    py::dict result;
+    result["blocks"] = stats.blocks;
+    result["allocations"] = stats.allocations;
+    result["reserved_bytes"] = stats.reservedBytes;
+    result["used_bytes"] = stats.usedBytes;
+    result["free_bytes"] = stats.freeBytes;
+    result["largest_free_bytes"] = stats.largestFreeBytes;
+    result["compacted_bytes"] = stats.compactedBytes;
+    result["driver_allocations"] = stats.driverAllocations;
+    // Releases still waiting on a fence; they keep their arena ranges.
+    result["pending_releases"] = query<size_t>(engine, [engine]() { return engine->releaseQueue->pending(); });
+    // Layers the loader thread has yet to hand back; they are not drawn.
+    result["pending_uploads"] = query<size_t>(engine, [engine]() {
+        return engine->loader != nullptr ? engine->loader->pending() : 0;
+    });
+    return result;
+}
+
+// Reads the published snapshot directly: no round trip to the render
+// thread, so it answers at once even while a frame is being drawn.
+py::dict frame_stats(Engine* engine) {
+    FrameStatsSnapshot stats = engine->frameStats.snapshot();
+    const double ms = 1000.0;
+    py::list history;
+    for (auto && seconds : stats.history) {
+        history.append(seconds * ms);
+    }
+    py::dict gpu;
+    for (auto && layer : stats.gpu) {
+        gpu[py::str(layer.name)] = layer.seconds * ms;
+    }
+    py::dict phases;
+    for (int phase = 0; phase < FRAME_PHASES; phase++) {
+        phases[framePhaseName(phase)] = stats.last.phaseSeconds[phase] * ms;
+    }
+    py::list latencies;
+    for (auto && seconds : stats.inputLatencies) {
+        latencies.append(seconds * ms);
+    }
+    py::dict result;
+    result["frames"] = stats.frames;
+    result["frame_ms"] = history;
+    result["last_frame_ms"] = stats.last.seconds * ms;
+    result["phase_ms"] = phases;
+    result["pick_ms"] = stats.last.phaseSeconds[PHASE_PICK] * ms;
+    result["input_latency_ms"] = latencies;
+    result["draw_calls"] = stats.last.drawCalls;
+    result["vertices"] = stats.last.vertices;
+    result["culled_vertices"] = stats.last.culledVertices;
+    result["upload_bytes"] = stats.last.uploadBytes;
+    result["gpu_ms"] = gpu;
+    return result;
+}
+
+py::dict shader_stats(Engine* engine) {
+    ShaderStats stats = query<ShaderStats>(engine, [engine]() { return engine->shaders.stats(); });
+    py::dict result;
+    result["programs"] = stats.programs;
+    result["compiled"] = stats.compiled;
+    result["loaded"] = stats.loaded;
+    result["binds"] = stats.binds;
+    result["binaries"] = stats.binaries;
+    return result;
+}
+
+struct MemoryReport {
+    std::map<int, LayerMemoryStats> layers;
+    std::map<int, std::string> names;
+    size_t gpuReservedBytes;
+};
+
+py::dict memory_stats(Engine* engine) {
+    MemoryReport report = query<MemoryReport>(engine, [engine]() {
+        MemoryReport result;
+        result.layers = engine->memoryStats();
+        std::shared_ptr<const SceneSnapshot> current = engine->sceneSnapshot();
+        for (auto && pair : current->models) {
+            result.names[pair.first] = pair.second->name;
+        }
+        result.gpuReservedBytes = engine->bufferStats().reservedBytes;
+        return result;
+    });
+    py::dict layers;
+    size_t cpuBytes = 0;
+    size_t gpuBytes = 0;
+    for (auto && pair : report.layers) {
+        const LayerMemoryStats& stats = pair.second;
+        py::dict cpu;
+        cpu["vertices"] = stats.vertexBytes;
+        cpu["colors"] = stats.colorBytes;
+        cpu["time"] = stats.timeBytes;
+        cpu["strings"] = stats.stringBytes;
+        cpu["picking"] = stats.pickingBytes;
+        cpu["permutation"] = stats.permutationBytes;
+        py::dict gpu;
+        gpu["vertices"] = stats.gpuVertexBytes;
+        gpu["colors"] = stats.gpuColorBytes;
+        gpu["time"] = stats.gpuTimeBytes;
+        gpu["batch_slots"] = stats.gpuBatchSlotBytes;
+        py::dict layer;
+        layer["name"] = report.names[pair.first];
+        layer["cpu"] = cpu;
+        layer["gpu"] = gpu;
+        layer["cpu_bytes"] = stats.cpuBytes();
+        layer["gpu_bytes"] = stats.gpuBytes();
+        layers[py::int_(pair.first)] = layer;
+        cpuBytes += stats.cpuBytes();
+        gpuBytes += stats.gpuBytes();
+    }
+    py::dict result;
+    result["layers"] = layers;
+    result["cpu_bytes"] = cpuBytes;
+    result["gpu_bytes"] = gpuBytes;
+    result["gpu_reserved_bytes"] = report.gpuReservedBytes;
+    return result;
+}
+
+CommandFuture set_memory_budget(Engine* engine, size_t cpu_bytes, size_t gpu_bytes, py::object callback) {
+    std::function<void(size_t, size_t)> hook;
+    if (!callback.is_none()) {
+        // The hook is copied and dropped on the render thread; only touch
+        // the Python reference count with the GIL held.
+        std::shared_ptr<py::function> function(
+            new py::function(callback.cast<py::function>()),
+            [](py::function* held) {
+                py::gil_scoped_acquire gil;
+                delete held;
+            });
+        hook = [function](size_t cpuBytes, size_t gpuBytes) {
+            py::gil_scoped_acquire gil;
+            // On the render thread nothing above could handle it; report it
+            // the way Python reports errors in finalizers.
+            try {
+                (*function)(cpuBytes, gpuBytes);
+            } catch (py::error_already_set& error) {
+                error.discard_as_unraisable("zenith memory budget callback");
+            }
+        };
+    }
+    return engine->submit([engine, cpu_bytes, gpu_bytes, hook]() {
+        engine->setMemoryBudget(cpu_bytes, gpu_bytes, hook);
+        return true;
+    });
+}
+
+// Layer changes are published as a new scene snapshot right away; the
+// future completes at the next frame boundary, when the render loop picks
+// the snapshot up.
+CommandFuture add_model(Engine* engine, int id, std::shared_ptr<GLModel> model) {
+    bool added = engine->addModel(id, model);
+    return engine->submit([added]() { return added; });
+}
+
+CommandFuture remove_model(Engine* engine, int id) {
+    bool removed = engine->removeModel(id);
+    return engine->submit([removed]() { return removed; });
+}
+
+// Windows are (begin, end) pairs of layer times; an empty list returns the
+// layer to following playback.
+CommandFuture set_time_windows(Engine* engine, int id, std::vector<std::pair<long, long>> windows, float fade) {
+    std::vector<TimeWindow> timeWindows;
+    for (auto && window : windows) {
+        timeWindows.push_back(TimeWindow{window.first, window.second});
+    }
+    return engine->submit([engine, id, timeWindows, fade]() {
+        std::shared_ptr<const SceneSnapshot> current = engine->sceneSnapshot();
+        auto found = current->models.find(id);
+        if (found == current->models.end())
+            return false;
+        bool set = found->second->setTimeWindows(timeWindows, fade);
+        engine->requestRedraw();
+        return set;
+    });
+}
+
+// Arguments left as None keep their current value.
+CommandFuture set_timeline(Engine* engine, py::object position, py::object playing, py::object rate, py::object loop) {
+    bool hasPosition = !position.is_none();
+    long seekTo = hasPosition ? position.cast<long>() : 0;
+    int play = playing.is_none() ? -1 : (int) playing.cast<bool>();
+    double newRate = rate.is_none() ? -1.0 : rate.cast<double>();
+    int looping = loop.is_none() ? -1 : (int) loop.cast<bool>();
+    return engine->submit([engine, hasPosition, seekTo, play, newRate, looping]() {
+        Timeline& timeline = engine->timeline;
+        // Seeks clamp to the layers' extent, which frames only refresh.
+        engine->updateTimelineExtent(engine->sceneSnapshot()->models);
+        if (newRate >= 0.0)
+            timeline.rate = newRate;
+        if (looping >= 0)
+            timeline.loop = looping != 0;
+        if (play >= 0)
+            timeline.play(play != 0);
+        if (hasPosition)
+            timeline.seek(seekTo);
+        engine->requestRedraw();
+        return true;
+    });
+}
+
+py::dict timeline(Engine* engine) {
+    Timeline state = query<Timeline>(engine, [engine]() {
+        engine->updateTimelineExtent(engine->sceneSnapshot()->models);
+        return engine->timeline;
+    });
+    py::dict result;
+    result["position"] = state.position;
+    result["first"] = state.first;
+    result["last"] = state.last;
+    result["rate"] = state.effectiveRate();
+    result["playing"] = state.playing;
+    result["loop"] = state.loop;
+    return result;
+}
+
+CommandFuture set_batching(Engine* engine, bool enabled, int max_vertices) {
+    return engine->submit([engine, enabled, max_vertices]() {
+        engine->setBatching(enabled, max_vertices);
+        return true;
+    });
+}
+
+CommandFuture set_keep_resident(Engine* engine, bool enabled) {
+    return engine->submit([engine, enabled]() {
+        engine->setKeepResident(enabled);
+        return true;
+    });
+}
+
+CommandFuture set_background_uploads(Engine* engine, size_t min_bytes) {
+    return engine->submit([engine, min_bytes]() {
+        engine->setBackgroundUploads(min_bytes);
+        return true;
+    });
+}
+
+CommandFuture set_continuous_rendering(Engine* engine, bool enabled) {
+    return engine->submit([engine, enabled]() {
+        engine->setContinuousRendering(enabled);
+        return true;
+    });
+}
+
+// Keys missing from the camera dict keep the values that fit every layer
+// into the image.
+Camera camera_from(Engine* engine, int width, int height, py::object camera) {
+    Camera result = engine->fitCamera(width, height);
+    if (camera.is_none())
+        return result;
+    py::dict settings = camera.cast<py::dict>();
+    if (settings.contains("center")) {
+        std::vector<float> center = settings["center"].cast<std::vector<float>>();
+        for (size_t i = 0; i < center.size() && i < 3; i++) {
+            result.center[i] = center[i];
+        }
+    }
+    if (settings.contains("scale"))
+        result.scale = settings["scale"].cast<float>();
+    if (settings.contains("distance"))
+        result.distance = settings["distance"].cast<float>();
+    if (settings.contains("yaw"))
+        result.yaw = settings["yaw"].cast<float>();
+    if (settings.contains("pitch"))
+        result.pitch = settings["pitch"].cast<float>();
+    if (settings.contains("fov"))
+        result.fov = settings["fov"].cast<float>();
+    return result;
+}
+
+// Renders one RGBA image per camera (and layer set, when given) with the
+// offscreen context; returns None when no context could be made or a
+// window is open.
+py::object render_batch(Engine* engine, int width, int height, py::list cameras, py::object layer_sets) {
+    size_t count = cameras.size();
+    if (!layer_sets.is_none())
+        count = std::max(count, py::len(layer_sets));
+    std::vector<py::array_t<unsigned char>> images;
+    std::vector<OffscreenView> views(count);
+    for (size_t i = 0; i < count; i++) {
+        py::object camera = py::none();
+        if (cameras.size() > 0)
+            camera = cameras[std::min(i, cameras.size() - 1)];
+        views[i].camera = camera_from(engine, width, height, camera);
+        views[i].filterLayers = !layer_sets.is_none();
+        if (views[i].filterLayers) {
+            py::list sets = layer_sets.cast<py::list>();
+            py::object layers = sets[std::min(i, sets.size() - 1)];
+            for (auto && id : layers) {
+                views[i].layers.insert(id.cast<int>());
+            }
+        }
+        images.push_back(py::array_t<unsigned char>({height, width, 4}));
+        views[i].pixels = images.back().mutable_data();
+    }
+    bool rendered;
+    {
+        py::gil_scoped_release release;
+        rendered = engine->renderOffscreen(width, height, &views);
+    }
+    engine->notifyBudget();
+    if (!rendered)
+        return py::none();
+    py::list result;
+    for (auto && image : images) {
+        result.append(image);
+    }
+    return result;
+}
+
+py::object render_to_array(Engine* engine, int width, int height, py::object camera, py::object layers) {
+    py::list cameras;
+    cameras.append(camera);
+    py::object layer_sets = py::none();
+    if (!layers.is_none()) {
+        py::list sets;
+        sets.append(layers);
+        layer_sets = sets;
+    }
+    py::object images = render_batch(engine, width, height, cameras, layer_sets);
+    if (images.is_none())
+        return images;
+    return images.cast<py::list>()[0];
+}
+
+// Streams an animation to path, one animation step per frame; returns
+// {frames, seconds, fps, bytes_written} or None on failure.
+py::object export_frames(
+    Engine* engine,
+    const std::string& path,
+    int width,
+    int height,
+    long frames,
+    int format,
+    int fps,
+    py::object camera,
+    int threads) {
+    Camera view = camera_from(engine, width, height, camera);
+    FrameExportStats stats;
+    bool exported;
+    {
+        py::gil_scoped_release release;
+        exported = engine->exportFrames(path, format, width, height, frames, fps, view, threads, &stats);
+    }
+    engine->notifyBudget();
+    if (!exported)
+        return py::none();
+    py::dict result;
+    result["frames"] = stats.frames;
+    result["seconds"] = stats.seconds;
+    result["fps"] = stats.fps;
+    result["bytes_written"] = stats.bytesWritten;
+    return result;
+}
+
+// Recording starts over each time it is switched on.
+CommandFuture record_camera_path(Engine* engine, bool enabled) {
+    return engine->submit([engine, enabled]() {
+        if (enabled && !engine->recording)
+            engine->cameraRecording.samples.clear();
+        engine->recording = enabled;
+        return true;
+    });
+}
+
+bool save_camera_path(Engine* engine, const std::string& path) {
+    CameraPath recorded = query<CameraPath>(engine, [engine]() { return engine->cameraRecording; });
+    py::gil_scoped_release release;
+    return recorded.save(path);
+}
+
+// Replays the camera path saved at path, or a synthetic one of frames
+// samples at width x height when path is None, and returns frame-time
+// percentiles and per-phase means in milliseconds with the draw calls per
+// frame; None when the path can't be read or drawn offscreen.
+py::object replay_camera_path(Engine* engine, py::object path, int width, int height, long frames) {
+    CameraPath camera_path;
+    if (path.is_none()) {
+        camera_path = engine->syntheticCameraPath(width, height, frames, 60.0);
+    } else if (!camera_path.load(path.cast<std::string>())) {
+        return py::none();
+    }
+    ReplayReport report;
+    bool replayed;
+    {
+        py::gil_scoped_release release;
+        replayed = engine->replayCameraPath(camera_path, &report);
+    }
+    engine->notifyBudget();
+    if (!replayed)
+        return py::none();
+    const double ms = 1000.0;
+    py::list draw_calls;
+    for (auto && frame : report.frames) {
+        draw_calls.append(frame.drawCalls);
+    }
+    py::dict phases;
+    phases["update"] = report.mean.update * ms;
+    phases["draw"] = report.mean.draw * ms;
+    phases["pick"] = report.mean.pick * ms;
+    phases["finish"] = report.mean.finish * ms;
+    py::dict result;
+    result["backend"] = report.backend;
+    result["frames"] = report.frames.size();
+    result["p50_ms"] = report.p50 * ms;
+    result["p95_ms"] = report.p95 * ms;
+    result["p99_ms"] = report.p99 * ms;
+    result["max_ms"] = report.max * ms;
+    result["mean_ms"] = report.mean.total * ms;
+    result["phase_ms"] = phases;
+    result["draw_calls"] = draw_calls;
+    return result;
+}
+
 PYBIND11_MODULE(_zenith, m) {
     py::class_<Engine>(m, "Engine")
-        .def(py::init<const std::string &>())
-        .def("animate", &Engine::animate)
-        .def("add_model", &Engine::addModel)
-        .def("remove_model", &Engine::removeModel)
+        .def(py::init<>())
+        .def("animate", &Engine::animate, py::call_guard<py::gil_scoped_release>())
+        .def("start", &Engine::start)
+        .def("join", &Engine::join, py::call_guard<py::gil_scoped_release>())
+        .def("close", &Engine::close)
+        .def("add_model", &add_model)
+        .def("remove_model", &remove_model)
         .def("model_exists", &Engine::modelExists)
-        .def("num_models", &Engine::numModels);
-    py::class_<Engine3d>(m, "Engine3d")
-        .def(py::init<const std::string &>())
-        .def("animate", &Engine::animate)
-        .def("add_model", &Engine::addModel)
-        .def("remove_model", &Engine::removeModel)
+        .def("num_models", &Engine::numModels)
+        .def("set_batching", &set_batching, py::arg("enabled"), py::arg("max_vertices") = 65536)
+        .def("set_continuous_rendering", &set_continuous_rendering)
+        .def("set_keep_resident", &set_keep_resident)
+        .def("set_background_uploads", &set_background_uploads)
+        .def(
+            "set_time_windows",
+            &set_time_windows,
+            py::arg("id"),
+            py::arg("windows"),
+            py::arg("fade") = 0.0f)
+        .def(
+            "set_timeline",
+            &set_timeline,
+            py::arg("position") = py::none(),
+            py::arg("playing") = py::none(),
+            py::arg("rate") = py::none(),
+            py::arg("loop") = py::none())
+        .def("timeline", &timeline)
+        .def("buffer_stats", &buffer_stats)
+        .def("memory_stats", &memory_stats)
+        .def("frame_stats", &frame_stats)
+        .def("shader_stats", &shader_stats)
+        .def(
+            "set_memory_budget",
+            &set_memory_budget,
+            py::arg("cpu_bytes"),
+            py::arg("gpu_bytes"),
+            py::arg("callback") = py::none())
+        .def(
+            "render_to_array",
+            &render_to_array,
+            py::arg("width"),
+            py::arg("height"),
+            py::arg("camera") = py::none(),
+            py::arg("layers") = py::none())
+        .def(
+            "render_batch",
+            &render_batch,
+            py::arg("width"),
+            py::arg("height"),
+            py::arg("cameras"),
+            py::arg("layer_sets") = py::none())
+        .def(
+            "export_frames",
+            &export_frames,
+            py::arg("path"),
+            py::arg("width"),
+            py::arg("height"),
+            py::arg("frames") = 0,
+            py::arg("format") = (int) FRAME_FORMAT_RAW,
+            py::arg("fps") = 30,
+            py::arg("camera") = py::none(),
+            py::arg("threads") = 0)
+        .def("record_camera_path", &record_camera_path)
+        .def("save_camera_path", &save_camera_path)
+        .def(
+            "replay_camera_path",
+            &replay_camera_path,
+            py::arg("path") = py::none(),
+            py::arg("width") = 1024,
+            py::arg("height") = 768,
+            py::arg("frames") = 300)
+        .def("close_headless", &Engine::closeHeadless, py::call_guard<py::gil_scoped_release>());
+    py::class_<Engine3d, Engine>(m, "Engine3d")
+        .def(py::init<>())
+        .def("animate", &Engine::animate, py::call_guard<py::gil_scoped_release>())
+        .def("start", &Engine::start)
+        .def("join", &Engine::join, py::call_guard<py::gil_scoped_release>())
+        .def("close", &Engine::close)
+        .def("add_model", &add_model)
+        .def("remove_model", &remove_model)
         .def("model_exists", &Engine::modelExists)
-        .def("num_models", &Engine::numModels);
+        .def("num_models", &Engine::numModels)
+        .def("set_batching", &set_batching, py::arg("enabled"), py::arg("max_vertices") = 65536)
+        .def("set_continuous_rendering", &set_continuous_rendering)
+        .def("set_keep_resident", &set_keep_resident)
+        .def("set_background_uploads", &set_background_uploads)
+        .def(
+            "set_time_windows",
+            &set_time_windows,
+            py::arg("id"),
+            py::arg("windows"),
+            py::arg("fade") = 0.0f)
+        .def(
+            "set_timeline",
+            &set_timeline,
+            py::arg("position") = py::none(),
+            py::arg("playing") = py::none(),
+            py::arg("rate") = py::none(),
+            py::arg("loop") = py::none())
+        .def("timeline", &timeline)
+        .def("buffer_stats", &buffer_stats)
+        .def("memory_stats", &memory_stats)
+        .def("frame_stats", &frame_stats)
+        .def("shader_stats", &shader_stats)
+        .def(
+            "set_memory_budget",
+            &set_memory_budget,
+            py::arg("cpu_bytes"),
+            py::arg("gpu_bytes"),
+            py::arg("callback") = py::none())
+        .def(
+            "render_to_array",
+            &render_to_array,
+            py::arg("width"),
+            py::arg("height"),
+            py::arg("camera") = py::none(),
+            py::arg("layers") = py::none())
+        .def(
+            "render_batch",
+            &render_batch,
+            py::arg("width"),
+            py::arg("height"),
+            py::arg("cameras"),
+            py::arg("layer_sets") = py::none())
+        .def(
+            "export_frames",
+            &export_frames,
+            py::arg("path"),
+            py::arg("width"),
+            py::arg("height"),
+            py::arg("frames") = 0,
+            py::arg("format") = (int) FRAME_FORMAT_RAW,
+            py::arg("fps") = 30,
+            py::arg("camera") = py::none(),
+            py::arg("threads") = 0)
+        .def("record_camera_path", &record_camera_path)
+        .def("save_camera_path", &save_camera_path)
+        .def(
+            "replay_camera_path",
+            &replay_camera_path,
+            py::arg("path") = py::none(),
+            py::arg("width") = 1024,
+            py::arg("height") = 768,
+            py::arg("frames") = 300)
+        .def("close_headless", &Engine::closeHeadless, py::call_guard<py::gil_scoped_release>());
+
+    py::class_<CommandFuture>(m, "CommandFuture")
+        .def("done", &CommandFuture::done)
+        .def("wait", &CommandFuture::wait, py::arg("timeout") = -1.0, py::call_guard<py::gil_scoped_release>())
+        .def("result", &CommandFuture::result, py::call_guard<py::gil_scoped_release>());
+
+    py::class_<GLModel, std::shared_ptr<GLModel>>(m, "GLModel")
+        .def("name", [](GLModel* model){ return model->name; })
+        // A layer's data never changes once built, so these need no engine.
+        .def("original_index", [](GLModel* model, int storage_index) {
+            if (storage_index < 0 || storage_index >= model->numVertices)
+                return -1;
+            return model->originalIndex(storage_index);
+        })
+        .def("nearest_index", [](GLModel* model, float x, float y, float z) {
+            float point[3] = {x, y, z};
+            return model->nearestIndex(point);
+        })
+        .def("string_data", [](GLModel* model, int index) {
+            if (index < 0 || index >= (int) model->stringReps.size())
+                return std::string();
+            return model->stringReps[index];
+        });
+
+    py::class_<GLModelAnimated, GLModel, std::shared_ptr<GLModelAnimated>>(m, "GLModelAnimated")
+        .def("name", [](GLModel* model){ return model->name; });
 
-    py::class_<GLModel>(m, "GLModel")
+    py::class_<GLModelTracks, GLModel, std::shared_ptr<GLModelTracks>>(m, "GLModelTracks")
         .def("name", [](GLModel* model){ return model->name; });
 
-    py::class_<GLModelAnimated>(m, "GLModelAnimated")
+    py::class_<GLModelStreamed, GLModel, std::shared_ptr<GLModelStreamed>>(m, "GLModelStreamed")
         .def("name", [](GLModel* model){ return model->name; });
 
     m.def(
@@ -121,7 +792,8 @@ PYBIND11_MODULE(_zenith, m) {
         py::arg("use_color_data"),
         py::arg("id"),
         py::arg("string_reps"),
-        py::arg("picking_enabled")
+        py::arg("picking_enabled"),
+        py::arg("spatial_order") = 0
     );
 
     m.def(
@@ -144,4 +816,65 @@ PYBIND11_MODULE(_zenith, m) {
         py::arg("string_reps"),
         py::arg("picking_enabled")
     );
+
+    m.def(
+        "create_gl_model_tracks",
+        &create_gl_model_tracks,
+        "Create a 2d or 3d layer of interpolated entity tracks",
+        py::arg("vertex_data"),
+        py::arg("num_vertices"),
+        py::arg("num_components"),
+        py::arg("stride"),
+        py::arg("draw_type"),
+        py::arg("step_size"),
+        py::arg("entity_ids"),
+        py::arg("time_data"),
+        py::arg("name"),
+        py::arg("color"),
+        py::arg("id")
+    );
+
+    m.def(
+        "create_gl_model_streamed",
+        &create_gl_model_streamed,
+        "Create an animated layer streamed to the GPU from memory",
+        py::arg("vertex_data"),
+        py::arg("time_data"),
+        py::arg("num_components"),
+        py::arg("draw_type"),
+        py::arg("step_size"),
+        py::arg("window_size"),
+        py::arg("chunk_points"),
+        py::arg("name"),
+        py::arg("color"),
+        py::arg("id")
+    );
+
+    m.def(
+        "create_gl_model_streamed_from_files",
+        &create_gl_model_streamed_from_files,
+        "Create an animated layer streamed to the GPU from mapped files",
+        py::arg("vertex_path"),
+        py::arg("time_path"),
+        py::arg("num_components"),
+        py::arg("draw_type"),
+        py::arg("step_size"),
+        py::arg("window_size"),
+        py::arg("chunk_points"),
+        py::arg("name"),
+        py::arg("color"),
+        py::arg("id")
+    );
+
+    m.def(
+        "export_trace",
+        [](const std::string& path) {
+            py::gil_scoped_release release;
+            return traceExport(path);
+        },
+        "Write the recorded trace zones as Chrome trace-event JSON",
+        py::arg("path")
+    );
+    m.def("clear_trace", &traceClear, "Drop the recorded trace zones");
+    m.def("tracing_enabled", &traceEnabled, "Whether the trace zones are built in");
 }
@@ -0,0 +1,76 @@
+#ifndef ZENITH_CPP_RELEASEQUEUE_CPP_
+#define ZENITH_CPP_RELEASEQUEUE_CPP_
+
+#include "ReleaseQueue.hpp"
+#include <utility>
+#include "glad/gl.h"
+
+ReleaseQueue::ReleaseQueue() {
+    this->released = 0;
+}
+
+ReleaseQueue::~ReleaseQueue() {
+    // Engine flushes while its context is still current; fences left here
+    // died with their context.
+}
+
+void ReleaseQueue::defer(std::function<void()> release) {
+    unfenced.push_back(std::move(release));
+}
+
+void ReleaseQueue::fence() {
+    if (unfenced.empty())
+        return;
+    Frame frame;
+    frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame.releases.swap(unfenced);
+    frames.push_back(std::move(frame));
+}
+
+size_t ReleaseQueue::collect() {
+    size_t count = 0;
+    while (!frames.empty()) {
+        Frame& frame = frames.front();
+        GLenum status = glClientWaitSync(frame.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(frame.fence);
+        for (auto && release : frame.releases) {
+            release();
+        }
+        count += frame.releases.size();
+        frames.pop_front();
+    }
+    released += count;
+    return count;
+}
+
+void ReleaseQueue::flush() {
+    if (!frames.empty())
+        glFinish();
+    while (!frames.empty()) {
+        Frame& frame = frames.front();
+        glDeleteSync(frame.fence);
+        for (auto && release : frame.releases) {
+            release();
+        }
+        released += frame.releases.size();
+        frames.pop_front();
+    }
+    std::vector<std::function<void()>> releases;
+    releases.swap(unfenced);
+    for (auto && release : releases) {
+        release();
+    }
+    released += releases.size();
+}
+
+size_t ReleaseQueue::pending() {
+    size_t count = unfenced.size();
+    for (auto && frame : frames) {
+        count += frame.releases.size();
+    }
+    return count;
+}
+
+#endif
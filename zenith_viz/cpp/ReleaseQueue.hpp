@@ -0,0 +1,41 @@
+#ifndef ZENITH_CPP_RELEASEQUEUE_HPP_
+#define ZENITH_CPP_RELEASEQUEUE_HPP_
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <vector>
+#include "glad/gl.h"
+
+// GL resources retired while the GPU may still be reading them. Releases
+// queued with defer() are grouped behind a fence at the end of the frame and
+// run by collect() once that fence has signaled, so a removed layer's
+// buffers are never recycled under an in-flight draw and no frame has to
+// stall on glFinish. All calls belong on the thread that owns the context.
+class ReleaseQueue {
+ public:
+    struct Frame {
+        GLsync fence;
+        std::vector<std::function<void()>> releases;
+    };
+
+    std::vector<std::function<void()>> unfenced;
+    std::deque<Frame> frames;
+    size_t released;
+
+    ReleaseQueue();
+    ~ReleaseQueue();
+    void defer(std::function<void()> release);
+    // Puts everything deferred since the last call behind a new fence.
+    void fence();
+    // Runs the releases of every frame whose fence has signaled, without
+    // blocking, and returns how many ran.
+    size_t collect();
+    // Runs everything now. Waits for the GPU first if any fence is still
+    // pending, so the context must be current unless fence() was never
+    // called.
+    void flush();
+    size_t pending();
+};
+
+#endif  // ZENITH_CPP_RELEASEQUEUE_HPP_
@@ -0,0 +1,415 @@
+#ifndef ZENITH_CPP_SHADERLIBRARY_CPP_
+#define ZENITH_CPP_SHADERLIBRARY_CPP_
+
+#include "ShaderLibrary.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include "FrameStats.hpp"
+#include "Tracing.hpp"
+
+static const char* VERTEX_SOURCE =
+#include "../shaders/vertexShader.shader"
+;
+
+static const char* FRAGMENT_SOURCE =
+#include "../shaders/fragmentShader.shader"
+;
+
+static const GLenum PROGRAM_BINARY_RETRIEVABLE_HINT = 0x8257;
+static const GLenum PROGRAM_BINARY_LENGTH = 0x8741;
+static const GLenum NUM_PROGRAM_BINARY_FORMATS = 0x87FE;
+
+static const GLuint FRAME_BINDING = 0;
+static const GLuint LAYER_BINDING = 1;
+
+// A cache file is this, the binary format and the binary.
+static const char CACHE_MAGIC[8] = {'Z', 'N', 'P', 'R', 'O', 'G', '0', '1'};
+
+struct FeatureDefine {
+    unsigned int feature;
+    const char* define;
+};
+
+static const FeatureDefine FEATURE_DEFINES[] = {
+    {SHADER_POINTS, "POINTS"},
+    {SHADER_COLOR_DATA, "COLOR_DATA"},
+    {SHADER_LAYER_TABLE, "LAYER_TABLE"},
+    {SHADER_PICKING, "PICKING"},
+    {SHADER_TIME_WINDOWS, "TIME_WINDOWS"},
+    {SHADER_KEYFRAMES, "KEYFRAMES"},
+};
+
+static std::string defaultCacheDir() {
+    const char* env = getenv("ZENITH_SHADER_CACHE");
+    if (env != nullptr)
+        return env;
+#ifdef _WIN32
+    const char* local = getenv("LOCALAPPDATA");
+    if (local != nullptr && *local != '\0')
+        return std::string(local) + "\\zenith_viz\\shaders";
+#else
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if (xdg != nullptr && *xdg != '\0')
+        return std::string(xdg) + "/zenith_viz/shaders";
+    const char* home = getenv("HOME");
+    if (home != nullptr && *home != '\0')
+        return std::string(home) + "/.cache/zenith_viz/shaders";
+#endif
+    return "";
+}
+
+static bool makeDirectories(const std::string& path) {
+    for (size_t i = 1; i <= path.size(); i++) {
+        if (i < path.size() && path[i] != '/' && path[i] != '\\')
+            continue;
+        std::string prefix = path.substr(0, i);
+        if (prefix.back() == ':')
+            continue;
+#ifdef _WIN32
+        int result = _mkdir(prefix.c_str());
+#else
+        int result = mkdir(prefix.c_str(), 0755);
+#endif
+        if (result != 0 && errno != EEXIST)
+            return false;
+    }
+    return true;
+}
+
+// FNV-1a, enough to tell variants and drivers apart in file names.
+static unsigned long long hashText(const std::string& text, unsigned long long hash) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static std::string variantSource(unsigned int features, const char* source) {
+    std::string text = "#version 330 core\n";
+    for (auto && feature : FEATURE_DEFINES) {
+        if (features & feature.feature)
+            text += std::string("#define ") + feature.define + "\n";
+    }
+    return text + source;
+}
+
+static GLuint compileShader(const std::string& source, GLenum type) {
+    GLuint shader = glCreateShader(type);
+    const char* text = source.c_str();
+    glShaderSource(shader, 1, &text, nullptr);
+    glCompileShader(shader);
+    GLint status = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status == GL_TRUE)
+        return shader;
+    GLint length = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    std::vector<char> log(length + 1, '\0');
+    if (length > 0)
+        glGetShaderInfoLog(shader, length, nullptr, log.data());
+    fprintf(stderr, "zenith: shader failed to compile\n%s\n", log.data());
+    glDeleteShader(shader);
+    return 0;
+}
+
+ShaderLibrary::ShaderLibrary() {
+    cacheDir = defaultCacheDir();
+    bound = 0;
+    frame = FrameUniforms();
+    setMatrix(glm::mat4(1.0f));
+    // Nothing picked.
+    setPickingPoint(glm::vec3(1e30f));
+    frameDirty = true;
+    frameBuffer = 0;
+    layerBuffer = 0;
+    layerStride = sizeof(LayerUniforms);
+    compiled = 0;
+    loaded = 0;
+    binds = 0;
+    binaries = false;
+    getProgramBinary = nullptr;
+    programBinary = nullptr;
+    programParameteri = nullptr;
+}
+
+void ShaderLibrary::initialize(GLADloadfunc load) {
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    bool supported = major > 4 || (major == 4 && minor >= 1);
+    GLint extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+    for (GLint i = 0; i < extensions && !supported; i++) {
+        const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, (GLuint) i));
+        supported = name != nullptr && strcmp(name, "GL_ARB_get_program_binary") == 0;
+    }
+    binaries = false;
+    if (supported && load != nullptr) {
+        getProgramBinary = reinterpret_cast<GetProgramBinary>(load("glGetProgramBinary"));
+        programBinary = reinterpret_cast<ProgramBinary>(load("glProgramBinary"));
+        programParameteri = reinterpret_cast<ProgramParameteri>(load("glProgramParameteri"));
+        GLint formats = 0;
+        glGetIntegerv(NUM_PROGRAM_BINARY_FORMATS, &formats);
+        binaries = getProgramBinary != nullptr && programBinary != nullptr
+            && programParameteri != nullptr && formats > 0;
+    }
+
+    GLint alignment = 1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment = std::max(alignment, 1);
+    layerStride = (sizeof(LayerUniforms) + alignment - 1) / alignment * alignment;
+
+    // Binaries only load into the driver that made them.
+    driver.clear();
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const char* value = reinterpret_cast<const char*>(glGetString(name));
+        driver += value != nullptr ? value : "";
+        driver += "\n";
+    }
+}
+
+void ShaderLibrary::setMatrix(const glm::mat4& mvp) {
+    if (memcmp(frame.mvp, &mvp[0][0], sizeof(frame.mvp)) == 0)
+        return;
+    memcpy(frame.mvp, &mvp[0][0], sizeof(frame.mvp));
+    frameDirty = true;
+}
+
+void ShaderLibrary::setPickingPoint(const glm::vec3& point) {
+    if (memcmp(frame.pickingPoint, &point[0], sizeof(frame.pickingPoint)) == 0)
+        return;
+    memcpy(frame.pickingPoint, &point[0], sizeof(frame.pickingPoint));
+    frameDirty = true;
+}
+
+void ShaderLibrary::beginDraw(const std::vector<LayerUniforms>& layers) {
+    if (frameBuffer == 0) {
+        glGenBuffers(1, &frameBuffer);
+        glGenBuffers(1, &layerBuffer);
+        frameDirty = true;
+    }
+    if (frameDirty) {
+        glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(frame), &frame, GL_DYNAMIC_DRAW);
+        RenderCounters::uploadBytes += sizeof(frame);
+        frameDirty = false;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BINDING, frameBuffer);
+
+    if (!layers.empty()) {
+        layerData.resize(layers.size() * (size_t) layerStride);
+        for (size_t i = 0; i < layers.size(); i++) {
+            memcpy(&layerData[i * (size_t) layerStride], &layers[i], sizeof(LayerUniforms));
+        }
+        // Respecified every frame, so the driver can hand out fresh storage
+        // instead of waiting for draws still reading the last frame's.
+        glBindBuffer(GL_UNIFORM_BUFFER, layerBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr) layerData.size(), layerData.data(), GL_STREAM_DRAW);
+        RenderCounters::uploadBytes += layerData.size();
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    // Anything may have been bound in between, the control panel included.
+    bound = 0;
+}
+
+GLuint ShaderLibrary::use(unsigned int features) {
+    auto found = programs.find(features);
+    if (found == programs.end()) {
+        GLuint program = build(features);
+        if (program != 0)
+            connectUniforms(program);
+        // A variant that failed stays failed rather than being rebuilt
+        // every frame.
+        found = programs.emplace(features, program).first;
+    }
+    GLuint program = found->second;
+    if (program != 0 && program != bound) {
+        glUseProgram(program);
+        bound = program;
+        binds++;
+    }
+    return program;
+}
+
+void ShaderLibrary::bindLayer(size_t index) {
+    glBindBufferRange(GL_UNIFORM_BUFFER, LAYER_BINDING, layerBuffer, (GLintptr) index * layerStride, sizeof(LayerUniforms));
+}
+
+ShaderStats ShaderLibrary::stats() {
+    ShaderStats result;
+    result.programs = (int) programs.size();
+    result.compiled = compiled;
+    result.loaded = loaded;
+    result.binds = binds;
+    result.binaries = binaries;
+    return result;
+}
+
+void ShaderLibrary::release() {
+    for (auto && pair : programs) {
+        if (pair.second != 0)
+            glDeleteProgram(pair.second);
+    }
+    programs.clear();
+    bound = 0;
+    if (frameBuffer != 0) {
+        glDeleteBuffers(1, &frameBuffer);
+        glDeleteBuffers(1, &layerBuffer);
+    }
+    frameBuffer = 0;
+    layerBuffer = 0;
+}
+
+GLuint ShaderLibrary::build(unsigned int features) {
+    ZENITH_TRACE_ZONE("ShaderLibrary::build");
+    std::string vertexSource = variantSource(features, VERTEX_SOURCE);
+    std::string fragmentSource = variantSource(features, FRAGMENT_SOURCE);
+    std::string path;
+    if (binaries && !cacheDir.empty()) {
+        unsigned long long key = hashText(fragmentSource, hashText(vertexSource, hashText(driver, 14695981039346656037ULL)));
+        char name[40];
+        snprintf(name, sizeof(name), "/program-%016llx.bin", key);
+        path = cacheDir + name;
+        GLuint program = loadBinary(path);
+        if (program != 0) {
+            loaded++;
+            return program;
+        }
+    }
+
+    GLuint vertexShader = compileShader(vertexSource, GL_VERTEX_SHADER);
+    GLuint fragmentShader = compileShader(fragmentSource, GL_FRAGMENT_SHADER);
+    if (vertexShader == 0 || fragmentShader == 0) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+    GLuint program = glCreateProgram();
+    if (!path.empty())
+        programParameteri(program, PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    glDetachShader(program, vertexShader);
+    glDetachShader(program, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::vector<char> log(length + 1, '\0');
+        if (length > 0)
+            glGetProgramInfoLog(program, length, nullptr, log.data());
+        fprintf(stderr, "zenith: shader program failed to link\n%s\n", log.data());
+        glDeleteProgram(program);
+        return 0;
+    }
+    compiled++;
+    if (!path.empty())
+        saveBinary(program, path);
+    return program;
+}
+
+void ShaderLibrary::connectUniforms(GLuint program) {
+    GLuint frameBlock = glGetUniformBlockIndex(program, "Frame");
+    if (frameBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, frameBlock, FRAME_BINDING);
+    GLuint layerBlock = glGetUniformBlockIndex(program, "Layer");
+    if (layerBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, layerBlock, LAYER_BINDING);
+    GLint layerTable = glGetUniformLocation(program, "layer_table");
+    if (layerTable >= 0) {
+        glUseProgram(program);
+        glUniform1i(layerTable, LAYER_TABLE_UNIT);
+        bound = program;
+        binds++;
+    }
+}
+
+GLuint ShaderLibrary::loadBinary(const std::string& path) {
+    FILE* in = fopen(path.c_str(), "rb");
+    if (in == nullptr)
+        return 0;
+    char magic[sizeof(CACHE_MAGIC)];
+    GLenum format = 0;
+    std::vector<char> binary;
+    bool read = fread(magic, 1, sizeof(magic), in) == sizeof(magic)
+        && memcmp(magic, CACHE_MAGIC, sizeof(magic)) == 0
+        && fread(&format, sizeof(format), 1, in) == 1;
+    if (read) {
+        long start = ftell(in);
+        fseek(in, 0, SEEK_END);
+        long end = ftell(in);
+        fseek(in, start, SEEK_SET);
+        read = end > start;
+        if (read) {
+            binary.resize((size_t) (end - start));
+            read = fread(binary.data(), 1, binary.size(), in) == binary.size();
+        }
+    }
+    fclose(in);
+    if (!read)
+        return 0;
+
+    GLuint program = glCreateProgram();
+    programBinary(program, format, binary.data(), (GLsizei) binary.size());
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        // Rejected, e.g. after a driver update; the caller compiles the
+        // variant and overwrites the file.
+        glDeleteProgram(program);
+        while (glGetError() != GL_NO_ERROR) {}
+        return 0;
+    }
+    return program;
+}
+
+void ShaderLibrary::saveBinary(GLuint program, const std::string& path) {
+    GLint length = 0;
+    glGetProgramiv(program, PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary((size_t) length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    getProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0)
+        return;
+    if (!makeDirectories(cacheDir)) {
+        fprintf(stderr, "zenith: could not create the shader cache %s\n", cacheDir.c_str());
+        return;
+    }
+    // Written aside and renamed into place, so a reader never sees half a
+    // file.
+    std::string partial = path + ".partial";
+    FILE* out = fopen(partial.c_str(), "wb");
+    if (out == nullptr)
+        return;
+    bool saved = fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC), out) == sizeof(CACHE_MAGIC)
+        && fwrite(&format, sizeof(format), 1, out) == 1
+        && fwrite(binary.data(), 1, (size_t) written, out) == (size_t) written;
+    saved = fclose(out) == 0 && saved;
+#ifdef _WIN32
+    if (saved)
+        remove(path.c_str());
+#endif
+    if (!saved || rename(partial.c_str(), path.c_str()) != 0)
+        remove(partial.c_str());
+}
+
+#endif
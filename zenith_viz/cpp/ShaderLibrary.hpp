@@ -0,0 +1,122 @@
+#ifndef ZENITH_CPP_SHADERLIBRARY_HPP_
+#define ZENITH_CPP_SHADERLIBRARY_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "glad/gl.h"
+#include <glm/glm.hpp>
+#include "TimeIndex.hpp"
+
+// What a draw needs from the shaders; each combination is its own program,
+// specialized with #defines instead of branching on uniforms.
+enum ShaderFeature {
+    // Round points; otherwise lines.
+    SHADER_POINTS = 1 << 0,
+    // Per-vertex colors instead of the layer color.
+    SHADER_COLOR_DATA = 1 << 1,
+    // A GLBatch: color, size and color source per layer from its table.
+    SHADER_LAYER_TABLE = 1 << 2,
+    // Highlights the vertex at picking_point.
+    SHADER_PICKING = 1 << 3,
+    SHADER_TIME_WINDOWS = 1 << 4,
+    SHADER_KEYFRAMES = 1 << 5
+};
+
+// Texture unit of GLBatch's layer table.
+const int LAYER_TABLE_UNIT = 1;
+
+// The vertex shader's std140 uniform blocks. Frame is shared by every draw
+// and only uploaded when it changes; each layer's Layer is gathered into
+// one buffer per frame and bound by range.
+struct FrameUniforms {
+    float mvp[16];
+    float pickingPoint[3];
+    float padding;
+};
+
+struct LayerUniforms {
+    float color[4];
+    float pointSize;
+    float timeFade;
+    float keyframeMix;
+    GLint numTimeWindows;
+    // Begin and end offsets of each time window.
+    GLuint timeWindows[2 * MAX_TIME_WINDOWS];
+};
+
+struct ShaderStats {
+    int programs;
+    int compiled;
+    int loaded;
+    // glUseProgram calls; consecutive draws with one program share one.
+    unsigned long binds;
+    // Whether the driver can hand out program binaries to cache.
+    bool binaries;
+};
+
+// The renderer's shader programs. The sources are compiled into the
+// library and specialized per feature set; a variant is built the first
+// time it is drawn with. Linked programs are saved with glGetProgramBinary
+// under cacheDir, keyed by the driver and the variant's source, and loaded
+// from there by later sessions instead of being compiled again.
+class ShaderLibrary {
+ public:
+    // ZENITH_SHADER_CACHE, or zenith_viz/shaders under the user's cache
+    // directory. Empty turns the cache off.
+    std::string cacheDir;
+
+    ShaderLibrary();
+    // Looks up the program binary entry points through load; without them
+    // every variant is compiled. The context must be current.
+    void initialize(GLADloadfunc load);
+    // Shared by every program; uploaded by the next beginDraw().
+    void setMatrix(const glm::mat4& mvp);
+    void setPickingPoint(const glm::vec3& point);
+    // Uploads the frame's uniforms and layers, whose entries bindLayer()
+    // then selects. Called before the first use() of each draw.
+    void beginDraw(const std::vector<LayerUniforms>& layers);
+    // Binds the program for features (a ShaderFeature mask) unless it is
+    // already bound. 0 if it fails to build.
+    GLuint use(unsigned int features);
+    void bindLayer(size_t index);
+    ShaderStats stats();
+    // Deletes the programs and buffers; the context must be current.
+    void release();
+
+ private:
+    // Built programs by feature mask; 0 for variants that failed.
+    std::map<unsigned int, GLuint> programs;
+    GLuint bound;
+    FrameUniforms frame;
+    bool frameDirty;
+    GLuint frameBuffer;
+    GLuint layerBuffer;
+    // Bytes between layers in layerBuffer, a multiple of the driver's
+    // uniform buffer offset alignment.
+    GLsizeiptr layerStride;
+    std::vector<char> layerData;
+    int compiled;
+    int loaded;
+    unsigned long binds;
+
+    // GL 4.1 / ARB_get_program_binary, which the GL 3.3 loader leaves out.
+    typedef void (GLAD_API_PTR *GetProgramBinary)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+    typedef void (GLAD_API_PTR *ProgramBinary)(GLuint, GLenum, const void*, GLsizei);
+    typedef void (GLAD_API_PTR *ProgramParameteri)(GLuint, GLenum, GLint);
+
+    bool binaries;
+    std::string driver;
+    GetProgramBinary getProgramBinary;
+    ProgramBinary programBinary;
+    ProgramParameteri programParameteri;
+
+    GLuint build(unsigned int features);
+    // Block bindings and sampler units, which linking and loading a binary
+    // both reset.
+    void connectUniforms(GLuint program);
+    GLuint loadBinary(const std::string& path);
+    void saveBinary(GLuint program, const std::string& path);
+};
+
+#endif  // ZENITH_CPP_SHADERLIBRARY_HPP_
@@ -0,0 +1,181 @@
+#ifndef ZENITH_CPP_SPATIALSORT_CPP_
+#define ZENITH_CPP_SPATIALSORT_CPP_
+
+#include "SpatialSort.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "Parallel.hpp"
+#include "Tracing.hpp"
+
+static const size_t SORT_MIN_CHUNK = 1 << 16;
+
+static uint64_t spreadBits(uint32_t v) {
+    uint64_t x = v & 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8) & 0x100f00f00f00f00fULL;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2) & 0x1249249249249249ULL;
+    return x;
+}
+
+uint64_t mortonKey(uint32_t x, uint32_t y, uint32_t z) {
+    return (spreadBits(x) << 2) | (spreadBits(y) << 1) | spreadBits(z);
+}
+
+uint64_t hilbertKey(uint32_t x, uint32_t y, uint32_t z) {
+    // Skilling's axes-to-transpose transform, then interleave the
+    // transposed axes the same way as a Morton key.
+    uint32_t axes[3] = {x, y, z};
+    uint32_t top = 1u << (SPATIAL_KEY_BITS - 1);
+    for (uint32_t q = top; q > 1; q >>= 1) {
+        uint32_t p = q - 1;
+        for (int i = 0; i < 3; i++) {
+            if (axes[i] & q) {
+                axes[0] ^= p;
+            } else {
+                uint32_t t = (axes[0] ^ axes[i]) & p;
+                axes[0] ^= t;
+                axes[i] ^= t;
+            }
+        }
+    }
+    axes[1] ^= axes[0];
+    axes[2] ^= axes[1];
+    uint32_t t = 0;
+    for (uint32_t q = top; q > 1; q >>= 1) {
+        if (axes[2] & q) t ^= q - 1;
+    }
+    for (int i = 0; i < 3; i++) axes[i] ^= t;
+    return mortonKey(axes[0], axes[1], axes[2]);
+}
+
+void radixSortPairs(
+    std::vector<uint64_t>* keys,
+    std::vector<unsigned int>* values) {
+    size_t n = keys->size();
+    if (n < 2) return;
+
+    uint64_t first = (*keys)[0];
+    uint64_t varying = 0;
+    for (size_t i = 1; i < n; i++) varying |= (*keys)[i] ^ first;
+
+    int workers = parallelWorkers(n, SORT_MIN_CHUNK);
+    std::vector<uint64_t> keyScratch(n);
+    std::vector<unsigned int> valueScratch(n);
+    std::vector<size_t> histograms(static_cast<size_t>(workers) * 256);
+    uint64_t* srcKeys = keys->data();
+    uint64_t* dstKeys = keyScratch.data();
+    unsigned int* srcValues = values->data();
+    unsigned int* dstValues = valueScratch.data();
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((varying >> shift) & 0xff) == 0) continue;
+
+        std::fill(histograms.begin(), histograms.end(), 0);
+        parallelFor(0, n, SORT_MIN_CHUNK, [&](size_t lo, size_t hi, int w) {
+            size_t* hist = &histograms[static_cast<size_t>(w) * 256];
+            for (size_t i = lo; i < hi; i++) {
+                hist[(srcKeys[i] >> shift) & 0xff]++;
+            }
+        });
+
+        // Exclusive scan, bucket-major then worker-major, keeps it stable.
+        size_t offset = 0;
+        for (int bucket = 0; bucket < 256; bucket++) {
+            for (int w = 0; w < workers; w++) {
+                size_t count = histograms[static_cast<size_t>(w) * 256 + bucket];
+                histograms[static_cast<size_t>(w) * 256 + bucket] = offset;
+                offset += count;
+            }
+        }
+
+        parallelFor(0, n, SORT_MIN_CHUNK, [&](size_t lo, size_t hi, int w) {
+            size_t* next = &histograms[static_cast<size_t>(w) * 256];
+            for (size_t i = lo; i < hi; i++) {
+                size_t dst = next[(srcKeys[i] >> shift) & 0xff]++;
+                dstKeys[dst] = srcKeys[i];
+                dstValues[dst] = srcValues[i];
+            }
+        });
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcValues, dstValues);
+    }
+
+    if (srcKeys != keys->data()) {
+        keys->swap(keyScratch);
+        values->swap(valueScratch);
+    }
+}
+
+std::vector<unsigned int> spatialPermutation(
+    const float* vertexData,
+    int numVertices,
+    int numComponents,
+    int order) {
+    ZENITH_TRACE_ZONE("spatialPermutation");
+    size_t n = static_cast<size_t>(numVertices);
+    std::vector<unsigned int> permutation(n);
+    for (size_t i = 0; i < n; i++) permutation[i] = static_cast<unsigned int>(i);
+    if (order == SPATIAL_ORDER_NONE || n < 2 || numComponents < 1) {
+        return permutation;
+    }
+    int axes = std::min(numComponents, 3);
+
+    int workers = parallelWorkers(n, SORT_MIN_CHUNK);
+    std::vector<float> lows(static_cast<size_t>(workers) * 3,
+                            std::numeric_limits<float>::max());
+    std::vector<float> highs(static_cast<size_t>(workers) * 3,
+                             std::numeric_limits<float>::lowest());
+    parallelFor(0, n, SORT_MIN_CHUNK, [&](size_t lo, size_t hi, int w) {
+        for (size_t i = lo; i < hi; i++) {
+            for (int a = 0; a < axes; a++) {
+                float v = vertexData[i * numComponents + a];
+                if (std::isfinite(v)) {
+                    lows[w * 3 + a] = std::min(lows[w * 3 + a], v);
+                    highs[w * 3 + a] = std::max(highs[w * 3 + a], v);
+                }
+            }
+        }
+    });
+
+    float low[3] = {0.0f, 0.0f, 0.0f};
+    float scale[3] = {0.0f, 0.0f, 0.0f};
+    const double cells = static_cast<double>((1u << SPATIAL_KEY_BITS) - 1);
+    for (int a = 0; a < axes; a++) {
+        float lo = std::numeric_limits<float>::max();
+        float hi = std::numeric_limits<float>::lowest();
+        for (int w = 0; w < workers; w++) {
+            lo = std::min(lo, lows[w * 3 + a]);
+            hi = std::max(hi, highs[w * 3 + a]);
+        }
+        if (hi > lo) {
+            low[a] = lo;
+            scale[a] = static_cast<float>(cells / (static_cast<double>(hi) - lo));
+        }
+    }
+
+    std::vector<uint64_t> keys(n);
+    parallelFor(0, n, SORT_MIN_CHUNK, [&](size_t lo, size_t hi, int w) {
+        for (size_t i = lo; i < hi; i++) {
+            uint32_t cell[3] = {0, 0, 0};
+            for (int a = 0; a < axes; a++) {
+                float v = (vertexData[i * numComponents + a] - low[a]) * scale[a];
+                if (v > 0.0f) {
+                    cell[a] = static_cast<uint32_t>(
+                        std::min(static_cast<double>(v), cells));
+                }
+            }
+            keys[i] = order == SPATIAL_ORDER_HILBERT
+                ? hilbertKey(cell[0], cell[1], cell[2])
+                : mortonKey(cell[0], cell[1], cell[2]);
+        }
+    });
+
+    radixSortPairs(&keys, &permutation);
+    return permutation;
+}
+
+#endif
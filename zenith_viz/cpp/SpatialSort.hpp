@@ -0,0 +1,33 @@
+#ifndef ZENITH_CPP_SPATIALSORT_HPP_
+#define ZENITH_CPP_SPATIALSORT_HPP_
+
+#include <cstdint>
+#include <vector>
+
+enum SpatialOrder {
+    SPATIAL_ORDER_NONE = 0,
+    SPATIAL_ORDER_MORTON = 1,
+    SPATIAL_ORDER_HILBERT = 2
+};
+
+// Bits per axis of the quantized grid; three axes fit in a 63 bit key.
+const int SPATIAL_KEY_BITS = 21;
+
+uint64_t mortonKey(uint32_t x, uint32_t y, uint32_t z);
+uint64_t hilbertKey(uint32_t x, uint32_t y, uint32_t z);
+
+// Stable LSD radix sort of keys, carrying values along. Byte passes where
+// every key agrees are skipped, so clustered data sorts in fewer passes.
+void radixSortPairs(
+    std::vector<uint64_t>* keys,
+    std::vector<unsigned int>* values);
+
+// Returns the order in which vertices should be stored: entry i is the
+// caller's index of the vertex placed at position i.
+std::vector<unsigned int> spatialPermutation(
+    const float* vertexData,
+    int numVertices,
+    int numComponents,
+    int order);
+
+#endif  // ZENITH_CPP_SPATIALSORT_HPP_
@@ -0,0 +1,85 @@
+#ifndef ZENITH_CPP_TIMEINDEX_CPP_
+#define ZENITH_CPP_TIMEINDEX_CPP_
+
+#include "TimeIndex.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "Parallel.hpp"
+#include "SpatialSort.hpp"
+#include "Tracing.hpp"
+
+static const size_t SORT_MIN_CHUNK = 1 << 16;
+
+bool timesSorted(const long* times, size_t numTimes) {
+    std::atomic<bool> sorted(true);
+    parallelFor(1, std::max(numTimes, (size_t) 1), SORT_MIN_CHUNK, [&](size_t lo, size_t hi, int w) {
+        for (size_t i = lo; i < hi && sorted.load(std::memory_order_relaxed); i++) {
+            if (times[i] < times[i - 1]) {
+                sorted.store(false, std::memory_order_relaxed);
+            }
+        }
+    });
+    return sorted.load();
+}
+
+std::vector<unsigned int> timePermutation(const long* times, int numTimes) {
+    ZENITH_TRACE_ZONE("timePermutation");
+    size_t n = static_cast<size_t>(numTimes);
+    if (n < 2 || timesSorted(times, n))
+        return std::vector<unsigned int>();
+
+    // Flipping the sign bit orders signed times as unsigned keys; the radix
+    // sort is stable, so equal times keep their input order.
+    std::vector<uint64_t> keys(n);
+    std::vector<unsigned int> permutation(n);
+    parallelFor(0, n, SORT_MIN_CHUNK, [&](size_t lo, size_t hi, int w) {
+        for (size_t i = lo; i < hi; i++) {
+            keys[i] = static_cast<uint64_t>(times[i]) ^ (UINT64_C(1) << 63);
+            permutation[i] = static_cast<unsigned int>(i);
+        }
+    });
+    radixSortPairs(&keys, &permutation);
+    return permutation;
+}
+
+size_t firstTimeAfter(const long* times, size_t numTimes, long t) {
+    // The answer stays within [lo, hi].
+    size_t lo = 0;
+    size_t hi = numTimes;
+    bool interpolate = true;
+    while (lo < hi) {
+        long first = times[lo];
+        long last = times[hi - 1];
+        if (t < first)
+            return lo;
+        if (t >= last)
+            return hi;
+        // first <= t < last, so there are at least two candidates and mid
+        // lands in [lo, hi - 1).
+        size_t mid;
+        if (interpolate) {
+            // Huge epochs can round first and last to the same double.
+            double fraction = (static_cast<double>(t) - first) / (static_cast<double>(last) - first);
+            if (!(fraction >= 0.0))
+                fraction = 0.0;
+            if (fraction > 1.0)
+                fraction = 1.0;
+            mid = lo + static_cast<size_t>(fraction * (hi - 1 - lo));
+            if (mid >= hi - 1)
+                mid = hi - 2;
+        } else {
+            mid = lo + (hi - 1 - lo) / 2;
+        }
+        if (times[mid] <= t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+        interpolate = !interpolate;
+    }
+    return lo;
+}
+
+#endif
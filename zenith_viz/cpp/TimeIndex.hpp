@@ -0,0 +1,29 @@
+#ifndef ZENITH_CPP_TIMEINDEX_HPP_
+#define ZENITH_CPP_TIMEINDEX_HPP_
+
+#include <cstddef>
+#include <vector>
+
+// Half-open range [begin, end) of layer times.
+struct TimeWindow {
+    long begin;
+    long end;
+};
+
+// Matches the uniform array size in the vertex shader.
+const int MAX_TIME_WINDOWS = 8;
+
+// Checks that times never decrease, in parallel.
+bool timesSorted(const long* times, size_t numTimes);
+
+// Returns the order that sorts times ascending, ties kept in input order:
+// entry i is the caller's index of the time placed at position i. Empty
+// when the times are already sorted.
+std::vector<unsigned int> timePermutation(const long* times, int numTimes);
+
+// Index of the first of numTimes sorted times greater than t, or numTimes.
+// Interpolation probes alternate with bisection, so evenly spaced times
+// take a handful of probes and skewed ones still take O(log n).
+size_t firstTimeAfter(const long* times, size_t numTimes, long t);
+
+#endif  // ZENITH_CPP_TIMEINDEX_HPP_
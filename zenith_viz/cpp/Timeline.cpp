@@ -0,0 +1,109 @@
+#ifndef ZENITH_CPP_TIMELINE_CPP_
+#define ZENITH_CPP_TIMELINE_CPP_
+
+#include "Timeline.hpp"
+#include <algorithm>
+#include <cmath>
+#include "imgui/imgui.h"
+
+Timeline::Timeline() {
+    this->position = 0;
+    this->carry = 0.0;
+    this->rate = 0.0;
+    this->speed = 1.0f;
+    this->fps = 30.0f;
+    this->playing = false;
+    this->loop = true;
+    this->held = false;
+    this->hasLayers = false;
+    this->first = 0;
+    this->last = 0;
+    this->finestStep = 1;
+    this->lastTick = 0.0;
+    this->restart = true;
+}
+
+void Timeline::beginExtent() {
+    this->hasLayers = false;
+}
+
+void Timeline::addExtent(long first, long last, long step) {
+    if (!this->hasLayers) {
+        this->first = first;
+        this->last = last;
+        this->finestStep = step;
+        this->hasLayers = true;
+        return;
+    }
+    this->first = std::min(this->first, first);
+    this->last = std::max(this->last, last);
+    this->finestStep = std::min(this->finestStep, step);
+}
+
+void Timeline::endExtent() {
+    if (this->hasLayers && (this->position < this->first || this->position > this->last))
+        seek(this->first);
+}
+
+void Timeline::play(bool playing) {
+    if (playing && !this->playing) {
+        this->restart = true;
+        if (this->position >= this->last)
+            seek(this->first);
+    }
+    this->playing = playing;
+}
+
+double Timeline::effectiveRate() {
+    double base = this->rate > 0.0 ? this->rate : (double) this->finestStep * this->fps;
+    return base * this->speed;
+}
+
+void Timeline::advance(double now) {
+    double elapsed = this->restart ? 0.0 : now - this->lastTick;
+    this->lastTick = now;
+    this->restart = false;
+    if (!this->playing || this->held || !this->hasLayers || elapsed <= 0.0)
+        return;
+    double delta = elapsed * effectiveRate() + this->carry;
+    double whole = std::floor(delta);
+    this->carry = delta - whole;
+    if (whole < (double) (this->last - this->position)) {
+        this->position += (long) whole;
+    } else if (this->loop) {
+        seek(this->first);
+    } else {
+        seek(this->last);
+        this->playing = false;
+    }
+}
+
+void Timeline::seek(long position) {
+    this->position = std::min(std::max(position, this->first), this->last);
+    this->carry = 0.0;
+}
+
+double Timeline::nextFrameDelay(double now) {
+    if (!this->playing || this->held || !this->hasLayers)
+        return -1.0;
+    double due = this->lastTick + 1.0 / this->fps - now;
+    return due > 0.0 ? due : 0.0;
+}
+
+void Timeline::renderUI() {
+    if (!this->hasLayers)
+        return;
+    if (ImGui::Button(this->playing ? "Pause" : "Play"))
+        play(!this->playing);
+    ImGui::SameLine();
+    ImGui::Checkbox("Loop", &this->loop);
+    // Offsets from the first time keep the slider precise for epoch times.
+    double offset = this->position - (double) this->first;
+    double span = (double) (this->last - this->first);
+    double zero = 0.0;
+    if (ImGui::SliderScalar("Time", ImGuiDataType_Double, &offset, &zero, &span, "+%.0f"))
+        seek(this->first + (long) offset);
+    ImGui::SliderFloat("Speed", &this->speed, 0.05f, 20.0f, "%.2fx");
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef ZENITH_CPP_TIMELINE_HPP_
+#define ZENITH_CPP_TIMELINE_HPP_
+
+// Engine-wide playback clock mapping wall time to data time. Animated layers
+// keep no clock of their own: each frame they are handed the playhead and
+// find what to show with a search of their sorted times, so layers sampled
+// at different rates stay in step and per-layer work is O(log n).
+class Timeline {
+ public:
+    // Data time at the playhead, kept integral so epoch nanoseconds stay
+    // exact; carry holds the fraction of a unit advanced so far.
+    long position;
+    double carry;
+    // Data time units per second of wall time; 0 advances the finest
+    // layer by one step per frame at fps, like the old per-layer clocks.
+    double rate;
+    float speed;
+    float fps;
+    bool playing;
+    bool loop;
+    // Frame export steps the playhead itself.
+    bool held;
+
+    // Refreshed from the animated layers before each frame.
+    bool hasLayers;
+    long first;
+    long last;
+    long finestStep;
+
+    double lastTick;
+    // Set when playback starts, so time spent paused isn't played back.
+    bool restart;
+
+    Timeline();
+    // Layers report their extents between beginExtent and endExtent; a
+    // playhead left outside them moves to the first time.
+    void beginExtent();
+    void addExtent(long first, long last, long step);
+    void endExtent();
+    void play(bool playing);
+    double effectiveRate();
+    // Moves the playhead by the wall time since the last call; at the end
+    // it wraps around when looping and stops otherwise.
+    void advance(double now);
+    void seek(long position);
+    // Seconds until the playhead is due to move, or a negative value while
+    // stopped.
+    double nextFrameDelay(double now);
+    void renderUI();
+};
+
+#endif  // ZENITH_CPP_TIMELINE_HPP_
@@ -0,0 +1,239 @@
+#ifndef ZENITH_CPP_TRACING_CPP_
+#define ZENITH_CPP_TRACING_CPP_
+
+#include "Tracing.hpp"
+#include <chrono>
+
+long long steadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef ZENITH_ENABLE_TRACING
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// 64 bytes an event, so a ring is 1 MiB.
+static const size_t TRACE_RING_EVENTS = 1 << 14;
+static const int GPU_TRACK = 0;
+
+struct TraceEvent {
+    char name[TRACE_NAME_LENGTH];
+    long long start;
+    long long duration;
+    int tid;
+};
+
+// The newest TRACE_RING_EVENTS events of one thread. The mutex is only
+// contended while exporting.
+struct TraceRing {
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    size_t next = 0;
+    size_t count = 0;
+
+    TraceRing() : events(TRACE_RING_EVENTS) {}
+
+    void push(const char* name, long long start, long long duration, int tid) {
+        std::lock_guard<std::mutex> lock(mutex);
+        TraceEvent& event = events[next];
+        memcpy(event.name, name, TRACE_NAME_LENGTH);
+        event.start = start;
+        event.duration = duration;
+        event.tid = tid;
+        next = (next + 1) % events.size();
+        count = std::min(count + 1, events.size());
+    }
+};
+
+// Rings outlive their threads: a finished thread's ring keeps its events
+// and is handed to the next new thread, so short-lived workers don't grow
+// the trace without bound. Never freed, as threads may still record while
+// statics are destroyed.
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceRing>> rings;
+    std::vector<TraceRing*> freeRings;
+    std::map<int, std::string> threadNames;
+    int nextTid = GPU_TRACK + 1;
+    TraceRing gpuRing;
+    std::mutex gpuMutex;
+    // End of the last zone on the GPU track.
+    long long gpuCursor = 0;
+};
+
+static TraceRegistry& registry() {
+    static TraceRegistry* instance = new TraceRegistry();
+    return *instance;
+}
+
+struct ThreadTrace {
+    TraceRing* ring = nullptr;
+    int tid = 0;
+
+    ~ThreadTrace() {
+        if (ring == nullptr)
+            return;
+        TraceRegistry& traces = registry();
+        std::lock_guard<std::mutex> lock(traces.mutex);
+        traces.freeRings.push_back(ring);
+    }
+};
+
+static thread_local ThreadTrace threadTrace;
+
+static ThreadTrace& currentThread() {
+    if (threadTrace.ring == nullptr) {
+        TraceRegistry& traces = registry();
+        std::lock_guard<std::mutex> lock(traces.mutex);
+        if (traces.freeRings.empty()) {
+            traces.rings.emplace_back(new TraceRing());
+            threadTrace.ring = traces.rings.back().get();
+        } else {
+            threadTrace.ring = traces.freeRings.back();
+            traces.freeRings.pop_back();
+        }
+        threadTrace.tid = traces.nextTid++;
+    }
+    return threadTrace;
+}
+
+static void copyName(char* to, const char* from) {
+    strncpy(to, from, TRACE_NAME_LENGTH - 1);
+    to[TRACE_NAME_LENGTH - 1] = '\0';
+}
+
+TraceZone::TraceZone(const char* name) {
+    copyName(this->name, name);
+    this->start = steadyNanoseconds();
+}
+
+TraceZone::TraceZone(const std::string& name) : TraceZone(name.c_str()) {}
+
+TraceZone::~TraceZone() {
+    long long end = steadyNanoseconds();
+    ThreadTrace& thread = currentThread();
+    thread.ring->push(name, start, end - start, thread.tid);
+}
+
+void traceGpuZone(const char* name, long long submitted, long long duration) {
+    TraceRegistry& traces = registry();
+    std::lock_guard<std::mutex> lock(traces.gpuMutex);
+    // Queries finish in order, so each starts after the one before.
+    long long start = std::max(submitted, traces.gpuCursor);
+    traces.gpuCursor = start + duration;
+    char copied[TRACE_NAME_LENGTH];
+    copyName(copied, name);
+    traces.gpuRing.push(copied, start, duration, GPU_TRACK);
+}
+
+void traceThreadName(const char* name) {
+    ThreadTrace& thread = currentThread();
+    TraceRegistry& traces = registry();
+    std::lock_guard<std::mutex> lock(traces.mutex);
+    traces.threadNames[thread.tid] = name;
+}
+
+static void writeJsonString(FILE* out, const char* text) {
+    fputc('"', out);
+    for (const char* c = text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\')
+            fprintf(out, "\\%c", *c);
+        else if ((unsigned char) *c < 0x20)
+            fprintf(out, "\\u%04x", (unsigned char) *c);
+        else
+            fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+static void copyRing(TraceRing* ring, std::vector<TraceEvent>* events) {
+    std::lock_guard<std::mutex> lock(ring->mutex);
+    size_t first = (ring->next + ring->events.size() - ring->count) % ring->events.size();
+    for (size_t i = 0; i < ring->count; i++) {
+        events->push_back(ring->events[(first + i) % ring->events.size()]);
+    }
+}
+
+bool traceExport(const std::string& path) {
+    std::vector<TraceEvent> events;
+    std::map<int, std::string> names;
+    {
+        TraceRegistry& traces = registry();
+        std::lock_guard<std::mutex> lock(traces.mutex);
+        for (auto && ring : traces.rings) {
+            copyRing(ring.get(), &events);
+        }
+        copyRing(&traces.gpuRing, &events);
+        names = traces.threadNames;
+        for (int tid = GPU_TRACK + 1; tid < traces.nextTid; tid++) {
+            if (names.count(tid) == 0)
+                names[tid] = "thread " + std::to_string(tid);
+        }
+        names[GPU_TRACK] = "GPU";
+    }
+
+    FILE* out = fopen(path.c_str(), "w");
+    if (out == nullptr) {
+        fprintf(stderr, "zenith: could not open %s\n", path.c_str());
+        return false;
+    }
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    const char* separator = "";
+    for (auto && name : names) {
+        fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": ",
+                separator, name.first);
+        writeJsonString(out, name.second.c_str());
+        fprintf(out, "}}");
+        separator = ",\n";
+    }
+    for (auto && event : events) {
+        fprintf(out, "%s{\"name\": ", separator);
+        writeJsonString(out, event.name);
+        fprintf(out, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                event.tid, event.start / 1000.0, event.duration / 1000.0);
+        separator = ",\n";
+    }
+    fprintf(out, "\n]}\n");
+    return fclose(out) == 0;
+}
+
+void traceClear() {
+    TraceRegistry& traces = registry();
+    std::lock_guard<std::mutex> lock(traces.mutex);
+    auto clear = [](TraceRing* ring) {
+        std::lock_guard<std::mutex> ringLock(ring->mutex);
+        ring->next = 0;
+        ring->count = 0;
+    };
+    for (auto && ring : traces.rings) {
+        clear(ring.get());
+    }
+    clear(&traces.gpuRing);
+}
+
+bool traceEnabled() {
+    return true;
+}
+
+#else
+
+bool traceExport(const std::string& path) {
+    return false;
+}
+
+void traceClear() {}
+
+bool traceEnabled() {
+    return false;
+}
+
+#endif
+
+#endif
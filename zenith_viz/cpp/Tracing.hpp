@@ -0,0 +1,63 @@
+#ifndef ZENITH_CPP_TRACING_HPP_
+#define ZENITH_CPP_TRACING_HPP_
+
+#include <string>
+
+// Scoped timing zones for profiling the renderer, exported as Chrome
+// trace-event JSON (chrome://tracing, Perfetto). Built with
+// ZENITH_ENABLE_TRACING (ZENITH_ENABLE_TRACING=1 pip install ., or the
+// CMake option of the same name); otherwise the macros expand to nothing
+// and their arguments are never evaluated.
+//
+//   ZENITH_TRACE_ZONE("GLModel::render");      CPU time until scope exit
+//   ZENITH_TRACE_THREAD("render");             names the calling thread
+//   ZENITH_TRACE_GPU(name, submitted, ns);     a GPU time measured elsewhere
+//
+// Every thread writes its zones into its own ring of the most recent
+// events, so recording takes no shared lock. The per-layer GPU times are
+// FrameStats' GL_TIME_ELAPSED queries, read back a frame or two later; they
+// land on a separate "GPU" track, starting no earlier than submission.
+
+// Writes the recorded zones to path. False when tracing is compiled out or
+// the file can't be written.
+bool traceExport(const std::string& path);
+// Drops the recorded zones.
+void traceClear();
+bool traceEnabled();
+// Nanoseconds on the monotonic clock the zones are timed with.
+long long steadyNanoseconds();
+
+#ifdef ZENITH_ENABLE_TRACING
+
+static const int TRACE_NAME_LENGTH = 40;
+
+class TraceZone {
+ public:
+    explicit TraceZone(const char* name);
+    explicit TraceZone(const std::string& name);
+    ~TraceZone();
+
+ private:
+    char name[TRACE_NAME_LENGTH];
+    long long start;
+};
+
+void traceThreadName(const char* name);
+// submitted is steadyNanoseconds() when the GPU work was issued.
+void traceGpuZone(const char* name, long long submitted, long long duration);
+
+#define ZENITH_TRACE_CONCAT_(a, b) a##b
+#define ZENITH_TRACE_CONCAT(a, b) ZENITH_TRACE_CONCAT_(a, b)
+#define ZENITH_TRACE_ZONE(name) TraceZone ZENITH_TRACE_CONCAT(traceZone, __LINE__)(name)
+#define ZENITH_TRACE_THREAD(name) traceThreadName(name)
+#define ZENITH_TRACE_GPU(name, submitted, duration) traceGpuZone(name, submitted, duration)
+
+#else
+
+#define ZENITH_TRACE_ZONE(name)
+#define ZENITH_TRACE_THREAD(name)
+#define ZENITH_TRACE_GPU(name, submitted, duration)
+
+#endif
+
+#endif  // ZENITH_CPP_TRACING_HPP_
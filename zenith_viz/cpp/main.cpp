@@ -51,9 +51,8 @@ GLModel* readData() {
 
 
 int main() {
-  auto shaderPath = new std::string("/home/mpfaffenberger/code/zenith/zenith/shaders");
-  auto engine = new Engine(*shaderPath);
+  auto engine = new Engine();
   auto model = readData();
-  engine->models->insert(std::pair<int, GLModel*>(0, model));
+  engine->addModel(0, std::shared_ptr<GLModel>(model));
   engine->animate();
 };
@@ -40,6 +40,7 @@
 #include <queue>
 #include <limits>
 #include <cmath>
+#include <functional>
 
 #pragma once
 
@@ -123,6 +124,14 @@ public:
 
     // Function that uses the tree to find the k nearest neighbors of target
     void search(const T& target, int k, std::vector<T>* results, std::vector<float>* distances)
+    {
+        search(target, k, results, distances, nullptr);
+    }
+
+    // Same, but only items for which accept(item.index()) is true can be
+    // returned.
+    void search(const T& target, int k, std::vector<T>* results, std::vector<float>* distances,
+                const std::function<bool(int)>* accept)
     {
 
         // Use a priority queue to store intermediate results on
@@ -132,7 +141,7 @@ public:
         _tau = std::numeric_limits<float>::max();
 
         // Perform the search
-        search(_root, target, k, heap);
+        search(_root, target, k, heap, accept);
 
         // Gather final results
         //results->clear(); distances->clear();
@@ -240,7 +249,8 @@ public:
     }
 
     // Helper function that searches the tree
-    void search(Node* node, const T& target, int k, std::priority_queue<HeapItem>& heap)
+    void search(Node* node, const T& target, int k, std::priority_queue<HeapItem>& heap,
+                const std::function<bool(int)>* accept)
     {
         if(node == NULL) return;     // indicates that we're done here
 
@@ -248,7 +258,7 @@ public:
         float dist = distance(_items[node->index], target);
 
         // If current node within radius tau
-        if(dist < _tau) {
+        if(dist < _tau && (accept == nullptr || (*accept)(_items[node->index].index()))) {
             if(heap.size() == k) heap.pop();                 // remove furthest node from result list (if we already have k results)
             heap.push(HeapItem(node->index, dist));           // add current node to result list
             if(heap.size() == k) _tau = heap.top().dist;     // update value of tau (farthest point in result list)
@@ -262,21 +272,21 @@ public:
         // If the target lies within the radius of ball
         if(dist < node->threshold) {
             if(dist - _tau <= node->threshold) {         // if there can still be neighbors inside the ball, recursively search left child first
-                search(node->left, target, k, heap);
+                search(node->left, target, k, heap, accept);
             }
 
             if(dist + _tau >= node->threshold) {         // if there can still be neighbors outside the ball, recursively search right child
-                search(node->right, target, k, heap);
+                search(node->right, target, k, heap, accept);
             }
 
             // If the target lies outsize the radius of the ball
         } else {
             if(dist + _tau >= node->threshold) {         // if there can still be neighbors outside the ball, recursively search right child first
-                search(node->right, target, k, heap);
+                search(node->right, target, k, heap, accept);
             }
 
             if (dist - _tau <= node->threshold) {         // if there can still be neighbors inside the ball, recursively search left child
-                search(node->left, target, k, heap);
+                search(node->left, target, k, heap, accept);
             }
         }
     }
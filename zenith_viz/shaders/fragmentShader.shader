@@ -1,26 +1,26 @@
-#version 330 core
-#define Thickness 4.0
-
+// Compiled into ShaderLibrary.cpp as a raw string literal, behind the same
+// #version line and feature #defines as vertexShader.shader.
+R"glsl(
 #ifdef GL_ES
 precision mediump float;
 #endif
 
 in vec4 fragment_color;
-uniform vec2 u_resolution;
-uniform vec2 u_mouse;
-uniform float u_time;
-uniform int is_point;
-out float dist;
+in float time_visible;
 out vec4 fragColor;
 
 void main() {
-    if (is_point > 0) {
-        float r = 0.0;
-        vec2 cxy = 2.0 * gl_PointCoord - 1.0;
-        r = dot(cxy, cxy);
-        if (r > 1.0) {
-            discard;
-        }
+#if defined(TIME_WINDOWS) || defined(KEYFRAMES)
+    if (time_visible < 0.5) {
+        discard;
+    }
+#endif
+#ifdef POINTS
+    vec2 cxy = 2.0 * gl_PointCoord - 1.0;
+    if (dot(cxy, cxy) > 1.0) {
+        discard;
     }
+#endif
     fragColor = fragment_color;
-}
\ No newline at end of file
+}
+)glsl"
@@ -1,33 +1,101 @@
-#version 330 core
-
+// Compiled into ShaderLibrary.cpp as a raw string literal. ShaderLibrary
+// puts the #version line and the variant's feature #defines in front:
+// POINTS, COLOR_DATA, LAYER_TABLE, PICKING, TIME_WINDOWS, KEYFRAMES.
+R"glsl(
 layout(location = 0) in vec3 vertexPosition_modelspace;
 layout(location = 1) in vec3 vertex_color;
+layout(location = 2) in float layer_slot;
+layout(location = 3) in uint time_offset;
+layout(location = 4) in vec4 keyframe_from;
+layout(location = 5) in vec4 keyframe_to;
+
+#define MAX_TIME_WINDOWS 8
+
+// The std140 blocks mirror FrameUniforms and LayerUniforms in
+// ShaderLibrary.hpp.
+layout(std140) uniform Frame {
+    mat4 MVP;
+    vec3 picking_point;
+};
+
+// Unused by batches, which read their layers from layer_table.
+layout(std140) uniform Layer {
+    vec4 color;
+    float point_size;
+    float time_fade;
+    float keyframe_mix;
+    int num_time_windows;
+    // [begin, end) pairs, two to an element.
+    uvec4 time_windows[MAX_TIME_WINDOWS / 2];
+};
 
-uniform vec3 picking_point;
-uniform mat4 MVP;
-uniform vec4 color;
-uniform float point_size;
-uniform float use_color_data;
+#ifdef LAYER_TABLE
+uniform sampler2D layer_table;
+#endif
 
 out vec4 fragment_color;
+out float time_visible;
 
 void main() {
+#if defined(LAYER_TABLE)
+    int slot = int(layer_slot + 0.5);
+    vec4 layer_color = texelFetch(layer_table, ivec2(slot, 0), 0);
+    vec4 layer_params = texelFetch(layer_table, ivec2(slot, 1), 0);
+    float layer_point_size = layer_params.x;
+    bool layer_use_color_data = layer_params.y > 0.0;
+#else
+    vec4 layer_color = color;
+    float layer_point_size = point_size;
+#ifdef COLOR_DATA
+    const bool layer_use_color_data = true;
+#else
+    const bool layer_use_color_data = false;
+#endif
+#endif
 
-    gl_Position =  MVP * vec4(vertexPosition_modelspace, 1);
-    gl_PointSize = point_size;
+    vec3 position = vertexPosition_modelspace;
+    time_visible = 1.0;
+#ifdef KEYFRAMES
+    // Entity tracks: interpolate between the keyframes either side of the
+    // playhead. w is 1 where the entity exists; one that exists at only one
+    // keyframe stays there and shows for the nearer half of the step.
+    vec3 from = keyframe_from.w > 0.5 ? keyframe_from.xyz : keyframe_to.xyz;
+    vec3 to = keyframe_to.w > 0.5 ? keyframe_to.xyz : keyframe_from.xyz;
+    position = mix(from, to, keyframe_mix);
+    time_visible = step(0.5, mix(keyframe_from.w, keyframe_to.w, keyframe_mix));
+#endif
 
-    if (use_color_data > 0.0f) {
+    gl_Position =  MVP * vec4(position, 1);
+    gl_PointSize = layer_point_size;
+
+    if (layer_use_color_data) {
         fragment_color.xyz = vertex_color;
-        fragment_color.w = color.w;
+        fragment_color.w = layer_color.w;
     } else {
-        fragment_color = color;
+        fragment_color = layer_color;
+#ifdef PICKING
         float eps = 1e-3;
-        float picking_dist = distance(picking_point, vertexPosition_modelspace.xyz);
+        float picking_dist = distance(picking_point, position);
         if (picking_dist < eps) {
-            fragment_color.x = 0.8;
-            fragment_color.y = 0.8;
-            fragment_color.z = 0.0;
-            fragment_color.w = 1.0;
+            fragment_color = vec4(0.8, 0.8, 0.0, 1.0);
+        }
+#endif
+    }
+
+#ifdef TIME_WINDOWS
+    // Animated layers: keep vertices inside one of the [begin, end) windows,
+    // the newest at full alpha.
+    time_visible = 0.0;
+    for (int i = 0; i < num_time_windows; i++) {
+        uvec4 pair = time_windows[i / 2];
+        uvec2 window = i % 2 == 0 ? pair.xy : pair.zw;
+        if (time_offset >= window.x && time_offset < window.y) {
+            float age = float(window.y - 1u - time_offset) / float(max(window.y - window.x, 1u));
+            fragment_color.w *= 1.0 - time_fade * age;
+            time_visible = 1.0;
+            break;
         }
     }
-}
\ No newline at end of file
+#endif
+}
+)glsl"
@@ -3,10 +3,11 @@ import os
 import re
 import struct
 import threading
+import zlib
 from abc import ABC
 from enum import Enum
 from functools import reduce, partial
-from typing import Collection, Union, Optional, Tuple, Type, Set, List
+from typing import Callable, Collection, Union, Optional, Tuple, Type, Set, Dict, List
 
 import jellyfish
 import numpy as np
@@ -16,7 +17,6 @@ import _zenith
 
 directory = os.path.dirname(os.path.abspath(__file__))
 color_yaml = directory + "/resources/colors.yml"
-shaders = directory + "/shaders"
 
 with open(color_yaml, "r") as f:
     color_lookup = yaml.load(f, yaml.Loader)
@@ -41,20 +41,69 @@ class DrawStyles(Enum):
     GL_POLYGON = 9
 
 
+class SpatialOrder(Enum):
+    NONE = 0
+    MORTON = 1
+    HILBERT = 2
+
+
+def write_image(path: str, image: np.ndarray) -> None:
+    """Write a (height, width, 4) uint8 RGBA array as PNG, or as binary PPM
+    (RGB) when the path does not end in .png."""
+    height, width = image.shape[:2]
+    if not path.lower().endswith(".png"):
+        with open(path, "wb") as out:
+            out.write("P6\n{} {}\n255\n".format(width, height).encode("ascii"))
+            out.write(np.ascontiguousarray(image[:, :, :3]).tobytes())
+        return
+
+    def chunk(tag: bytes, data: bytes) -> bytes:
+        crc = zlib.crc32(tag + data) & 0xFFFFFFFF
+        return struct.pack(">I", len(data)) + tag + data + struct.pack(">I", crc)
+
+    # Filter type 0 (none) in front of every row.
+    rows = np.zeros((height, width * 4 + 1), dtype=np.uint8)
+    rows[:, 1:] = image.reshape(height, width * 4)
+    with open(path, "wb") as out:
+        out.write(b"\x89PNG\r\n\x1a\n")
+        out.write(chunk(b"IHDR", struct.pack(">IIBBBBB", width, height, 8, 6, 0, 0, 0)))
+        out.write(chunk(b"IDAT", zlib.compress(rows.tobytes(), 6)))
+        out.write(chunk(b"IEND", b""))
+
+
+def tracing_enabled() -> bool:
+    """Whether the extension was built with ZENITH_ENABLE_TRACING=1."""
+    return _zenith.tracing_enabled()
+
+
+def export_trace(path: str) -> bool:
+    """Write the profiling zones recorded so far (the render loop's phases,
+    layer draws with their GPU times, picking, ingest and index builds) as
+    Chrome trace-event JSON, for chrome://tracing or ui.perfetto.dev. Each
+    thread keeps its most recent zones. False when tracing is not built in
+    or the file can't be written."""
+    return _zenith.export_trace(path)
+
+
+def clear_trace() -> None:
+    """Drop the profiling zones recorded so far."""
+    _zenith.clear_trace()
+
+
 class ZenithCommon(ABC):
     __num_layers__: int
     __engine__: _zenith.Engine
     __layer_ids__: Set[int]
-    __layers__: List[_zenith.GLModel]
+    __layers__: Dict[int, _zenith.GLModel]
     __logger__: logging.Logger
 
     def __init__(self):
         self.__num_layers__: int = 0
         self.__layer_ids__: Set[int] = set()
-        self.__layers__: List[_zenith.GLModel] = []
+        self.__layers__: Dict[int, _zenith.GLModel] = {}
         self.__logger__: logging.Logger = logging.Logger(__name__)
         self.__logger__.setLevel(logging.INFO)
-        self.__string_data__ = []
+        self.__string_data__ = {}
 
     def _check_values(
         self,
@@ -105,14 +154,299 @@ class ZenithCommon(ABC):
             )
             return 0
 
-    def show(self) -> bool:
+    def _check_spatial_order(self, spatial_order: Union[int, SpatialOrder]) -> int:
+        if type(spatial_order) == SpatialOrder:
+            spatial_order = spatial_order.value
+        if 0 <= spatial_order <= 2:
+            return spatial_order
+        else:
+            self.__logger__.error(
+                "Must pick spatial order from the SpatialOrder Enum -- DEFAULTING TO NONE"
+            )
+            return 0
+
+    def show(self, block: bool = True) -> bool:
+        """Open the window. With block=False the window runs on its own
+        render thread and show() returns at once; layer changes made
+        meanwhile are applied between frames. Not available on macOS,
+        where windows must live on the main thread."""
+        if not block:
+            if not self.__engine__.start():
+                self.__logger__.error(
+                    "Could not start a render thread -- already showing, or unsupported on this platform"
+                )
+                return False
+            return True
         if threading.current_thread() is not threading.main_thread():
             return False
         self.__engine__.animate()
         return True
 
-    def remove_layer(self, layer_id: int) -> bool:
-        return self.__engine__.remove_model(layer_id)
+    def wait(self) -> None:
+        """Block until a window opened with show(block=False) is closed."""
+        self.__engine__.join()
+
+    def close(self) -> None:
+        """Ask an open window to close after its current frame."""
+        self.__engine__.close()
+
+    def set_keep_resident(self, enabled: bool) -> None:
+        """Hide the window when it is closed instead of destroying it, so
+        the next show() reopens it at once: the GL context, shaders and
+        layer buffers stay on the GPU in the meantime. Turning this off,
+        rendering offscreen or deleting the plot frees a hidden window."""
+        self.__engine__.set_keep_resident(enabled).result()
+
+    def set_background_uploads(self, min_bytes: int = 16 << 20) -> None:
+        """Upload layers of at least min_bytes of vertex data to the GPU on a
+        loader thread, so the window stays responsive and each layer appears
+        once it is ready. 0 uploads everything on the render thread. Applies
+        to windows opened afterwards; offscreen rendering is unaffected."""
+        self.__engine__.set_background_uploads(min_bytes).result()
+
+    def set_batching(self, enabled: bool, max_vertices: int = 65536) -> None:
+        """Pack runs of consecutive static layers of up to max_vertices
+        points that share a draw style into shared buffers, each run drawn
+        with one multi-draw call. Layers still stack in the order they were
+        added."""
+        self.__engine__.set_batching(enabled, max_vertices).result()
+
+    def set_continuous_rendering(self, enabled: bool) -> None:
+        """Redraw every iteration of the render loop instead of only when
+        input arrives, layers change or an animation needs a new frame."""
+        self.__engine__.set_continuous_rendering(enabled)
+
+    def set_time_windows(
+        self,
+        layer_id: int,
+        windows: Optional[Collection[Tuple[int, int]]] = None,
+        fade: float = 0.0,
+    ) -> bool:
+        """Show only the points of an animated layer whose time falls in one
+        of up to 8 [begin, end) windows, instead of following playback.
+        fade in [0, 1] dims older points within a window toward
+        transparency, for trails. Picking ignores hidden points. Passing no
+        windows returns the layer to playback. False for static layers."""
+        windows = [(int(begin), int(end)) for begin, end in (windows or [])]
+        return self.__engine__.set_time_windows(layer_id, windows, fade).result()
+
+    def set_timeline(
+        self,
+        position: Optional[int] = None,
+        playing: Optional[bool] = None,
+        rate: Optional[float] = None,
+        loop: Optional[bool] = None,
+    ) -> None:
+        """Control the clock shared by every animated layer. position seeks
+        to a time in the layers' units and is clamped to their range; rate
+        is time units per second, 0 for one of the finest step per frame.
+        Arguments left as None are unchanged."""
+        self.__engine__.set_timeline(position, playing, rate, loop).result()
+
+    def timeline(self) -> dict:
+        """The shared clock: position, first and last time over all animated
+        layers, the effective rate, and whether it is playing and looping."""
+        return self.__engine__.timeline()
+
+    def buffer_stats(self) -> dict:
+        """GPU buffer arena usage: blocks, reserved/used/free bytes, the
+        largest free range, bytes moved by background compaction, the
+        removed layers whose buffers wait on the GPU to be released and the
+        layers still uploading on the loader thread (see
+        set_background_uploads)."""
+        return self.__engine__.buffer_stats()
+
+    def memory_stats(self) -> dict:
+        """Bytes held by each layer, keyed by layer id, split into CPU and GPU
+        components (vertices, colors, time, strings, picking, permutation;
+        GPU vertices, colors, time, batch slots), plus totals for the plot."""
+        return self.__engine__.memory_stats()
+
+    def frame_stats(self) -> dict:
+        """Statistics of the latest frame drawn in the window (or replayed
+        by benchmark_camera_path): frame_ms holds the times of up to 240
+        recent frames, oldest first; draw_calls, vertices, culled_vertices
+        (left out by time windows), upload_bytes and pick_ms are the last
+        frame's, and phase_ms splits its time into update, pick, draw, ui
+        and present; input_latency_ms holds the time from input to the end
+        of the buffer swap of up to 240 recent frames that handled input;
+        gpu_ms maps each layer, or "batch: ..." for layers drawn together,
+        to its GPU time in a frame or two before. Also shown under Stats in
+        the control panel. Reading never waits for the render loop."""
+        return self.__engine__.frame_stats()
+
+    def shader_stats(self) -> dict:
+        """Shader programs built so far: each combination of layer features
+        (points or lines, color data, picking, time windows, keyframes) is
+        its own program, built the first time it is drawn. compiled counts
+        programs compiled from source and loaded those read back from the
+        program binary cache; binds counts program switches, made only
+        between consecutive layers of different kinds; binaries is
+        whether the driver supports that cache. The cache lives under ZENITH_SHADER_CACHE, or zenith_viz in
+        the user's cache directory; set ZENITH_SHADER_CACHE to an empty
+        string to turn it off."""
+        return self.__engine__.shader_stats()
+
+    def set_memory_budget(
+        self,
+        cpu_bytes: int = 0,
+        gpu_bytes: int = 0,
+        callback: Optional[Callable[[int, int], None]] = None,
+    ) -> None:
+        """Call callback(cpu_bytes, gpu_bytes) whenever layer memory goes
+        over budget. A budget of 0 is unlimited; without a callback a
+        warning is logged."""
+        if callback is None:
+            # The engine holds the callback from C++, where the garbage
+            # collector can't see a cycle back to this plot.
+            logger = self.__logger__
+
+            def callback(cpu: int, gpu: int) -> None:
+                logger.warning(
+                    "Memory budget exceeded: {} bytes CPU, {} bytes GPU".format(cpu, gpu)
+                )
+
+        self.__engine__.set_memory_budget(cpu_bytes, gpu_bytes, callback)
+
+    def render_to_array(
+        self,
+        width: int,
+        height: int,
+        camera: Optional[dict] = None,
+        layers: Optional[Collection[int]] = None,
+    ) -> Optional[np.ndarray]:
+        """Render the plot offscreen, without a display, into a
+        (height, width, 4) uint8 RGBA array. camera may set center, scale
+        (2D world units per pixel), distance, yaw and pitch (radians) and
+        fov (degrees); anything left out fits every layer in view. layers
+        limits the image to those layer ids. Returns None while the window
+        is open or when no offscreen GL context is available."""
+        image = self.__engine__.render_to_array(width, height, camera, layers)
+        if image is None:
+            self.__logger__.error("Offscreen rendering is unavailable")
+        return image
+
+    def render_batch(
+        self,
+        width: int,
+        height: int,
+        cameras: Collection[Optional[dict]],
+        layer_sets: Optional[Collection[Collection[int]]] = None,
+    ) -> Optional[List[np.ndarray]]:
+        """Render one image per camera, or per layer set, reusing a single
+        offscreen context. When both are given the shorter list repeats its
+        last entry."""
+        images = self.__engine__.render_batch(
+            width,
+            height,
+            list(cameras),
+            None if layer_sets is None else [list(layers) for layers in layer_sets],
+        )
+        if images is None:
+            self.__logger__.error("Offscreen rendering is unavailable")
+        return images
+
+    def save_image(
+        self,
+        path: str,
+        width: int,
+        height: int,
+        camera: Optional[dict] = None,
+        layers: Optional[Collection[int]] = None,
+    ) -> bool:
+        """Render offscreen like render_to_array and write a .png, or a .ppm
+        for any other extension."""
+        image = self.render_to_array(width, height, camera, layers)
+        if image is None:
+            return False
+        write_image(path, image)
+        return True
+
+    def export_frames(
+        self,
+        path: str,
+        width: int,
+        height: int,
+        frames: int = 0,
+        fps: int = 30,
+        camera: Optional[dict] = None,
+        threads: int = 0,
+    ) -> Optional[dict]:
+        """Render an animation offscreen, advancing every animated layer by
+        exactly one step per frame regardless of how long frames take, so
+        the output is the same on any machine. A .y4m path writes a YUV4MPEG2
+        video, a path ending in .png writes one file per frame (formatted
+        with the frame index, e.g. "frames/%05d.png"), and anything else
+        writes raw RGBA frames back to back. frames=0 exports one full
+        animation cycle. Returns frames, seconds, fps and bytes_written."""
+        extension = os.path.splitext(path)[1].lower()
+        frame_format = {".y4m": 1, ".png": 2}.get(extension, 0)
+        stats = self.__engine__.export_frames(
+            path, width, height, frames, frame_format, fps, camera, threads
+        )
+        if stats is None:
+            self.__logger__.error("Frame export to %s failed", path)
+            return None
+        self.__logger__.info(
+            "Exported %d frames in %.2fs (%.1f fps)",
+            stats["frames"],
+            stats["seconds"],
+            stats["fps"],
+        )
+        return stats
+
+    def record_camera_path(self, enabled: bool = True) -> None:
+        """Record the pan, zoom, rotation and cursor of every frame the
+        window draws, with timestamps, until called with False. Starting
+        again discards the previous recording."""
+        self.__engine__.record_camera_path(enabled).result()
+
+    def save_camera_path(self, path: str) -> bool:
+        """Write the recorded camera path to a text file for
+        benchmark_camera_path."""
+        if not self.__engine__.save_camera_path(path):
+            self.__logger__.error("Could not write camera path %s", path)
+            return False
+        return True
+
+    def benchmark_camera_path(
+        self,
+        path: Optional[str] = None,
+        width: int = 1024,
+        height: int = 768,
+        frames: int = 300,
+    ) -> Optional[dict]:
+        """Replay a saved camera path offscreen as fast as possible, with
+        hover picking at the recorded cursor, and time every frame. Without
+        a path a synthetic one of frames frames at width x height pans,
+        zooms and turns over the layers. Returns p50/p95/p99/max/mean frame
+        times in milliseconds, the mean CPU time per phase (update, pick,
+        draw, finish) and the draw calls of each frame."""
+        report = self.__engine__.replay_camera_path(path, width, height, frames)
+        if report is None:
+            self.__logger__.error("Camera path replay is unavailable")
+        return report
+
+    def close_headless(self) -> None:
+        """Free the offscreen context and the GPU buffers it holds. Opening
+        the window does this as well."""
+        self.__engine__.close_headless()
+
+    def remove_layer(
+        self, layer_id: int, block: bool = True
+    ) -> Union[bool, _zenith.CommandFuture]:
+        """Remove a layer. With block=False, return a CommandFuture whose
+        result() is whether the layer existed, once the render loop has
+        applied the removal."""
+        removed = self.__engine__.remove_model(layer_id)
+        # The engine frees the layer's GPU buffers once the GPU is done with
+        # them; dropping our references lets its CPU data go with them.
+        self.__layers__.pop(layer_id, None)
+        self.__string_data__.pop(layer_id, None)
+        self.__layer_ids__.discard(layer_id)
+        if not block:
+            return removed
+        return removed.result()
 
     def check_color_data(self, color_data):
         if color_data is None:
@@ -195,11 +529,165 @@ class ZenithCommon(ABC):
             return string_data
         return []
 
+    def _add_tracks(
+        self,
+        vertex_data: np.ndarray,
+        entity_ids: Collection[int],
+        time_data: Collection[int],
+        color: Union[str, Collection[int], Collection[float]],
+        draw_style: Union[int, DrawStyles],
+        step: int,
+        name: str,
+    ) -> Union[int, bool]:
+        num_vertices = len(vertex_data) // 3
+        if (
+            len(entity_ids) != num_vertices
+            or np.array(entity_ids).dtype.name not in {"int32", "int64"}
+        ):
+            self.__logger__.error(
+                "entity_ids must be integers, one per point"
+            )
+            return False
+        draw_style = self._check_draw_style(draw_style)
+        if not self._check_name(name):
+            return False
+        if step < 1:
+            self.__logger__.error("Step must be gt than 0")
+            return False
+        color = (
+            np.array(self.__validate_and_map_color__(color), dtype=np.float32) / 255.0
+        )
+
+        self.__num_layers__ = self.__num_layers__ + 1
+        model_id = self.__num_layers__
+
+        model = _zenith.create_gl_model_tracks(
+            vertex_data.astype(np.float32),
+            num_vertices,
+            3,
+            0,
+            draw_style,
+            step,
+            np.array(entity_ids, dtype=np.int64),
+            np.array(time_data, dtype=np.int64),
+            name,
+            color,
+            model_id,
+        )
+        self.__engine__.add_model(model_id, model)
+        self.__layers__[model_id] = model
+        self.__string_data__[model_id] = []
+        self.__layer_ids__.add(model_id)
+        return model_id
+
+    def _add_streamed(
+        self,
+        vertex_data: Optional[np.ndarray],
+        time_data: Optional[Collection[int]],
+        paths: Optional[Tuple[str, str]],
+        color: Union[str, Collection[int], Collection[float]],
+        draw_style: Union[int, DrawStyles],
+        window_size: int,
+        name: str,
+        chunk_points: int,
+    ) -> Union[int, bool]:
+        draw_style = self._check_draw_style(draw_style)
+        # Each chunk is drawn on its own, so only styles whose primitives
+        # can be cut between chunks are allowed.
+        if draw_style not in (
+            DrawStyles.GL_POINTS.value,
+            DrawStyles.GL_LINES.value,
+            DrawStyles.GL_LINE_STRIP.value,
+            DrawStyles.GL_TRIANGLES.value,
+        ):
+            self.__logger__.error(
+                "Streamed layers draw points, lines, line strips or triangles"
+            )
+            return False
+        if not self._check_name(name):
+            return False
+        if window_size < 1 or chunk_points < 1:
+            self.__logger__.error("Window size and chunk points must be gt than 0")
+            return False
+        color = (
+            np.array(self.__validate_and_map_color__(color), dtype=np.float32) / 255.0
+        )
+
+        self.__num_layers__ = self.__num_layers__ + 1
+        model_id = self.__num_layers__
+        if paths is None:
+            time_array = np.array(time_data, dtype=np.int64)
+            vertices = vertex_data.reshape(-1, 3)
+            if len(time_array) > 1 and (np.diff(time_array) < 0).any():
+                order = np.argsort(time_array, kind="stable")
+                time_array = time_array[order]
+                vertices = vertices[order]
+            model = _zenith.create_gl_model_streamed(
+                np.ascontiguousarray(vertices, dtype=np.float32),
+                time_array,
+                3,
+                draw_style,
+                window_size,
+                window_size,
+                chunk_points,
+                name,
+                color,
+                model_id,
+            )
+        else:
+            model = _zenith.create_gl_model_streamed_from_files(
+                paths[0],
+                paths[1],
+                3,
+                draw_style,
+                window_size,
+                window_size,
+                chunk_points,
+                name,
+                color,
+                model_id,
+            )
+        if model is None:
+            self.__logger__.error("Could not create streamed layer {}".format(name))
+            return False
+        self.__engine__.add_model(model_id, model)
+        self.__layers__[model_id] = model
+        self.__string_data__[model_id] = []
+        self.__layer_ids__.add(model_id)
+        return model_id
+
+    def add_streamed_layer_from_files(
+        self,
+        vertex_path: str,
+        time_path: str,
+        color: Union[str, Collection[int], Collection[float]],
+        draw_style: Union[int, DrawStyles],
+        window_size: int,
+        name: str,
+        chunk_points: int = 1 << 20,
+    ) -> Union[int, bool]:
+        """Play back a series far larger than GPU memory straight from disk.
+        vertex_path holds float32 x, y, z per sample and time_path the
+        int64 times, sorted, e.g. written with numpy's tofile(). The files
+        are memory mapped; only the chunk_points sized chunks around the
+        playback window are read and uploaded, a background thread reading
+        ahead of playback."""
+        return self._add_streamed(
+            None,
+            None,
+            (vertex_path, time_path),
+            color,
+            draw_style,
+            window_size,
+            name,
+            chunk_points,
+        )
+
 
 class Zenith2D(ZenithCommon):
     def __init__(self):
         super().__init__()
-        self.__engine__: _zenith.Engine3d = _zenith.Engine3d(shaders)
+        self.__engine__: _zenith.Engine3d = _zenith.Engine3d()
 
     def add_layer(
         self,
@@ -211,6 +699,7 @@ class Zenith2D(ZenithCommon):
         color_data: Optional[Collection[float]] = None,
         string_data: Optional[Collection[str]] = None,
         picking_enabled: Optional[bool] = False,
+        spatial_order: Union[int, SpatialOrder] = SpatialOrder.NONE,
     ) -> Union[int, bool]:
         use_color_data = 1 if color_data is not None else 0
 
@@ -220,7 +709,6 @@ class Zenith2D(ZenithCommon):
         if not self._check_name(name):
             return False
         string_data = self.__validate_string_data__(string_data, len(x_data))
-        self.__string_data__.append(string_data)
 
         data = np.ravel(np.vstack((x_data, y_data, np.ones(len(x_data)))), order="F")
         color = (
@@ -242,9 +730,11 @@ class Zenith2D(ZenithCommon):
             model_id,
             string_data,
             picking_enabled,
+            self._check_spatial_order(spatial_order),
         )
         self.__engine__.add_model(model_id, model)
-        self.__layers__.append(model)
+        self.__layers__[model_id] = model
+        self.__string_data__[model_id] = string_data
         self.__layer_ids__.add(model_id)
         return model_id
 
@@ -269,7 +759,6 @@ class Zenith2D(ZenithCommon):
         if not self._check_name(name):
             return False
         string_data = self.__validate_string_data__(string_data, len(x_data))
-        self.__string_data__.append(string_data)
         if window_size < 1 or window_size > len(x_data):
             self.__logger__.error(
                 "Window size must be gt than 0 and lte to length of x, y, and time_data"
@@ -306,15 +795,71 @@ class Zenith2D(ZenithCommon):
         )
         model_id = self.__num_layers__
         self.__engine__.add_model(model_id, model)
-        self.__layers__.append(model)
+        self.__layers__[model_id] = model
+        self.__string_data__[model_id] = string_data
         self.__layer_ids__.add(model_id)
         return model_id
 
 
+    def add_track_layer(
+        self,
+        x_data: Collection[float],
+        y_data: Collection[float],
+        entity_ids: Collection[int],
+        time_data: Collection[int],
+        color: Union[str, Collection[int], Collection[float]],
+        step: int,
+        name: str,
+        draw_style: Union[int, DrawStyles] = DrawStyles.GL_POINTS,
+    ) -> Union[int, bool]:
+        """Draw one point per entity, moving smoothly along its samples as
+        the timeline plays. Positions are interpolated between keyframes
+        step time units apart, so motion stays fluid even when the data is
+        sampled far less often than frames are drawn. Entities show only
+        while the playhead is within their first and last sample."""
+        if not self._check_values(x_data, y_data, time_data=time_data):
+            return False
+        vertex_data = np.ravel(
+            np.vstack((x_data, y_data, np.ones(len(x_data)))), order="F"
+        )
+        return self._add_tracks(
+            vertex_data, entity_ids, time_data, color, draw_style, step, name
+        )
+
+    def add_streamed_layer(
+        self,
+        x_data: Collection[float],
+        y_data: Collection[float],
+        time_data: Collection[int],
+        color: Union[str, Collection[int], Collection[float]],
+        draw_style: Union[int, DrawStyles],
+        window_size: int,
+        name: str,
+        chunk_points: int = 1 << 20,
+    ) -> Union[int, bool]:
+        """Like add_animated_layer, but only the chunks of chunk_points
+        samples around the playback window are kept on the GPU, so the
+        series is bounded by RAM rather than GPU memory. No picking."""
+        if not self._check_values(x_data, y_data, time_data=time_data):
+            return False
+        vertex_data = np.ravel(
+            np.vstack((x_data, y_data, np.ones(len(x_data)))), order="F"
+        )
+        return self._add_streamed(
+            vertex_data,
+            time_data,
+            None,
+            color,
+            draw_style,
+            window_size,
+            name,
+            chunk_points,
+        )
+
 class Zenith3D(ZenithCommon):
     def __init__(self):
         super().__init__()
-        self.__engine__: _zenith.Engine3d = _zenith.Engine3d(shaders)
+        self.__engine__: _zenith.Engine3d = _zenith.Engine3d()
 
     def add_layer(
         self,
@@ -327,6 +872,7 @@ class Zenith3D(ZenithCommon):
         color_data: Optional[Collection[float]] = None,
         string_data: Optional[Collection[str]] = None,
         picking_enabled: Optional[bool] = False,
+        spatial_order: Union[int, SpatialOrder] = SpatialOrder.NONE,
     ) -> Union[int, bool]:
         use_color_data = 1 if color_data is not None else 0
 
@@ -336,7 +882,6 @@ class Zenith3D(ZenithCommon):
         if not self._check_name(name):
             return False
         string_data = self.__validate_string_data__(string_data, len(x_data))
-        self.__string_data__.append(string_data)
         data = np.ravel(np.vstack((x_data, y_data, z_data)), order="F")
         color = (
             np.array(self.__validate_and_map_color__(color), dtype=np.float32) / 255.0
@@ -358,10 +903,12 @@ class Zenith3D(ZenithCommon):
             model_id,
             string_data,
             picking_enabled,
+            self._check_spatial_order(spatial_order),
         )
 
         self.__engine__.add_model(model_id, model)
-        self.__layers__.append(model)
+        self.__layers__[model_id] = model
+        self.__string_data__[model_id] = string_data
         self.__layer_ids__.add(model_id)
         return model_id
 
@@ -384,7 +931,6 @@ class Zenith3D(ZenithCommon):
         if not self._check_values(x_data, y_data, z_data, time_data):
             return False
         string_data = self.__validate_string_data__(string_data, len(x_data))
-        self.__string_data__.append(string_data)
         draw_style = self._check_draw_style(draw_style)
         if not self._check_name(name):
             return False
@@ -420,6 +966,60 @@ class Zenith3D(ZenithCommon):
             picking_enabled,
         )
         self.__engine__.add_model(model_id, model)
-        self.__layers__.append(model)
+        self.__layers__[model_id] = model
+        self.__string_data__[model_id] = string_data
         self.__layer_ids__.add(model_id)
         return model_id
+
+    def add_track_layer(
+        self,
+        x_data: Collection[float],
+        y_data: Collection[float],
+        z_data: Collection[float],
+        entity_ids: Collection[int],
+        time_data: Collection[int],
+        color: Union[str, Collection[int], Collection[float]],
+        step: int,
+        name: str,
+        draw_style: Union[int, DrawStyles] = DrawStyles.GL_POINTS,
+    ) -> Union[int, bool]:
+        """Draw one point per entity, moving smoothly along its samples as
+        the timeline plays. Positions are interpolated between keyframes
+        step time units apart, so motion stays fluid even when the data is
+        sampled far less often than frames are drawn. Entities show only
+        while the playhead is within their first and last sample."""
+        if not self._check_values(x_data, y_data, z_data, time_data):
+            return False
+        vertex_data = np.ravel(np.vstack((x_data, y_data, z_data)), order="F")
+        return self._add_tracks(
+            vertex_data, entity_ids, time_data, color, draw_style, step, name
+        )
+
+    def add_streamed_layer(
+        self,
+        x_data: Collection[float],
+        y_data: Collection[float],
+        z_data: Collection[float],
+        time_data: Collection[int],
+        color: Union[str, Collection[int], Collection[float]],
+        draw_style: Union[int, DrawStyles],
+        window_size: int,
+        name: str,
+        chunk_points: int = 1 << 20,
+    ) -> Union[int, bool]:
+        """Like add_animated_layer, but only the chunks of chunk_points
+        samples around the playback window are kept on the GPU, so the
+        series is bounded by RAM rather than GPU memory. No picking."""
+        if not self._check_values(x_data, y_data, z_data, time_data):
+            return False
+        vertex_data = np.ravel(np.vstack((x_data, y_data, z_data)), order="F")
+        return self._add_streamed(
+            vertex_data,
+            time_data,
+            None,
+            color,
+            draw_style,
+            window_size,
+            name,
+            chunk_points,
+        )